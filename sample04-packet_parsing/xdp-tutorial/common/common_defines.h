@@ -27,6 +27,7 @@ struct config {
 	int xsk_if_queue;
 	bool xsk_poll_mode;
 	bool unload_all;
+	bool reparse;
 };
 
 /* Defined in common_params.o */
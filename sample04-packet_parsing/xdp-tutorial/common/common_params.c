@@ -182,6 +182,9 @@ void parse_cmdline_args(int argc, char **argv,
 		case 4: /* --unload-all */
 			cfg->unload_all = true;
 			break;
+		case 5: /* --reparse */
+			cfg->reparse = true;
+			break;
 		case 'h':
 			full_help = true;
 			/* fall-through */
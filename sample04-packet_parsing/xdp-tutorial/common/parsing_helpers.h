@@ -29,6 +29,9 @@
 #include <linux/udp.h>
 #include <linux/tcp.h>
 
+/* struct flow_key and flow_hash(), shared with userspace readers */
+#include "../xdp_flow_meta_kern_user.h"
+
 /* Header cursor to keep track of current parsing position */
 struct hdr_cursor {
 	void *pos;
@@ -269,4 +272,423 @@ static __always_inline int parse_tcphdr(struct hdr_cursor *nh,
 	return len;
 }
 
+#ifndef IP_MF
+#define IP_MF		0x2000	/* More Fragments */
+#define IP_OFFSET	0x1FFF	/* Fragment offset, in 8-byte units */
+#endif
+
+/* Allow users of header file to redefine the extension header limit */
+#ifndef IPV6_EXT_MAX_CHAIN
+#define IPV6_EXT_MAX_CHAIN 8
+#endif
+
+#define IP6_MF		0x0001	/* More Fragments */
+#define IP6_OFFSET	0xFFF8	/* Fragment offset, already in bytes */
+
+/*
+ *	struct ipv6_frag_hdr - IPv6 Fragment extension header
+ *	@frag_off: fragment offset and the M flag
+ */
+struct ipv6_frag_hdr {
+	__u8	nexthdr;
+	__u8	reserved;
+	__be16	frag_off;
+	__be32	identification;
+};
+
+static __always_inline int ipv6_is_exthdr(int nexthdr)
+{
+	return nexthdr == IPPROTO_HOPOPTS || nexthdr == IPPROTO_ROUTING ||
+	       nexthdr == IPPROTO_FRAGMENT || nexthdr == IPPROTO_DSTOPTS ||
+	       nexthdr == IPPROTO_AH || nexthdr == IPPROTO_MH;
+}
+
+/*
+ * parse_ip6_exthdrs: skip up to IPV6_EXT_MAX_CHAIN extension headers after
+ * the fixed IPv6 header, nexthdr being its nexthdr field. Returns the
+ * upper-layer protocol with nh->pos on its header, or -1 if a header is
+ * truncated or the chain is longer. A Fragment header sets FLOW_F_FRAG in
+ * *flags, and FLOW_F_LATER_FRAG if it isn't the first fragment; the walk
+ * stops there, as what follows is not a header.
+ */
+static __always_inline int parse_ip6_exthdrs(struct hdr_cursor *nh,
+					     void *data_end,
+					     int nexthdr,
+					     __u8 *flags)
+{
+	struct ipv6_frag_hdr *fh;
+	struct ipv6_opt_hdr *hdr;
+	int i, len;
+
+	#pragma unroll
+	for (i = 0; i < IPV6_EXT_MAX_CHAIN; i++) {
+		if (!ipv6_is_exthdr(nexthdr))
+			return nexthdr;
+
+		hdr = nh->pos;
+		if (hdr + 1 > data_end)
+			return -1;
+
+		/* All types start with nexthdr and a length byte, so every
+		 * iteration ends in the same cursor update and the verifier
+		 * doesn't fork its state per header type.
+		 */
+		if (nexthdr == IPPROTO_FRAGMENT) {
+			fh = nh->pos;
+			if (fh + 1 > data_end)
+				return -1;
+			*flags |= FLOW_F_FRAG;
+			if (fh->frag_off & bpf_htons(IP6_OFFSET))
+				*flags |= FLOW_F_LATER_FRAG;
+			len = sizeof(*fh);
+		} else if (nexthdr == IPPROTO_AH) {
+			len = (hdr->hdrlen + 2) << 2;	/* 4-byte units */
+		} else {
+			len = (hdr->hdrlen + 1) << 3;	/* 8-byte units */
+		}
+
+		if (nh->pos + len > data_end)
+			return -1;
+		nexthdr = hdr->nexthdr;
+		nh->pos += len;
+
+		if (*flags & FLOW_F_LATER_FRAG)
+			return nexthdr;
+	}
+
+	return ipv6_is_exthdr(nexthdr) ? -1 : nexthdr;
+}
+
+/*
+ *	struct frag_key - the IPv4 datagram a fragment belongs to (RFC 791)
+ *
+ *	Later fragments have no L4 header. Programs that need their ports keep
+ *	a map of frag_key to struct frag_ports, filled from the first fragment.
+ */
+struct frag_key {
+	__be32	saddr;
+	__be32	daddr;
+	__be16	id;
+	__u8	ip_proto;
+	__u8	pad;
+};
+
+struct frag_ports {
+	__be16	sport;
+	__be16	dport;
+};
+
+/*
+ * flow_frag_key: frag_key of a parsed IPv4 fragment. Returns 0, or -1 if key
+ * isn't one (not fragmented, not IPv4: IPv6 fragments aren't tracked).
+ */
+static __always_inline int flow_frag_key(const struct flow_key *key,
+					 struct frag_key *fk)
+{
+	if (!(key->flags & FLOW_F_FRAG) || key->h_proto != bpf_htons(ETH_P_IP))
+		return -1;
+	fk->saddr = key->saddr[0];
+	fk->daddr = key->daddr[0];
+	fk->id = key->frag_id;
+	fk->ip_proto = key->ip_proto;
+	fk->pad = 0;
+	return 0;
+}
+
+/*
+ * parse_flow_eth: Ethernet and VLAN part of parse_flow(). Returns the
+ * EtherType after the tags, or -1.
+ */
+static __always_inline int parse_flow_eth(struct hdr_cursor *nh,
+					  void *data_end,
+					  struct flow_key *key)
+{
+	struct collect_vlans vlans = {};
+	struct ethhdr *eth;
+	int h_proto;
+
+	h_proto = parse_ethhdr_vlan(nh, data_end, &eth, &vlans);
+	if (h_proto < 0)
+		return -1;
+	key->nr_vlans = (nh->pos - (void *)(eth + 1)) / sizeof(struct vlan_hdr);
+	key->vlan_id[0] = vlans.id[0];
+#if VLAN_MAX_DEPTH > 1
+	key->vlan_id[1] = vlans.id[1];
+#endif
+	return h_proto;
+}
+
+/*
+ * parse_flow_l3: IP and L4 part of parse_flow(), from the header of
+ * EtherType h_proto at nh->pos. Offsets are taken from start.
+ */
+static __always_inline int parse_flow_l3(struct hdr_cursor *nh,
+					 void *data_end,
+					 struct flow_key *key,
+					 void *start,
+					 int h_proto)
+{
+	struct icmp6hdr *icmp6h;
+	struct icmphdr *icmph;
+	struct ipv6hdr *ip6h;
+	struct udphdr *udph;
+	struct tcphdr *tcph;
+	struct iphdr *iph;
+	int ip_proto;
+
+	key->h_proto = h_proto;
+	key->l3_off = nh->pos - start;
+
+	if (h_proto == bpf_htons(ETH_P_IP)) {
+		ip_proto = parse_iphdr(nh, data_end, &iph);
+		if (ip_proto < 0)
+			return -1;
+		key->saddr[0] = iph->saddr;
+		key->daddr[0] = iph->daddr;
+		if (iph->frag_off & bpf_htons(IP_MF | IP_OFFSET)) {
+			key->flags |= FLOW_F_FRAG;
+			key->frag_id = iph->id;
+			if (iph->frag_off & bpf_htons(IP_OFFSET))
+				key->flags |= FLOW_F_LATER_FRAG;
+		}
+	} else if (h_proto == bpf_htons(ETH_P_IPV6)) {
+		ip_proto = parse_ip6hdr(nh, data_end, &ip6h);
+		if (ip_proto < 0)
+			return -1;
+		__builtin_memcpy(key->saddr, &ip6h->saddr, sizeof(key->saddr));
+		__builtin_memcpy(key->daddr, &ip6h->daddr, sizeof(key->daddr));
+		ip_proto = parse_ip6_exthdrs(nh, data_end, ip_proto, &key->flags);
+		if (ip_proto < 0)
+			return -1;
+	} else {
+		return 0;
+	}
+	key->ip_proto = ip_proto;
+
+	if (key->flags & FLOW_F_LATER_FRAG)
+		return ip_proto;
+	key->l4_off = nh->pos - start;
+
+	switch (ip_proto) {
+	case IPPROTO_TCP:
+		if (parse_tcphdr(nh, data_end, &tcph) < 0)
+			return -1;
+		key->sport = tcph->source;
+		key->dport = tcph->dest;
+		key->flags |= FLOW_F_PORTS;
+		break;
+	case IPPROTO_UDP:
+		if (parse_udphdr(nh, data_end, &udph) < 0)
+			return -1;
+		key->sport = udph->source;
+		key->dport = udph->dest;
+		key->flags |= FLOW_F_PORTS;
+		break;
+	case IPPROTO_ICMP:
+		if (parse_icmphdr(nh, data_end, &icmph) < 0)
+			return -1;
+		key->sport = *(__be16 *)icmph;
+		if (icmph->type == ICMP_ECHO || icmph->type == ICMP_ECHOREPLY)
+			key->dport = icmph->un.echo.id;
+		break;
+	case IPPROTO_ICMPV6:
+		if (parse_icmp6hdr(nh, data_end, &icmp6h) < 0)
+			return -1;
+		key->sport = *(__be16 *)icmp6h;
+		if (icmp6h->icmp6_type == ICMPV6_ECHO_REQUEST ||
+		    icmp6h->icmp6_type == ICMPV6_ECHO_REPLY)
+			key->dport = icmp6h->icmp6_identifier;
+		break;
+	default:
+		/* Tunnels (GRE, IP-in-IP) leave nh->pos on their header */
+		return ip_proto;
+	}
+	key->payload_off = nh->pos - start;
+
+	return ip_proto;
+}
+
+/*
+ * parse_flow: single pass from the Ethernet header to the L4 header, past any
+ * IPv6 extension headers, filling key. Only reads the packet. Returns the L4
+ * protocol (0 if not IP), or -1 if a header is truncated, with key holding
+ * what was parsed up to there.
+ */
+static __always_inline int parse_flow(struct hdr_cursor *nh,
+				      void *data_end,
+				      struct flow_key *key)
+{
+	void *start = nh->pos;
+	int h_proto;
+
+	__builtin_memset(key, 0, sizeof(*key));
+
+	h_proto = parse_flow_eth(nh, data_end, key);
+	if (h_proto < 0)
+		return -1;
+	return parse_flow_l3(nh, data_end, key, start, h_proto);
+}
+
+/* Allow users of header file to use other UDP ports */
+#ifndef VXLAN_UDP_PORT
+#define VXLAN_UDP_PORT	4789
+#endif
+#ifndef GENEVE_UDP_PORT
+#define GENEVE_UDP_PORT	6081
+#endif
+
+/* struct tunnel_key types */
+#define TUNNEL_NONE	0
+#define TUNNEL_VXLAN	1
+#define TUNNEL_GENEVE	2
+#define TUNNEL_GRE	3
+#define TUNNEL_IPIP	4	/* IPv4 or IPv6 in IPv4 or IPv6 */
+
+/*
+ *	struct vxlanhdr - VXLAN header (RFC 7348)
+ *	@vx_flags: VXLAN_HF_VNI must be set
+ *	@vx_vni: VNI in the upper 24 bits
+ */
+struct vxlanhdr {
+	__be32	vx_flags;
+	__be32	vx_vni;
+};
+
+#define VXLAN_HF_VNI	0x08000000
+
+/*
+ *	struct genevehdr - GENEVE header (RFC 8926), options follow
+ *	@ver_opt_len: 2-bit version, 6-bit option length in 4-byte units
+ *	@proto_type: EtherType of the payload, ETH_P_TEB for Ethernet
+ */
+struct genevehdr {
+	__u8	ver_opt_len;
+	__u8	flags;
+	__be16	proto_type;
+	__u8	vni[3];
+	__u8	rsvd;
+};
+
+/*
+ *	struct gre_base_hdr - GRE header (RFC 2784/2890), then the optional
+ *	checksum, key and sequence number words its flags announce
+ */
+struct gre_base_hdr {
+	__be16	flags;
+	__be16	protocol;
+};
+
+#define GRE_F_CSUM	0x8000
+#define GRE_F_ROUTING	0x4000
+#define GRE_F_KEY	0x2000
+#define GRE_F_SEQ	0x1000
+#define GRE_F_VERSION	0x0007
+
+/*
+ *	struct tunnel_key - what parse_flow_tunnel() found
+ *	@vni: VXLAN or GENEVE VNI, or GRE key
+ *	@type: TUNNEL_*; inner is all zero for TUNNEL_NONE
+ */
+struct tunnel_key {
+	struct flow_key	outer;
+	struct flow_key	inner;
+	__u32		vni;
+	__u32		type;
+};
+
+/*
+ * parse_flow_tunnel: parse_flow() into tk->outer and, if that carries VXLAN,
+ * GENEVE, GRE or IP-in-IP, once more over the encapsulated packet into
+ * tk->inner, with offsets still from the start of the outer frame. Returns
+ * tk->type, or -1 if a header is truncated.
+ */
+static __always_inline int parse_flow_tunnel(struct hdr_cursor *nh,
+					     void *data_end,
+					     struct tunnel_key *tk)
+{
+	void *start = nh->pos;
+	struct gre_base_hdr *greh;
+	struct genevehdr *gh;
+	struct vxlanhdr *vxh;
+	int ip_proto, h_proto, len;
+	__be32 *grekey;
+
+	__builtin_memset(&tk->inner, 0, sizeof(tk->inner));
+	tk->vni = 0;
+	tk->type = TUNNEL_NONE;
+
+	ip_proto = parse_flow(nh, data_end, &tk->outer);
+	if (ip_proto < 0)
+		return -1;
+	if (tk->outer.flags & FLOW_F_LATER_FRAG)
+		return TUNNEL_NONE;
+
+	if (ip_proto == IPPROTO_UDP &&
+	    tk->outer.dport == bpf_htons(VXLAN_UDP_PORT)) {
+		vxh = nh->pos;
+		if (vxh + 1 > data_end)
+			return -1;
+		if (!(vxh->vx_flags & bpf_htonl(VXLAN_HF_VNI)))
+			return TUNNEL_NONE;
+		tk->vni = bpf_ntohl(vxh->vx_vni) >> 8;
+		nh->pos = vxh + 1;
+		h_proto = bpf_htons(ETH_P_TEB);
+		tk->type = TUNNEL_VXLAN;
+	} else if (ip_proto == IPPROTO_UDP &&
+		   tk->outer.dport == bpf_htons(GENEVE_UDP_PORT)) {
+		gh = nh->pos;
+		if (gh + 1 > data_end)
+			return -1;
+		if (gh->ver_opt_len >> 6)	/* only version 0 */
+			return TUNNEL_NONE;
+		tk->vni = (gh->vni[0] << 16) | (gh->vni[1] << 8) | gh->vni[2];
+		h_proto = gh->proto_type;
+		len = sizeof(*gh) + (gh->ver_opt_len & 0x3f) * 4;
+		if (nh->pos + len > data_end)
+			return -1;
+		nh->pos += len;
+		tk->type = TUNNEL_GENEVE;
+	} else if (ip_proto == IPPROTO_GRE) {
+		greh = nh->pos;
+		if (greh + 1 > data_end)
+			return -1;
+		/* Plain GRE only: no source routing, no PPTP (version 1) */
+		if (greh->flags & bpf_htons(GRE_F_ROUTING | GRE_F_VERSION))
+			return TUNNEL_NONE;
+		len = sizeof(*greh);
+		if (greh->flags & bpf_htons(GRE_F_CSUM))
+			len += 4;
+		if (greh->flags & bpf_htons(GRE_F_KEY)) {
+			grekey = nh->pos + len;
+			if (grekey + 1 > data_end)
+				return -1;
+			tk->vni = bpf_ntohl(*grekey);
+			len += 4;
+		}
+		if (greh->flags & bpf_htons(GRE_F_SEQ))
+			len += 4;
+		if (nh->pos + len > data_end)
+			return -1;
+		h_proto = greh->protocol;
+		nh->pos += len;
+		tk->type = TUNNEL_GRE;
+	} else if (ip_proto == IPPROTO_IPIP || ip_proto == IPPROTO_IPV6) {
+		h_proto = ip_proto == IPPROTO_IPIP ? bpf_htons(ETH_P_IP) :
+						     bpf_htons(ETH_P_IPV6);
+		tk->type = TUNNEL_IPIP;
+	} else {
+		return TUNNEL_NONE;
+	}
+
+	if (h_proto == bpf_htons(ETH_P_TEB)) {
+		h_proto = parse_flow_eth(nh, data_end, &tk->inner);
+		if (h_proto < 0)
+			return -1;
+	}
+	if (parse_flow_l3(nh, data_end, &tk->inner, start, h_proto) < 0)
+		return -1;
+
+	return tk->type;
+}
+
 #endif /* __PARSING_HELPERS_H */
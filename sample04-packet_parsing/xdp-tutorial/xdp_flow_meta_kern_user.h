@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Used by xdp_flow_meta_func (kernel side), the stages after it (TC
+ * classifier, AF_XDP reader) and xdp_parse_bench, for sharing the layout
+ * of the metadata xdp_flow_meta_func puts in front of the packet, and of
+ * the struct flow_key parse_flow() (common/parsing_helpers.h) fills.
+ */
+#ifndef __XDP_FLOW_META_KERN_USER_H
+#define __XDP_FLOW_META_KERN_USER_H
+
+#define FLOW_META_MAGIC		0xf10e
+
+/* struct flow_key flags */
+#define FLOW_F_PORTS		(1 << 0)	/* sport/dport are TCP/UDP ports */
+#define FLOW_F_FRAG		(1 << 1)	/* IP fragment */
+#define FLOW_F_LATER_FRAG	(1 << 2)	/* not the first fragment: no L4 header */
+#define FLOW_F_FRAG_PORTS	(1 << 3)	/* ports taken from the first fragment */
+
+/*
+ *	struct flow_key - what parse_flow() found, in one cache line
+ *	Addresses and ports are in network byte order, IPv4 uses saddr[0] and
+ *	daddr[0]. For ICMP, sport holds type and code and dport the echo
+ *	identifier. Offsets are from the start of the frame, 0 when the header
+ *	isn't there.
+ */
+struct flow_key {
+	__u32	saddr[4];
+	__u32	daddr[4];
+	__be16	sport;
+	__be16	dport;
+	__be16	h_proto;	/* EtherType after the VLAN tags */
+	__u8	ip_proto;
+	__u8	flags;		/* FLOW_F_* */
+	__u16	vlan_id[2];	/* outermost first */
+	__u8	nr_vlans;
+	__u8	pad;
+	__u16	l3_off;
+	__u16	l4_off;
+	__u16	payload_off;
+	__be16	frag_id;	/* IPv4 identification, for fragments */
+};
+
+_Static_assert(sizeof(struct flow_key) <= 64, "flow_key must fit a cache line");
+
+/* murmur3 finalizer */
+static __always_inline __u32 flow_hash_mix(__u32 h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+/*
+ * flow_hash: hash of the addresses, ports and L4 protocol of a parsed key.
+ * IPv4 keys only have saddr[0]/daddr[0] set, the other words are zero.
+ * Unrolled by hand, so userspace includes it without #pragma unroll.
+ */
+static __always_inline __u32 flow_hash(const struct flow_key *key)
+{
+	__u32 h = key->ip_proto;
+
+	h = flow_hash_mix(h ^ key->saddr[0] ^ (key->daddr[0] * 0x9e3779b1));
+	h = flow_hash_mix(h ^ key->saddr[1] ^ (key->daddr[1] * 0x9e3779b1));
+	h = flow_hash_mix(h ^ key->saddr[2] ^ (key->daddr[2] * 0x9e3779b1));
+	h = flow_hash_mix(h ^ key->saddr[3] ^ (key->daddr[3] * 0x9e3779b1));
+	return flow_hash_mix(h ^ (((__u32)key->sport << 16) | key->dport));
+}
+
+/* parse_flow() result in the data_meta area, right before the Ethernet
+ * header. bpf_xdp_adjust_meta() allows at most 32 bytes, so this is a
+ * compact struct flow_key: IPv6 addresses are not copied, readers take
+ * them from the packet at l3_off. magic is last, next to the packet, so
+ * a reader checks it before trusting the rest.
+ */
+struct flow_meta {
+	__u32	hash;		/* flow_hash() of the flow key */
+	__be32	saddr;		/* IPv4 only */
+	__be32	daddr;
+	__be16	sport;
+	__be16	dport;
+	__be16	h_proto;
+	__u8	ip_proto;
+	__u8	flags;		/* FLOW_F_* */
+	__u16	vlan_id;	/* outer tag */
+	__u16	l3_off;
+	__u16	l4_off;
+	__u16	payload_off;
+	__u8	nr_vlans;
+	__u8	pad;
+	__u16	magic;		/* FLOW_META_MAGIC */
+};
+
+_Static_assert(sizeof(struct flow_meta) == 32, "flow_meta must fit data_meta");
+
+/* meta_stats map indexes: packets consumers took from the metadata, or
+ * had to parse again because there was none
+ */
+#define META_STAT_HIT	0
+#define META_STAT_MISS	1
+#define META_STAT_MAX	2
+
+#endif /* __XDP_FLOW_META_KERN_USER_H */
@@ -0,0 +1,445 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "AF_XDP reader of the XDP flow metadata\n"
+	" - Attaches xdp_flow_meta_func to --dev and binds an AF_XDP socket to\n"
+	"   queue -Q: packets arrive with the parse_flow() result in front\n"
+	" - Counts packets per L4 protocol and flows per second from the\n"
+	"   metadata, parsing again only when there is none (or --reparse)\n"
+	" - Prints the ns/pkt spent classifying, to compare with --reparse\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf_endian.h>
+#include <xdp/libxdp.h>
+#include <xdp/xsk.h>
+
+/* net/if.h (via common_defines.h) must come before linux/if.h (via linux/icmp.h) */
+#include "./common/common_params.h"
+#include "./common/common_user_bpf_xdp.h"
+
+#include <netinet/in.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/icmp.h>
+#include <linux/icmpv6.h>
+#include <linux/udp.h>
+#include <linux/tcp.h>
+
+#include "xdp_flow_meta_kern_user.h"
+
+#define NUM_FRAMES		4096
+#define FRAME_SIZE		XSK_UMEM__DEFAULT_FRAME_SIZE
+#define RX_BATCH_SIZE		64
+#define FLOW_BUCKETS		4096	/* power of two, the flow hash is masked */
+#define MAX_VLANS		2	/* VLAN_MAX_DEPTH of parse_flow() */
+#define MAX_EXTHDRS		8	/* IPV6_EXT_MAX_CHAIN of parse_flow() */
+
+static const char *default_filename = "xdp_prog_kern.o";
+static const char *default_progname = "xdp_flow_meta_func";
+
+static const struct option_wrapper long_options[] = {
+
+	{{"help",        no_argument,		NULL, 'h' },
+	 "Show help", false},
+
+	{{"dev",         required_argument,	NULL, 'd' },
+	 "Operate on device <ifname>", "<ifname>", true},
+
+	{{"skb-mode",    no_argument,		NULL, 'S' },
+	 "Install XDP program in SKB (AKA generic) mode"},
+
+	{{"native-mode", no_argument,		NULL, 'N' },
+	 "Install XDP program in native mode"},
+
+	{{"auto-mode",   no_argument,		NULL, 'A' },
+	 "Auto-detect SKB or native mode"},
+
+	{{"copy",        no_argument,		NULL, 'c' },
+	 "Force copy mode"},
+
+	{{"zero-copy",   no_argument,		NULL, 'z' },
+	 "Force zero-copy mode"},
+
+	{{"queue",       required_argument,	NULL, 'Q' },
+	 "Configure interface receive queue for AF_XDP, default=0"},
+
+	{{"poll-mode",   no_argument,		NULL, 'p' },
+	 "Use the poll() API waiting for packets to arrive"},
+
+	{{"reparse",     no_argument,		NULL,  5  },
+	 "Ignore the metadata and parse every packet again"},
+
+	{{"quiet",       no_argument,		NULL, 'q' },
+	 "Quiet mode (no output)"},
+
+	{{"filename",    required_argument,	NULL,  1  },
+	 "Load program from <file>", "<file>"},
+
+	{{"progname",    required_argument,	NULL,  2  },
+	 "Load program from function <name> in the ELF file", "<name>"},
+
+	{{0, 0, NULL,  0 }, NULL, false}
+};
+
+struct xsk_info {
+	struct xsk_ring_prod fq;
+	struct xsk_ring_cons cq;
+	struct xsk_ring_cons rx;
+	struct xsk_umem *umem;
+	struct xsk_socket *xsk;
+	void *buffer;
+};
+
+/* Reset every interval */
+struct rx_stats {
+	__u64 packets;
+	__u64 meta;		/* classified from the metadata */
+	__u64 reparsed;		/* no metadata (or --reparse): parsed again */
+	__u64 bad;		/* truncated, not even parse_frame() could tell */
+	__u64 tcp, udp, icmp, other;
+	__u64 ns;		/* spent in classify() */
+	__u8 flows[FLOW_BUCKETS];
+};
+
+static volatile sig_atomic_t global_exit;
+
+static void exit_application(int signal)
+{
+	global_exit = 1;
+}
+
+static __u64 gettime(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (__u64)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* The fields of struct flow_key classify() needs, filled like parse_flow()
+ * does in the kernel so both paths hash a flow the same. parsing_helpers.h
+ * is written for the verifier and doesn't build warning-clean here.
+ * Returns the L4 protocol (0 if not IP), or -1 if a header is truncated.
+ */
+static int parse_frame(unsigned char *pkt, __u32 len, struct flow_key *key)
+{
+	unsigned char *pos = pkt + sizeof(struct ethhdr);
+	unsigned char *end = pkt + len;
+	struct ipv6hdr *ip6h;
+	struct iphdr *iph;
+	__be16 h_proto;
+	int ip_proto, i, hlen;
+
+	memset(key, 0, sizeof(*key));
+	if (pos > end)
+		return -1;
+	h_proto = ((struct ethhdr *)pkt)->h_proto;
+	for (i = 0; i < MAX_VLANS; i++) {
+		if (h_proto != htons(ETH_P_8021Q) && h_proto != htons(ETH_P_8021AD))
+			break;
+		if (pos + 4 > end)
+			return -1;
+		h_proto = *(__be16 *)(pos + 2);	/* TCI, then EtherType */
+		pos += 4;
+	}
+
+	if (h_proto == htons(ETH_P_IP)) {
+		iph = (struct iphdr *)pos;
+		if (pos + sizeof(*iph) > end || iph->ihl < 5 || pos + iph->ihl * 4 > end)
+			return -1;
+		key->saddr[0] = iph->saddr;
+		key->daddr[0] = iph->daddr;
+		if (iph->frag_off & htons(0x1fff))	/* IP_OFFSET */
+			key->flags |= FLOW_F_FRAG | FLOW_F_LATER_FRAG;
+		ip_proto = iph->protocol;
+		pos += iph->ihl * 4;
+	} else if (h_proto == htons(ETH_P_IPV6)) {
+		ip6h = (struct ipv6hdr *)pos;
+		if (pos + sizeof(*ip6h) > end)
+			return -1;
+		memcpy(key->saddr, &ip6h->saddr, sizeof(key->saddr));
+		memcpy(key->daddr, &ip6h->daddr, sizeof(key->daddr));
+		ip_proto = ip6h->nexthdr;
+		pos += sizeof(*ip6h);
+		for (i = 0; i < MAX_EXTHDRS; i++) {
+			if (ip_proto != IPPROTO_HOPOPTS && ip_proto != IPPROTO_ROUTING &&
+			    ip_proto != IPPROTO_FRAGMENT && ip_proto != IPPROTO_DSTOPTS &&
+			    ip_proto != IPPROTO_AH && ip_proto != IPPROTO_MH)
+				break;
+			if (pos + 8 > end)
+				return -1;
+			if (ip_proto == IPPROTO_FRAGMENT) {
+				if (*(__be16 *)(pos + 2) & htons(0xfff8))	/* IP6_OFFSET */
+					key->flags |= FLOW_F_FRAG | FLOW_F_LATER_FRAG;
+				hlen = 8;
+			} else if (ip_proto == IPPROTO_AH) {
+				hlen = (pos[1] + 2) << 2;
+			} else {
+				hlen = (pos[1] + 1) << 3;
+			}
+			ip_proto = pos[0];
+			pos += hlen;
+			if (pos > end)
+				return -1;
+			if (key->flags & FLOW_F_LATER_FRAG)
+				break;
+		}
+	} else {
+		return 0;
+	}
+	key->ip_proto = ip_proto;
+
+	/* Later fragments have no L4 header */
+	if (key->flags & FLOW_F_LATER_FRAG)
+		return ip_proto;
+
+	switch (ip_proto) {
+	case IPPROTO_TCP:
+		hlen = ((struct tcphdr *)pos)->doff * 4;
+		if (pos + sizeof(struct tcphdr) > end || hlen < (int)sizeof(struct tcphdr) ||
+		    pos + hlen > end)
+			return -1;
+		key->sport = ((struct tcphdr *)pos)->source;
+		key->dport = ((struct tcphdr *)pos)->dest;
+		key->flags |= FLOW_F_PORTS;
+		break;
+	case IPPROTO_UDP:
+		if (pos + sizeof(struct udphdr) > end ||
+		    ntohs(((struct udphdr *)pos)->len) < sizeof(struct udphdr))
+			return -1;
+		key->sport = ((struct udphdr *)pos)->source;
+		key->dport = ((struct udphdr *)pos)->dest;
+		key->flags |= FLOW_F_PORTS;
+		break;
+	case IPPROTO_ICMP:
+		if (pos + sizeof(struct icmphdr) > end)
+			return -1;
+		key->sport = *(__be16 *)pos;	/* type and code */
+		if (pos[0] == ICMP_ECHO || pos[0] == ICMP_ECHOREPLY)
+			key->dport = ((struct icmphdr *)pos)->un.echo.id;
+		break;
+	case IPPROTO_ICMPV6:
+		if (pos + sizeof(struct icmp6hdr) > end)
+			return -1;
+		key->sport = *(__be16 *)pos;
+		if (pos[0] == ICMPV6_ECHO_REQUEST || pos[0] == ICMPV6_ECHO_REPLY)
+			key->dport = ((struct icmp6hdr *)pos)->icmp6_identifier;
+		break;
+	}
+	return ip_proto;
+}
+
+/* What a reader does with each packet: take the flow from the metadata
+ * xdp_flow_meta_func left in the headroom, or parse the frame again
+ */
+static void classify(unsigned char *pkt, __u32 len, bool reparse, struct rx_stats *st)
+{
+	struct flow_meta *meta = (struct flow_meta *)(pkt - sizeof(*meta));
+	bool from_meta = !reparse && meta->magic == FLOW_META_MAGIC;
+	struct flow_key key;
+	__u32 hash;
+	__u8 ip_proto;
+
+	/* The frame goes back to the fill ring: a packet without metadata
+	 * must not find this one's there
+	 */
+	meta->magic = 0;
+
+	if (from_meta) {
+		hash = meta->hash;
+		ip_proto = meta->ip_proto;
+		st->meta++;
+	} else {
+		if (parse_frame(pkt, len, &key) < 0) {
+			st->bad++;
+			return;
+		}
+		hash = flow_hash(&key);
+		ip_proto = key.ip_proto;
+		st->reparsed++;
+	}
+
+	switch (ip_proto) {
+	case IPPROTO_TCP:	st->tcp++; break;
+	case IPPROTO_UDP:	st->udp++; break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:	st->icmp++; break;
+	default:		st->other++; break;
+	}
+	st->flows[hash & (FLOW_BUCKETS - 1)] = 1;
+}
+
+static void print_stats(struct rx_stats *st, double period)
+{
+	int i, flows = 0;
+
+	for (i = 0; i < FLOW_BUCKETS; i++)
+		flows += st->flows[i];
+
+	printf("%10.0f pps  meta %-10llu reparsed %-10llu bad %-6llu "
+	       "tcp %-8llu udp %-8llu icmp %-6llu other %-6llu flows ~%-5d %6.1f ns/pkt\n",
+	       st->packets / period, st->meta, st->reparsed, st->bad,
+	       st->tcp, st->udp, st->icmp, st->other, flows,
+	       st->packets ? (double)st->ns / st->packets : 0.0);
+	memset(st, 0, sizeof(*st));
+}
+
+static int xsk_setup(struct xsk_info *xi, struct config *cfg, int xsks_map_fd)
+{
+	struct xsk_socket_config xsk_cfg = {
+		.rx_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+		.tx_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+		.libxdp_flags = XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD,
+		.bind_flags = cfg->xsk_bind_flags,
+	};
+	__u64 size = (__u64)NUM_FRAMES * FRAME_SIZE;
+	__u32 idx, i;
+	int err;
+
+	if (posix_memalign(&xi->buffer, getpagesize(), size)) {
+		fprintf(stderr, "ERR: can't allocate buffer memory\n");
+		return -1;
+	}
+	err = xsk_umem__create(&xi->umem, xi->buffer, size, &xi->fq, &xi->cq, NULL);
+	if (err) {
+		fprintf(stderr, "ERR: creating umem: %s\n", strerror(-err));
+		return -1;
+	}
+	err = xsk_socket__create(&xi->xsk, cfg->ifname, cfg->xsk_if_queue,
+				 xi->umem, &xi->rx, NULL, &xsk_cfg);
+	if (err) {
+		fprintf(stderr, "ERR: creating AF_XDP socket: %s\n", strerror(-err));
+		return -1;
+	}
+	err = xsk_socket__update_xskmap(xi->xsk, xsks_map_fd);
+	if (err) {
+		fprintf(stderr, "ERR: adding socket to xsks_map: %s\n", strerror(-err));
+		return -1;
+	}
+
+	/* Half the frames wait in the fill ring, the rest are in flight */
+	if (xsk_ring_prod__reserve(&xi->fq, XSK_RING_PROD__DEFAULT_NUM_DESCS, &idx) !=
+	    XSK_RING_PROD__DEFAULT_NUM_DESCS) {
+		fprintf(stderr, "ERR: populating fill ring\n");
+		return -1;
+	}
+	for (i = 0; i < XSK_RING_PROD__DEFAULT_NUM_DESCS; i++)
+		*xsk_ring_prod__fill_addr(&xi->fq, idx++) = (__u64)i * FRAME_SIZE;
+	xsk_ring_prod__submit(&xi->fq, XSK_RING_PROD__DEFAULT_NUM_DESCS);
+	return 0;
+}
+
+static void rx_and_classify(struct xsk_info *xi, struct config *cfg)
+{
+	struct pollfd fds = {
+		.fd = xsk_socket__fd(xi->xsk),
+		.events = POLLIN,
+	};
+	static struct rx_stats st;
+	__u64 start, last = gettime();
+	__u32 idx_rx, idx_fq, rcvd, i;
+	const struct xdp_desc *desc;
+
+	while (!global_exit) {
+		if (cfg->xsk_poll_mode && poll(&fds, 1, 1000) <= 0)
+			goto report;
+
+		rcvd = xsk_ring_cons__peek(&xi->rx, RX_BATCH_SIZE, &idx_rx);
+		if (!rcvd)
+			goto report;
+
+		/* Every received frame goes straight back to the fill ring */
+		while (xsk_ring_prod__reserve(&xi->fq, rcvd, &idx_fq) != rcvd) {
+			if (global_exit)
+				return;
+		}
+
+		start = gettime();
+		for (i = 0; i < rcvd; i++) {
+			desc = xsk_ring_cons__rx_desc(&xi->rx, idx_rx + i);
+			classify(xsk_umem__get_data(xi->buffer, desc->addr), desc->len,
+				 cfg->reparse, &st);
+			*xsk_ring_prod__fill_addr(&xi->fq, idx_fq + i) = desc->addr;
+		}
+		st.ns += gettime() - start;
+		st.packets += rcvd;
+
+		xsk_ring_prod__submit(&xi->fq, rcvd);
+		xsk_ring_cons__release(&xi->rx, rcvd);
+report:
+		start = gettime();
+		if (start - last >= 1000000000ULL) {
+			if (verbose)
+				print_stats(&st, (start - last) / 1e9);
+			last = start;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct xdp_program *program;
+	struct xsk_info xi = {};
+	int xsks_map_fd, err;
+
+	struct config cfg = {
+		.attach_mode = XDP_MODE_NATIVE,
+		.ifindex     = -1,
+	};
+
+	strncpy(cfg.filename, default_filename, sizeof(cfg.filename));
+	strncpy(cfg.progname, default_progname, sizeof(cfg.progname));
+	parse_cmdline_args(argc, argv, long_options, &cfg, __doc__);
+
+	/* Required option */
+	if (cfg.ifindex == -1) {
+		fprintf(stderr, "ERR: required option --dev missing\n\n");
+		usage(argv[0], __doc__, long_options, (argc == 1));
+		return EXIT_FAIL_OPTION;
+	}
+
+	program = load_bpf_and_xdp_attach(&cfg);
+	xsks_map_fd = bpf_object__find_map_fd_by_name(xdp_program__bpf_obj(program),
+						      "xsks_map");
+	if (xsks_map_fd < 0) {
+		fprintf(stderr, "ERR: no xsks_map in %s\n", cfg.filename);
+		err = EXIT_FAIL_BPF;
+		goto out;
+	}
+
+	signal(SIGINT, exit_application);
+	signal(SIGTERM, exit_application);
+
+	if (xsk_setup(&xi, &cfg, xsks_map_fd)) {
+		err = EXIT_FAIL_BPF;
+		goto out;
+	}
+	if (verbose)
+		printf("Reading %s queue %d%s\n", cfg.ifname, cfg.xsk_if_queue,
+		       cfg.reparse ? ", parsing every packet again" : "");
+
+	rx_and_classify(&xi, &cfg);
+	err = EXIT_OK;
+
+out:
+	if (xi.xsk)
+		xsk_socket__delete(xi.xsk);
+	if (xi.umem)
+		xsk_umem__delete(xi.umem);
+	free(xi.buffer);
+	xdp_program__detach(program, cfg.ifindex, cfg.attach_mode, 0);
+	xdp_program__close(program);
+	return err;
+}
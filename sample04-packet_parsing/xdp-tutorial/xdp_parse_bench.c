@@ -0,0 +1,673 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP flow dissector benchmark\n"
+	" - Runs xdp_flow_func (parse_flow) with BPF_PROG_TEST_RUN on one\n"
+	"   packet per protocol mix, next to xdp_pass_func as the baseline\n"
+	" - Prints the verifier's instruction count and the ns/pkt, offsets\n"
+	"   and flags of every path\n"
+	" - Checks that later IPv4 fragments get the ports of their first one\n"
+	" - Checks xdp_tunnel_flow_func (parse_flow_tunnel) against VXLAN,\n"
+	"   GENEVE, GRE and IP-in-IP test vectors\n"
+	" - Measures the data_meta hand-off: what xdp_flow_meta_func adds to\n"
+	"   write the flow metadata, against what a later stage\n"
+	"   (xdp_meta_consumer_func) saves by not parsing again\n";
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+/* net/if.h (via common_defines.h) must come before linux/if.h (via linux/icmp.h) */
+#include "./common/common_defines.h"
+#include "xdp_flow_meta_kern_user.h"
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/icmp.h>
+#include <linux/icmpv6.h>
+#include <linux/udp.h>
+#include <linux/tcp.h>
+
+#define PKT_LEN		192
+#define FRAG_ID		0x1234	/* IPv4 identification of every built packet */
+#define LOG_BUF_SIZE	(64 * 1024)
+
+/* Must match struct tunnel_key in common/parsing_helpers.h */
+struct tunnel_key {
+	struct flow_key	outer;
+	struct flow_key	inner;
+	__u32		vni;
+	__u32		type;
+};
+
+struct mix {
+	const char *name;
+	int vlans;
+	__u16 h_proto;		/* ETH_P_* */
+	__u8 ip_proto;
+	__u16 frag_off;		/* IPv4 or IPv6 Fragment header, host byte order */
+	int nr_ext;		/* IPv6 extension headers, the last one the
+				 * Fragment header if frag_off is set */
+};
+
+static const struct mix mixes[] = {
+	{ "arp",		0, ETH_P_ARP,  0,		0 },
+	{ "ipv4/tcp",		0, ETH_P_IP,   IPPROTO_TCP,	0 },
+	{ "ipv4/udp",		0, ETH_P_IP,   IPPROTO_UDP,	0 },
+	{ "ipv4/icmp",		0, ETH_P_IP,   IPPROTO_ICMP,	0 },
+	{ "ipv4/udp frag",	0, ETH_P_IP,   IPPROTO_UDP,	0x2000 },
+	{ "ipv4 later frag",	0, ETH_P_IP,   IPPROTO_UDP,	185 },
+	{ "vlan/ipv4/udp",	1, ETH_P_IP,   IPPROTO_UDP,	0 },
+	{ "qinq/ipv4/tcp",	2, ETH_P_IP,   IPPROTO_TCP,	0 },
+	{ "ipv6/tcp",		0, ETH_P_IPV6, IPPROTO_TCP,	0 },
+	{ "ipv6/udp",		0, ETH_P_IPV6, IPPROTO_UDP,	0 },
+	{ "ipv6/icmpv6",	0, ETH_P_IPV6, IPPROTO_ICMPV6,	0 },
+	{ "vlan/ipv6/udp",	1, ETH_P_IPV6, IPPROTO_UDP,	0 },
+	{ "ipv6 1 ext/udp",	0, ETH_P_IPV6, IPPROTO_UDP,	0, 1 },
+	{ "ipv6 2 ext/udp",	0, ETH_P_IPV6, IPPROTO_UDP,	0, 2 },
+	{ "ipv6 4 ext/udp",	0, ETH_P_IPV6, IPPROTO_UDP,	0, 4 },
+	{ "ipv6 8 ext/udp",	0, ETH_P_IPV6, IPPROTO_UDP,	0, 8 },
+	{ "ipv6 9 ext/udp",	0, ETH_P_IPV6, IPPROTO_UDP,	0, 9 },
+	{ "ipv6 frag/udp",	0, ETH_P_IPV6, IPPROTO_UDP,	0x0001, 1 },
+	{ "ipv6 later frag",	0, ETH_P_IPV6, IPPROTO_UDP,	185 << 3, 1 },
+	{ "ipv6 hbh+frag",	0, ETH_P_IPV6, IPPROTO_TCP,	0x0001, 2 },
+};
+
+/* Run in order: the first fragment fills frag_ports for the next ones */
+static const struct {
+	const char *name;
+	__u16 id;
+	__u16 frag_off;		/* host byte order */
+	bool want_ports;
+} frags[] = {
+	{ "first",		0x4242, 0x2000,		true },
+	{ "middle",		0x4242, 0x2000 | 185,	true },
+	{ "last",		0x4242, 370,		true },
+	{ "other datagram",	0x4343, 185,		false },
+};
+
+/* Tunnel test vectors: headers listed outermost first. Each layer sets
+ * the protocol field of the one before it, the way the encapsulation in
+ * a capture would.
+ */
+enum layer {
+	L_END,
+	L_ETH,
+	L_VLAN,
+	L_IP4,
+	L_IP6,
+	L_UDP,
+	L_TCP,
+	L_VXLAN,
+	L_GENEVE,
+	L_GENEVE_OPT,	/* with 8 bytes of options */
+	L_GRE,
+	L_GRE_KEY,	/* with checksum, key and sequence number */
+};
+
+#define TUNNEL_NONE	0
+#define TUNNEL_VXLAN	1
+#define TUNNEL_GENEVE	2
+#define TUNNEL_GRE	3
+#define TUNNEL_IPIP	4
+
+#define TEST_VNI	0x123456
+
+struct tvec {
+	const char *name;
+	enum layer layers[10];
+};
+
+static const struct tvec tvecs[] = {
+	{ "udp/53",		{ L_ETH, L_IP4, L_UDP } },
+	{ "vxlan",		{ L_ETH, L_IP4, L_UDP, L_VXLAN, L_ETH, L_IP4, L_UDP } },
+	{ "vlan/vxlan",		{ L_ETH, L_VLAN, L_IP4, L_UDP, L_VXLAN, L_ETH, L_IP4, L_TCP } },
+	{ "vxlan6/vlan",	{ L_ETH, L_IP6, L_UDP, L_VXLAN, L_ETH, L_VLAN, L_IP6, L_TCP } },
+	{ "geneve",		{ L_ETH, L_IP4, L_UDP, L_GENEVE, L_ETH, L_IP4, L_TCP } },
+	{ "geneve opts",	{ L_ETH, L_IP4, L_UDP, L_GENEVE_OPT, L_ETH, L_IP6, L_UDP } },
+	{ "geneve ipv4",	{ L_ETH, L_IP6, L_UDP, L_GENEVE, L_IP4, L_UDP } },
+	{ "gre",		{ L_ETH, L_IP4, L_GRE, L_IP4, L_TCP } },
+	{ "gre key/teb",	{ L_ETH, L_IP4, L_GRE_KEY, L_ETH, L_IP4, L_UDP } },
+	{ "ip6gre",		{ L_ETH, L_IP6, L_GRE, L_IP6, L_UDP } },
+	{ "ipip",		{ L_ETH, L_IP4, L_IP4, L_TCP } },
+	{ "ip6ip6",		{ L_ETH, L_IP6, L_IP6, L_UDP } },
+	{ "ipv4 in ipv6",	{ L_ETH, L_IP6, L_IP4, L_UDP } },
+};
+
+/* What parse_flow_tunnel() should find for a vector */
+struct texp {
+	__u32 type;
+	__u32 vni;
+	__u16 l3_off;		/* inner, 0 if not a tunnel */
+	__u16 l4_off;
+};
+
+static __u16 layer_ethertype(enum layer l)
+{
+	switch (l) {
+	case L_ETH:	return ETH_P_TEB;
+	case L_VLAN:	return ETH_P_8021Q;
+	case L_IP4:	return ETH_P_IP;
+	case L_IP6:	return ETH_P_IPV6;
+	default:	return 0;
+	}
+}
+
+static __u8 layer_ipproto(enum layer l)
+{
+	switch (l) {
+	case L_IP4:	return IPPROTO_IPIP;
+	case L_IP6:	return IPPROTO_IPV6;
+	case L_UDP:	return IPPROTO_UDP;
+	case L_TCP:	return IPPROTO_TCP;
+	case L_GRE:
+	case L_GRE_KEY:	return IPPROTO_GRE;
+	default:	return 0;
+	}
+}
+
+static void put16(unsigned char *p, __u16 val)
+{
+	__be16 be = htons(val);
+
+	memcpy(p, &be, sizeof(be));
+}
+
+static void put32(unsigned char *p, __u32 val)
+{
+	__be32 be = htonl(val);
+
+	memcpy(p, &be, sizeof(be));
+}
+
+static void build_tunnel(unsigned char *pkt, const enum layer *layers, struct texp *exp)
+{
+	unsigned char *pos = pkt;
+	enum layer l, next;
+	int nr_ip = 0, i;
+
+	memset(pkt, 0, PKT_LEN);
+	memset(exp, 0, sizeof(*exp));
+
+	for (i = 0; (l = layers[i]) != L_END; i++) {
+		next = layers[i + 1];
+		switch (l) {
+		case L_ETH:
+			memcpy(pos, "\x02\x00\x00\x00\x00\x02\x02\x00\x00\x00\x00\x01", 2 * ETH_ALEN);
+			put16(pos + 2 * ETH_ALEN, layer_ethertype(next));
+			pos += ETH_HLEN;
+			break;
+		case L_VLAN:
+			put16(pos, 100);				/* TCI */
+			put16(pos + 2, layer_ethertype(next));
+			pos += 4;
+			break;
+		case L_IP4: {
+			struct iphdr *iph = (struct iphdr *)pos;
+
+			if (nr_ip++ == 1)
+				exp->l3_off = pos - pkt;
+			if (nr_ip == 2 && (layers[i - 1] == L_IP4 || layers[i - 1] == L_IP6))
+				exp->type = TUNNEL_IPIP;
+			iph->version = 4;
+			iph->ihl = 5;
+			iph->tot_len = htons(PKT_LEN - (pos - pkt));
+			iph->ttl = 64;
+			iph->protocol = layer_ipproto(next);
+			iph->saddr = inet_addr(nr_ip == 1 ? "10.0.0.1" : "192.168.101.2");
+			iph->daddr = inet_addr(nr_ip == 1 ? "10.0.0.2" : "192.168.102.2");
+			pos += sizeof(*iph);
+			break;
+		}
+		case L_IP6: {
+			struct ipv6hdr *ip6h = (struct ipv6hdr *)pos;
+
+			if (nr_ip++ == 1)
+				exp->l3_off = pos - pkt;
+			if (nr_ip == 2 && (layers[i - 1] == L_IP4 || layers[i - 1] == L_IP6))
+				exp->type = TUNNEL_IPIP;
+			ip6h->version = 6;
+			ip6h->payload_len = htons(PKT_LEN - (pos - pkt) - sizeof(*ip6h));
+			ip6h->nexthdr = layer_ipproto(next);
+			ip6h->hop_limit = 64;
+			inet_pton(AF_INET6, nr_ip == 1 ? "fc00::1" : "fc00:dead:cafe:1::1", &ip6h->saddr);
+			inet_pton(AF_INET6, nr_ip == 1 ? "fc00::2" : "fc00:dead:cafe:2::1", &ip6h->daddr);
+			pos += sizeof(*ip6h);
+			break;
+		}
+		case L_UDP:
+			if (nr_ip == 2)
+				exp->l4_off = pos - pkt;
+			put16(pos, 40000);
+			put16(pos + 2, next == L_VXLAN ? 4789 :
+				       next == L_GENEVE || next == L_GENEVE_OPT ? 6081 : 53);
+			put16(pos + 4, PKT_LEN - (pos - pkt));
+			pos += sizeof(struct udphdr);
+			break;
+		case L_TCP: {
+			struct tcphdr *tcph = (struct tcphdr *)pos;
+
+			if (nr_ip == 2)
+				exp->l4_off = pos - pkt;
+			tcph->source = htons(40000);
+			tcph->dest = htons(80);
+			tcph->doff = 5;
+			tcph->syn = 1;
+			pos += sizeof(*tcph);
+			break;
+		}
+		case L_VXLAN:
+			exp->type = TUNNEL_VXLAN;
+			exp->vni = TEST_VNI;
+			put32(pos, 0x08000000);
+			put32(pos + 4, TEST_VNI << 8);
+			pos += 8;
+			break;
+		case L_GENEVE:
+		case L_GENEVE_OPT:
+			exp->type = TUNNEL_GENEVE;
+			exp->vni = TEST_VNI;
+			pos[0] = l == L_GENEVE_OPT ? 2 : 0;	/* 4-byte units */
+			put16(pos + 2, layer_ethertype(next));
+			put32(pos + 4, TEST_VNI << 8);
+			pos += 8;
+			if (l == L_GENEVE_OPT) {
+				put16(pos, 0x0104);		/* class */
+				pos[2] = 0x01;			/* type */
+				pos[3] = 1;			/* 4 bytes of data */
+				pos += 8;
+			}
+			break;
+		case L_GRE:
+			exp->type = TUNNEL_GRE;
+			put16(pos + 2, layer_ethertype(next));
+			pos += 4;
+			break;
+		case L_GRE_KEY:
+			exp->type = TUNNEL_GRE;
+			exp->vni = TEST_VNI;
+			put16(pos, 0x8000 | 0x2000 | 0x1000);
+			put16(pos + 2, layer_ethertype(next));
+			put32(pos + 8, TEST_VNI);		/* after the checksum */
+			put32(pos + 12, 1);			/* sequence */
+			pos += 16;
+			break;
+		case L_END:
+			break;
+		}
+	}
+}
+
+static void build_packet(unsigned char *pkt, const struct mix *m)
+{
+	struct ethhdr *eth = (struct ethhdr *)pkt;
+	unsigned char *pos = (unsigned char *)(eth + 1);
+	unsigned char *proto = pkt + 2 * ETH_ALEN;	/* h_proto */
+	__be16 val;
+	int l4_len, i;
+
+	memset(pkt, 0, PKT_LEN);
+	memcpy(eth->h_source, "\x02\x00\x00\x00\x00\x01", ETH_ALEN);
+	memcpy(eth->h_dest, "\x02\x00\x00\x00\x00\x02", ETH_ALEN);
+
+	for (i = 0; i < m->vlans; i++) {
+		val = htons(i == 0 && m->vlans > 1 ? ETH_P_8021AD : ETH_P_8021Q);
+		memcpy(proto, &val, sizeof(val));
+		val = htons(100 + i);				/* TCI */
+		memcpy(pos, &val, sizeof(val));
+		proto = pos + 2;
+		pos += 4;
+	}
+	val = htons(m->h_proto);
+	memcpy(proto, &val, sizeof(val));
+
+	if (m->h_proto == ETH_P_IP) {
+		struct iphdr *iph = (struct iphdr *)pos;
+
+		iph->version = 4;
+		iph->ihl = 5;
+		iph->tot_len = htons(PKT_LEN - (pos - pkt));
+		iph->id = htons(FRAG_ID);
+		iph->frag_off = htons(m->frag_off);
+		iph->ttl = 64;
+		iph->protocol = m->ip_proto;
+		iph->saddr = inet_addr("192.168.101.2");
+		iph->daddr = inet_addr("192.168.102.2");
+		pos = (unsigned char *)(iph + 1);
+	} else if (m->h_proto == ETH_P_IPV6) {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)pos;
+
+		__u8 *nexthdr = &ip6h->nexthdr;
+
+		ip6h->version = 6;
+		ip6h->payload_len = htons(PKT_LEN - (pos - pkt) - sizeof(*ip6h));
+		ip6h->hop_limit = 64;
+		inet_pton(AF_INET6, "fc00:dead:cafe:1::1", &ip6h->saddr);
+		inet_pton(AF_INET6, "fc00:dead:cafe:2::1", &ip6h->daddr);
+		pos = (unsigned char *)(ip6h + 1);
+
+		/* 8-byte headers: Hop-by-Hop first, then Destination
+		 * Options and Routing in turn
+		 */
+		for (i = 0; i < m->nr_ext; i++) {
+			if (m->frag_off && i == m->nr_ext - 1) {
+				*nexthdr = IPPROTO_FRAGMENT;
+				val = htons(m->frag_off);
+				memcpy(pos + 2, &val, sizeof(val));
+			} else {
+				*nexthdr = i == 0 ? IPPROTO_HOPOPTS :
+					   i % 2 ? IPPROTO_DSTOPTS : IPPROTO_ROUTING;
+			}
+			nexthdr = pos;
+			pos += 8;
+		}
+		*nexthdr = m->ip_proto;
+	} else {
+		return;
+	}
+
+	l4_len = PKT_LEN - (pos - pkt);
+	if (m->ip_proto == IPPROTO_TCP) {
+		struct tcphdr *tcph = (struct tcphdr *)pos;
+
+		tcph->source = htons(40000);
+		tcph->dest = htons(80);
+		tcph->doff = 5;
+		tcph->syn = 1;
+	} else if (m->ip_proto == IPPROTO_UDP) {
+		struct udphdr *udph = (struct udphdr *)pos;
+
+		udph->source = htons(40000);
+		udph->dest = htons(53);
+		udph->len = htons(l4_len);
+	} else if (m->ip_proto == IPPROTO_ICMP) {
+		struct icmphdr *icmph = (struct icmphdr *)pos;
+
+		icmph->type = ICMP_ECHO;
+		icmph->un.echo.id = htons(1234);
+	} else if (m->ip_proto == IPPROTO_ICMPV6) {
+		struct icmp6hdr *icmp6h = (struct icmp6hdr *)pos;
+
+		icmp6h->icmp6_type = ICMPV6_ECHO_REQUEST;
+		icmp6h->icmp6_identifier = htons(1234);
+	}
+}
+
+/* ns per run; the kernel averages duration over repeat */
+static int test_run(int prog_fd, unsigned char *pkt, int repeat, __u32 *retval, __u32 *ns)
+{
+	unsigned char out[PKT_LEN];
+	LIBBPF_OPTS(bpf_test_run_opts, opts,
+		.data_in = pkt,
+		.data_size_in = PKT_LEN,
+		.data_out = out,
+		.data_size_out = sizeof(out),
+		.repeat = repeat,
+	);
+
+	if (bpf_prog_test_run_opts(prog_fd, &opts)) {
+		fprintf(stderr, "ERR: test run: %s\n", strerror(errno));
+		return -1;
+	}
+	*retval = opts.retval;
+	*ns = opts.duration;
+	return 0;
+}
+
+/* Like test_run(), with meta_len bytes of data_meta in front of pkt.
+ * Returns what the program left: packet and metadata in out, the
+ * metadata length in *out_meta.
+ */
+static int test_run_meta(int prog_fd, unsigned char *in, __u32 meta_len, int repeat,
+			 unsigned char *out, __u32 *out_meta, __u32 *ns)
+{
+	struct xdp_md ctx_in = {
+		.data = meta_len,
+		.data_end = meta_len + PKT_LEN,
+	};
+	struct xdp_md ctx_out = {};
+	LIBBPF_OPTS(bpf_test_run_opts, opts,
+		.data_in = in,
+		.data_size_in = meta_len + PKT_LEN,
+		.data_out = out,
+		.data_size_out = sizeof(struct flow_meta) + PKT_LEN,
+		.ctx_in = &ctx_in,
+		.ctx_size_in = sizeof(ctx_in),
+		.ctx_out = &ctx_out,
+		.ctx_size_out = sizeof(ctx_out),
+		.repeat = repeat,
+	);
+
+	if (bpf_prog_test_run_opts(prog_fd, &opts)) {
+		fprintf(stderr, "ERR: test run with metadata: %s\n", strerror(errno));
+		return -1;
+	}
+	*out_meta = ctx_out.data;
+	*ns = opts.duration;
+	return 0;
+}
+
+static int find_prog_fd(struct bpf_object *obj, const char *name)
+{
+	struct bpf_program *prog;
+
+	prog = bpf_object__find_program_by_name(obj, name);
+	if (!prog) {
+		fprintf(stderr, "ERR: %s not found\n", name);
+		return -1;
+	}
+	return bpf_program__fd(prog);
+}
+
+static const char *action_str(__u32 action)
+{
+	switch (action) {
+	case XDP_ABORTED:	return "ABORTED";
+	case XDP_DROP:		return "DROP";
+	case XDP_PASS:		return "PASS";
+	case XDP_TX:		return "TX";
+	case XDP_REDIRECT:	return "REDIRECT";
+	}
+	return "?";
+}
+
+static const char *tunnel_str(__u32 type)
+{
+	switch (type) {
+	case TUNNEL_NONE:	return "-";
+	case TUNNEL_VXLAN:	return "vxlan";
+	case TUNNEL_GENEVE:	return "geneve";
+	case TUNNEL_GRE:	return "gre";
+	case TUNNEL_IPIP:	return "ipip";
+	}
+	return "?";
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_program *flow_prog, *pass_prog, *tunnel_prog;
+	struct bpf_prog_info info = {};
+	__u32 info_len = sizeof(info);
+	unsigned char pkt[PKT_LEN];
+	struct tunnel_key *tkeys;
+	struct flow_key *keys;
+	__u32 retval, ns, base_ns, zero = 0;
+	int flow_fd, pass_fd, tunnel_fd, map_fd, tunnel_map_fd, repeat, i;
+	int meta_fd, consumer_fd, failed = 0;
+	unsigned char meta_pkt[sizeof(struct flow_meta) + PKT_LEN];
+	__u32 flow_ns, produce_ns, meta_ns, reparse_ns, meta_len;
+	struct bpf_object *obj;
+	char *log_buf, *insns;
+	cpu_set_t cpus;
+
+	repeat = argc > 1 ? atoi(argv[1]) : 1000000;
+	if (argc > 2 || repeat <= 0) {
+		printf("Usage: %s [repeat]\n\n", argv[0]);
+		printf("DOCUMENTATION:\n %s\n", __doc__);
+		return EXIT_FAIL_OPTION;
+	}
+
+	/* flow_last is per CPU: stay on one to read back what was parsed */
+	CPU_ZERO(&cpus);
+	CPU_SET(0, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus))
+		fprintf(stderr, "WARN: can't pin to CPU 0, flow keys may be stale\n");
+
+	log_buf = calloc(1, LOG_BUF_SIZE);
+	keys = calloc(libbpf_num_possible_cpus(), sizeof(*keys));
+	tkeys = calloc(libbpf_num_possible_cpus(), sizeof(*tkeys));
+	if (!log_buf || !keys || !tkeys)
+		return EXIT_FAIL;
+
+	obj = bpf_object__open_file("xdp_prog_kern.o", NULL);
+	if (libbpf_get_error(obj)) {
+		fprintf(stderr, "ERR: opening xdp_prog_kern.o\n");
+		return EXIT_FAIL_BPF;
+	}
+	flow_prog = bpf_object__find_program_by_name(obj, "xdp_flow_func");
+	pass_prog = bpf_object__find_program_by_name(obj, "xdp_pass_func");
+	tunnel_prog = bpf_object__find_program_by_name(obj, "xdp_tunnel_flow_func");
+	if (!flow_prog || !pass_prog || !tunnel_prog) {
+		fprintf(stderr, "ERR: xdp_flow_func, xdp_pass_func or xdp_tunnel_flow_func not found\n");
+		return EXIT_FAIL_BPF;
+	}
+	/* Level 4: just the verifier statistics */
+	bpf_program__set_log_buf(flow_prog, log_buf, LOG_BUF_SIZE);
+	bpf_program__set_log_level(flow_prog, 4);
+	if (bpf_object__load(obj)) {
+		fprintf(stderr, "ERR: loading xdp_prog_kern.o\n%s", log_buf);
+		return EXIT_FAIL_BPF;
+	}
+	flow_fd = bpf_program__fd(flow_prog);
+	pass_fd = bpf_program__fd(pass_prog);
+	tunnel_fd = bpf_program__fd(tunnel_prog);
+	meta_fd = find_prog_fd(obj, "xdp_flow_meta_func");
+	consumer_fd = find_prog_fd(obj, "xdp_meta_consumer_func");
+	if (meta_fd < 0 || consumer_fd < 0)
+		return EXIT_FAIL_BPF;
+	map_fd = bpf_object__find_map_fd_by_name(obj, "flow_last");
+	tunnel_map_fd = bpf_object__find_map_fd_by_name(obj, "tunnel_last");
+
+	insns = strstr(log_buf, "processed ");
+	if (insns)
+		*strchrnul(insns, '\n') = '\0';
+	if (bpf_obj_get_info_by_fd(flow_fd, &info, &info_len) == 0)
+		printf("xdp_flow_func: %u insns after rewrites, %u bytes JITed; verifier %s\n\n",
+		       info.xlated_prog_len / 8, info.jited_prog_len,
+		       insns ? insns : "stats unavailable");
+
+	printf("%-16s %-7s %8s %8s  %3s %3s %4s  %s\n", "path", "action",
+	       "ns/pkt", "parse", "l3", "l4", "data", "flags");
+	for (i = 0; i < (int)(sizeof(mixes) / sizeof(mixes[0])); i++) {
+		build_packet(pkt, &mixes[i]);
+
+		if (test_run(pass_fd, pkt, repeat, &retval, &base_ns) ||
+		    test_run(flow_fd, pkt, repeat, &retval, &ns))
+			return EXIT_FAIL_BPF;
+
+		memset(keys, 0, libbpf_num_possible_cpus() * sizeof(*keys));
+		bpf_map_lookup_elem(map_fd, &zero, keys);
+
+		printf("%-16s %-7s %8u %8d  %3u %3u %4u  %s%s%s%s%s\n", mixes[i].name,
+		       action_str(retval), ns, (int)ns - (int)base_ns,
+		       keys[0].l3_off, keys[0].l4_off, keys[0].payload_off,
+		       keys[0].nr_vlans ? "vlan " : "",
+		       keys[0].flags & FLOW_F_PORTS ? "ports " : "",
+		       keys[0].flags & FLOW_F_FRAG ? "frag " : "",
+		       keys[0].flags & FLOW_F_LATER_FRAG ? "later " : "",
+		       keys[0].flags & FLOW_F_FRAG_PORTS ? "fragports " : "");
+	}
+
+	/* Tunnel vectors: offsets are checked, so one run each is enough */
+	printf("\n%-16s %-7s %8s  %-6s %6s %3s %3s  %s\n", "tunnel", "action",
+	       "ns/pkt", "type", "vni", "l3", "l4", "result");
+	for (i = 0; i < (int)(sizeof(tvecs) / sizeof(tvecs[0])); i++) {
+		struct tunnel_key *tk = &tkeys[0];
+		struct texp exp;
+		bool ok;
+
+		build_tunnel(pkt, tvecs[i].layers, &exp);
+		if (test_run(tunnel_fd, pkt, 1, &retval, &ns))
+			return EXIT_FAIL_BPF;
+
+		memset(tkeys, 0, libbpf_num_possible_cpus() * sizeof(*tkeys));
+		bpf_map_lookup_elem(tunnel_map_fd, &zero, tkeys);
+
+		ok = retval == XDP_PASS && tk->type == exp.type && tk->vni == exp.vni &&
+		     tk->inner.l3_off == exp.l3_off && tk->inner.l4_off == exp.l4_off;
+		failed += !ok;
+		printf("%-16s %-7s %8u  %-6s %6x %3u %3u  %s\n", tvecs[i].name,
+		       action_str(retval), ns, tunnel_str(tk->type), tk->vni,
+		       tk->inner.l3_off, tk->inner.l4_off, ok ? "ok" : "MISMATCH");
+		if (!ok)
+			printf("%-16s expected %-6s %6x %3u %3u\n", "", tunnel_str(exp.type),
+			       exp.vni, exp.l3_off, exp.l4_off);
+	}
+
+	/* Fragments: a later fragment gets the ports of its first one, not
+	 * those of another datagram
+	 */
+	printf("\n%-16s %5s %6s  %-11s %s\n", "fragment", "id", "offset", "ports", "result");
+	for (i = 0; i < (int)(sizeof(frags) / sizeof(frags[0])); i++) {
+		struct mix m = { frags[i].name, 0, ETH_P_IP, IPPROTO_UDP, frags[i].frag_off };
+		__be16 id = htons(frags[i].id);
+		bool ok;
+
+		build_packet(pkt, &m);
+		memcpy(pkt + ETH_HLEN + offsetof(struct iphdr, id), &id, sizeof(id));
+		if (test_run(flow_fd, pkt, 1, &retval, &ns))
+			return EXIT_FAIL_BPF;
+
+		memset(keys, 0, libbpf_num_possible_cpus() * sizeof(*keys));
+		bpf_map_lookup_elem(map_fd, &zero, keys);
+
+		ok = frags[i].want_ports ?
+		     (keys[0].flags & FLOW_F_PORTS) && ntohs(keys[0].sport) == 40000 &&
+		     ntohs(keys[0].dport) == 53 :
+		     !(keys[0].flags & FLOW_F_PORTS);
+		failed += !ok;
+		printf("%-16s %5x %6u  %5u/%-5u %s\n", frags[i].name, frags[i].id,
+		       frags[i].frag_off & 0x1fff, ntohs(keys[0].sport), ntohs(keys[0].dport),
+		       ok ? "ok" : "MISMATCH");
+	}
+
+	/* Hand-off: produce is the extra cost of writing the metadata, meta
+	 * and reparse what the later stage costs with and without it, and
+	 * saved what each such stage gains net of the producer
+	 */
+	printf("\n%-16s %8s %8s %8s %8s\n", "handoff", "produce", "meta",
+	       "reparse", "saved");
+	for (i = 0; i < (int)(sizeof(mixes) / sizeof(mixes[0])); i++) {
+		build_packet(pkt, &mixes[i]);
+
+		if (test_run(flow_fd, pkt, repeat, &retval, &flow_ns) ||
+		    test_run_meta(meta_fd, pkt, 0, repeat, meta_pkt, &meta_len, &produce_ns))
+			return EXIT_FAIL_BPF;
+		if (meta_len != sizeof(struct flow_meta)) {
+			printf("%-16s no metadata written\n", mixes[i].name);
+			continue;
+		}
+		if (test_run_meta(consumer_fd, meta_pkt, meta_len, repeat,
+				  meta_pkt, &meta_len, &meta_ns) ||
+		    test_run_meta(consumer_fd, pkt, 0, repeat, meta_pkt, &meta_len, &reparse_ns))
+			return EXIT_FAIL_BPF;
+
+		printf("%-16s %8d %8u %8u %8d\n", mixes[i].name,
+		       (int)produce_ns - (int)flow_ns, meta_ns, reparse_ns,
+		       (int)reparse_ns - (int)meta_ns - ((int)produce_ns - (int)flow_ns));
+	}
+
+	bpf_object__close(obj);
+	free(log_buf);
+	free(keys);
+	free(tkeys);
+	return failed ? EXIT_FAIL : EXIT_OK;
+}
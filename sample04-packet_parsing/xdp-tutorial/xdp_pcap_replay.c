@@ -0,0 +1,607 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP pcap replay\n"
+	" - Feeds every Ethernet frame of a pcap or pcapng file to an XDP\n"
+	"   program with BPF_PROG_TEST_RUN, each frame -r times in one call\n"
+	" - Works with any of the tutorial objects (-o, default xdp_prog_kern.o)\n"
+	" - Prints the action distribution, ns/pkt percentiles and the frames\n"
+	"   the program rewrote; data_meta the program adds is reported apart\n"
+	"   from resizes (-m, default: any 4-byte aligned growth up to 32 bytes)\n"
+	" - -t threads replay disjoint slices of the file on different CPUs,\n"
+	"   to see how the program scales\n";
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "./common/common_defines.h"
+
+#include <linux/if_ether.h>
+
+#define MAX_THREADS		64
+#define MAX_FRAME		4096	/* test run frames live in one page */
+#define MAX_META		32	/* bpf_xdp_adjust_meta limit */
+#define META_AUTO		-1
+#define MAX_IFACES		64	/* pcapng interfaces per section */
+#define LINKTYPE_ETHERNET	1
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NS		0xa1b23c4d
+#define PCAPNG_SHB		0x0a0d0d0a
+#define PCAPNG_BYTE_ORDER	0x1a2b3c4d
+#define PCAPNG_IDB		1
+#define PCAPNG_OPB		2	/* obsolete Packet Block */
+#define PCAPNG_SPB		3
+#define PCAPNG_EPB		6
+
+/* Per frame result; diff is DIFF_SAME, DIFF_LEN or the first changed byte */
+#define DIFF_SAME		-1
+#define DIFF_LEN		-2
+#define DIFF_ERR		-3	/* test run failed (too big, ENOSPC) */
+
+struct frame {
+	const unsigned char *data;
+	__u32 len;
+};
+
+struct result {
+	__u32 ns;		/* average over the repeat */
+	__u32 action;
+	int diff;		/* in the frame, after the metadata */
+	__u32 out_len;		/* frame only */
+	__u32 meta_len;
+};
+
+struct replay {
+	struct frame *frames;
+	struct result *results;
+	int nr_frames;
+	int prog_fd;
+	int repeat;
+	int meta_len;		/* -m, or META_AUTO */
+	__u32 ifindex;
+};
+
+struct worker {
+	pthread_t thread;
+	struct replay *rp;
+	int first, last;	/* frames [first, last) */
+	int cpu;
+	__u64 wall_ns;
+};
+
+/* Frames found in the file; skipped ones aren't Ethernet or don't fit */
+static int nr_skipped;
+/* Why the first failed test run failed */
+static int first_errno;
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-o <obj>] [-p <progname>] [-r <repeat>] [-t <threads>]\n"
+	       "       [-c <first cpu>] [-i <ifname>] [-d <diffs>] [-m <meta bytes>]\n"
+	       "       <file.pcap|file.pcapng>\n\n",
+	       prog);
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+static __u64 gettime(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (__u64)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static __u32 rd32(const unsigned char *p, bool swap)
+{
+	__u32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap ? __builtin_bswap32(v) : v;
+}
+
+static __u16 rd16(const unsigned char *p, bool swap)
+{
+	__u16 v;
+
+	memcpy(&v, p, sizeof(v));
+	return swap ? __builtin_bswap16(v) : v;
+}
+
+static int add_frame(struct frame **frames, int *nr, int *alloc,
+		     const unsigned char *data, __u32 len, __u32 linktype)
+{
+	struct frame *f;
+
+	if (linktype != LINKTYPE_ETHERNET || len < ETH_HLEN || len > MAX_FRAME) {
+		nr_skipped++;
+		return 0;
+	}
+	if (*nr == *alloc) {
+		*alloc = *alloc ? *alloc * 2 : 4096;
+		f = realloc(*frames, *alloc * sizeof(**frames));
+		if (!f)
+			return -1;
+		*frames = f;
+	}
+	(*frames)[*nr].data = data;
+	(*frames)[*nr].len = len;
+	(*nr)++;
+	return 0;
+}
+
+/* Classic pcap: 24-byte file header, then 16-byte record headers */
+static int index_pcap(const unsigned char *buf, size_t size,
+		      struct frame **frames, int *nr)
+{
+	__u32 magic = rd32(buf, false), linktype, caplen;
+	bool swap = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS;
+	size_t pos = 24;
+	int alloc = 0;
+
+	linktype = rd32(buf + 20, swap) & 0xffff;
+	while (pos + 16 <= size) {
+		caplen = rd32(buf + pos + 8, swap);
+		pos += 16;
+		if (caplen > size - pos) {
+			fprintf(stderr, "WARN: truncated record at offset %zu\n", pos - 16);
+			break;
+		}
+		if (add_frame(frames, nr, &alloc, buf + pos, caplen, linktype))
+			return -1;
+		pos += caplen;
+	}
+	return 0;
+}
+
+/* pcapng: blocks of type, total length, body, total length again. Every
+ * section header sets its own byte order and interface list.
+ */
+static int index_pcapng(const unsigned char *buf, size_t size,
+			struct frame **frames, int *nr)
+{
+	__u32 linktypes[MAX_IFACES], snaplens[MAX_IFACES];
+	__u32 type, len, if_id, caplen;
+	int nr_ifaces = 0, alloc = 0;
+	const unsigned char *body;
+	bool swap = false;
+	size_t pos = 0;
+
+	while (pos + 12 <= size) {
+		type = rd32(buf + pos, swap);
+		if (type == PCAPNG_SHB) {
+			/* The byte-order magic tells how to read the length */
+			swap = rd32(buf + pos + 8, false) != PCAPNG_BYTE_ORDER;
+			nr_ifaces = 0;
+		}
+		len = rd32(buf + pos + 4, swap);
+		if (len < 12 || len % 4 || len > size - pos) {
+			fprintf(stderr, "WARN: bad block at offset %zu\n", pos);
+			break;
+		}
+		body = buf + pos + 8;
+
+		switch (type) {
+		case PCAPNG_IDB:
+			if (len < 20)
+				break;
+			if (nr_ifaces < MAX_IFACES) {
+				linktypes[nr_ifaces] = rd16(body, swap);
+				snaplens[nr_ifaces] = rd32(body + 4, swap);
+			}
+			nr_ifaces++;
+			break;
+		case PCAPNG_EPB:
+		case PCAPNG_OPB:
+			if (len < 32)
+				break;
+			/* OPB has a 16-bit interface id and drop count */
+			if_id = type == PCAPNG_EPB ? rd32(body, swap) : rd16(body, swap);
+			caplen = rd32(body + 12, swap);
+			if (caplen > len - 32 || if_id >= MAX_IFACES || if_id >= nr_ifaces) {
+				nr_skipped++;
+				break;
+			}
+			if (add_frame(frames, nr, &alloc, body + 20, caplen, linktypes[if_id]))
+				return -1;
+			break;
+		case PCAPNG_SPB:
+			if (len < 16 || !nr_ifaces)
+				break;
+			caplen = rd32(body, swap);
+			if (snaplens[0] && caplen > snaplens[0])
+				caplen = snaplens[0];
+			if (caplen > len - 16) {
+				nr_skipped++;
+				break;
+			}
+			if (add_frame(frames, nr, &alloc, body + 4, caplen, linktypes[0]))
+				return -1;
+			break;
+		}
+		pos += len;
+	}
+	return 0;
+}
+
+static const unsigned char *map_file(const char *path, size_t *size)
+{
+	struct stat st;
+	void *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "ERR: opening %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	if (st.st_size < 24) {
+		fprintf(stderr, "ERR: %s is too short for a capture\n", path);
+		close(fd);
+		return NULL;
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		fprintf(stderr, "ERR: mmap %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	/* One pass from start to end */
+	madvise(buf, st.st_size, MADV_SEQUENTIAL);
+	*size = st.st_size;
+	return buf;
+}
+
+static int run_frame(struct replay *rp, const struct frame *f, int repeat,
+		     unsigned char *out, struct result *res)
+{
+	struct xdp_md ctx_in = {
+		.data_end = f->len,
+		.ingress_ifindex = rp->ifindex,
+	};
+	LIBBPF_OPTS(bpf_test_run_opts, opts,
+		.data_in = f->data,
+		.data_size_in = f->len,
+		.data_out = out,
+		.data_size_out = MAX_META + MAX_FRAME,
+		.repeat = repeat,
+	);
+	__u32 i, meta = 0;
+
+	/* Without an interface the context is left to the kernel */
+	if (rp->ifindex) {
+		opts.ctx_in = &ctx_in;
+		opts.ctx_size_in = sizeof(ctx_in);
+	}
+	if (bpf_prog_test_run_opts(rp->prog_fd, &opts)) {
+		res->diff = DIFF_ERR;
+		__sync_val_compare_and_swap(&first_errno, 0, errno);
+		return -errno;
+	}
+
+	/* The output starts with whatever data_meta the program set. Its
+	 * length isn't returned: with META_AUTO, growth that bpf_xdp_adjust_meta
+	 * could produce is taken as metadata, assuming the program doesn't
+	 * also adjust head or tail (use -m 0 for encap programs).
+	 */
+	if (rp->meta_len != META_AUTO) {
+		meta = rp->meta_len;
+	} else if (opts.data_size_out > f->len) {
+		meta = opts.data_size_out - f->len;
+		if (meta > MAX_META || meta % 4)
+			meta = 0;
+	}
+	if (meta > opts.data_size_out)
+		meta = 0;
+
+	res->ns = opts.duration;
+	res->action = opts.retval;
+	res->meta_len = meta;
+	res->out_len = opts.data_size_out - meta;
+	res->diff = DIFF_SAME;
+	if (res->out_len != f->len) {
+		res->diff = DIFF_LEN;
+	} else {
+		for (i = 0; i < f->len; i++) {
+			if (out[meta + i] != f->data[i]) {
+				res->diff = i;
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+static void *replay_slice(void *arg)
+{
+	struct worker *w = arg;
+	struct replay *rp = w->rp;
+	unsigned char out[MAX_META + MAX_FRAME];
+	cpu_set_t cpus;
+	__u64 start;
+	int i;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(w->cpu, &cpus);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+		fprintf(stderr, "WARN: can't pin a thread to CPU %d\n", w->cpu);
+
+	start = gettime();
+	for (i = w->first; i < w->last; i++)
+		run_frame(rp, &rp->frames[i], rp->repeat, out, &rp->results[i]);
+	w->wall_ns = gettime() - start;
+	return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	__u32 x = *(const __u32 *)a, y = *(const __u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static const char *action_str(__u32 action)
+{
+	switch (action) {
+	case XDP_ABORTED:	return "ABORTED";
+	case XDP_DROP:		return "DROP";
+	case XDP_PASS:		return "PASS";
+	case XDP_TX:		return "TX";
+	case XDP_REDIRECT:	return "REDIRECT";
+	}
+	return "?";
+}
+
+static void print_actions(struct replay *rp)
+{
+	int counts[XDP_REDIRECT + 2] = {}, errors = 0, i;
+
+	for (i = 0; i < rp->nr_frames; i++) {
+		if (rp->results[i].diff == DIFF_ERR)
+			errors++;
+		else if (rp->results[i].action <= XDP_REDIRECT)
+			counts[rp->results[i].action]++;
+		else
+			counts[XDP_REDIRECT + 1]++;
+	}
+	printf("%-10s %10s %7s\n", "action", "frames", "share");
+	for (i = 0; i <= XDP_REDIRECT + 1; i++) {
+		if (counts[i])
+			printf("%-10s %10d %6.2f%%\n", i <= XDP_REDIRECT ? action_str(i) : "other",
+			       counts[i], 100.0 * counts[i] / rp->nr_frames);
+	}
+	if (errors)
+		printf("%-10s %10d %6.2f%%  (test run failed: %s)\n", "error", errors,
+		       100.0 * errors / rp->nr_frames, strerror(first_errno));
+}
+
+static void print_percentiles(struct replay *rp)
+{
+	static const double pct[] = { 50, 90, 99, 99.9 };
+	__u32 *ns;
+	int i, n = 0;
+
+	ns = malloc(rp->nr_frames * sizeof(*ns));
+	if (!ns)
+		return;
+	for (i = 0; i < rp->nr_frames; i++) {
+		if (rp->results[i].diff != DIFF_ERR)
+			ns[n++] = rp->results[i].ns;
+	}
+	if (!n) {
+		free(ns);
+		return;
+	}
+	qsort(ns, n, sizeof(*ns), cmp_u32);
+
+	printf("\nns/pkt    min %u", ns[0]);
+	for (i = 0; i < (int)(sizeof(pct) / sizeof(pct[0])); i++)
+		printf("  p%g %u", pct[i], ns[(int)((n - 1) * pct[i] / 100)]);
+	printf("  max %u\n", ns[n - 1]);
+	free(ns);
+}
+
+/* Up to max_diffs rewritten frames, run once more to show the bytes.
+ * Frames compare after the metadata, which is counted on its own.
+ */
+static void print_diffs(struct replay *rp, int max_diffs)
+{
+	int same = 0, resized = 0, changed = 0, with_meta = 0, shown = 0, i, j, off;
+	unsigned char out[MAX_META + MAX_FRAME];
+	struct result res;
+
+	for (i = 0; i < rp->nr_frames; i++) {
+		if (rp->results[i].diff == DIFF_SAME)
+			same++;
+		else if (rp->results[i].diff == DIFF_LEN)
+			resized++;
+		else if (rp->results[i].diff >= 0)
+			changed++;
+		if (rp->results[i].diff != DIFF_ERR && rp->results[i].meta_len)
+			with_meta++;
+	}
+	printf("\noutput    unchanged %d  rewritten %d  resized %d  with metadata %d\n",
+	       same, changed, resized, with_meta);
+
+	for (i = 0; i < rp->nr_frames && shown < max_diffs; i++) {
+		if (rp->results[i].diff < 0 && rp->results[i].diff != DIFF_LEN)
+			continue;
+		if (run_frame(rp, &rp->frames[i], 1, out, &res))
+			continue;
+		shown++;
+		printf("frame %-7d %-8s len %u -> %u", i + 1, action_str(res.action),
+		       rp->frames[i].len, res.out_len);
+		if (res.meta_len)
+			printf(" + %u bytes metadata", res.meta_len);
+		if (res.diff < 0) {
+			printf("\n");
+			continue;
+		}
+		/* 16 bytes from the first change, as in/out */
+		off = res.diff & ~15;
+		printf(", first change at %d\n  in  %04x:", res.diff, off);
+		for (j = off; j < off + 16 && j < (int)rp->frames[i].len; j++)
+			printf(" %02x", rp->frames[i].data[j]);
+		printf("\n  out %04x:", off);
+		for (j = off; j < off + 16 && j < (int)res.out_len; j++)
+			printf(" %02x", out[res.meta_len + j]);
+		printf("\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *filename = "xdp_prog_kern.o", *progname = "xdp_parser_func";
+	int nr_threads = 1, first_cpu = 0, max_diffs = 5, nr_cpus, opt, i;
+	struct worker workers[MAX_THREADS];
+	struct replay rp = { .repeat = 100, .meta_len = META_AUTO };
+	struct bpf_program *prog, *pos;
+	struct bpf_object *obj;
+	const unsigned char *buf;
+	__u64 total_wall = 0;
+	size_t size;
+
+	while ((opt = getopt(argc, argv, "ho:p:r:t:c:i:d:m:")) != -1) {
+		switch (opt) {
+		case 'o':
+			filename = optarg;
+			break;
+		case 'p':
+			progname = optarg;
+			break;
+		case 'r':
+			rp.repeat = atoi(optarg);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'c':
+			first_cpu = atoi(optarg);
+			break;
+		case 'i':
+			rp.ifindex = if_nametoindex(optarg);
+			if (!rp.ifindex) {
+				fprintf(stderr, "ERR: unknown interface %s\n", optarg);
+				return EXIT_FAIL_OPTION;
+			}
+			break;
+		case 'd':
+			max_diffs = atoi(optarg);
+			break;
+		case 'm':
+			rp.meta_len = atoi(optarg);
+			if (rp.meta_len < 0 || rp.meta_len > MAX_META || rp.meta_len % 4) {
+				fprintf(stderr, "ERR: -m takes 0..%d in steps of 4\n", MAX_META);
+				return EXIT_FAIL_OPTION;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		}
+	}
+	if (optind + 1 != argc || rp.repeat <= 0 || nr_threads <= 0 ||
+	    nr_threads > MAX_THREADS || first_cpu < 0) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	buf = map_file(argv[optind], &size);
+	if (!buf)
+		return EXIT_FAIL;
+	if (rd32(buf, false) == PCAPNG_SHB) {
+		if (index_pcapng(buf, size, &rp.frames, &rp.nr_frames))
+			return EXIT_FAIL;
+	} else if (rd32(buf, false) == PCAP_MAGIC || rd32(buf, false) == PCAP_MAGIC_NS ||
+		   rd32(buf, true) == PCAP_MAGIC || rd32(buf, true) == PCAP_MAGIC_NS) {
+		if (index_pcap(buf, size, &rp.frames, &rp.nr_frames))
+			return EXIT_FAIL;
+	} else {
+		fprintf(stderr, "ERR: %s is neither pcap nor pcapng\n", argv[optind]);
+		return EXIT_FAIL_OPTION;
+	}
+	if (!rp.nr_frames) {
+		fprintf(stderr, "ERR: no Ethernet frames of %d..%d bytes in %s\n",
+			ETH_HLEN, MAX_FRAME, argv[optind]);
+		return EXIT_FAIL;
+	}
+	rp.results = calloc(rp.nr_frames, sizeof(*rp.results));
+	if (!rp.results)
+		return EXIT_FAIL;
+	if (nr_threads > rp.nr_frames)
+		nr_threads = rp.nr_frames;
+
+	obj = bpf_object__open_file(filename, NULL);
+	if (libbpf_get_error(obj)) {
+		fprintf(stderr, "ERR: opening %s\n", filename);
+		return EXIT_FAIL_BPF;
+	}
+	prog = bpf_object__find_program_by_name(obj, progname);
+	if (!prog) {
+		fprintf(stderr, "ERR: %s not found in %s\n", progname, filename);
+		return EXIT_FAIL_BPF;
+	}
+	/* Only load what is replayed: other sections may need a device */
+	bpf_object__for_each_program(pos, obj)
+		bpf_program__set_autoload(pos, pos == prog);
+	if (bpf_object__load(obj)) {
+		fprintf(stderr, "ERR: loading %s from %s\n", progname, filename);
+		return EXIT_FAIL_BPF;
+	}
+	rp.prog_fd = bpf_program__fd(prog);
+
+	printf("%s: %d frames (%d skipped), %s from %s, repeat %d, %d thread(s)\n\n",
+	       argv[optind], rp.nr_frames, nr_skipped, progname, filename,
+	       rp.repeat, nr_threads);
+
+	/* Contiguous slices, so each thread walks its part of the mapping */
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].rp = &rp;
+		workers[i].first = (long)rp.nr_frames * i / nr_threads;
+		workers[i].last = (long)rp.nr_frames * (i + 1) / nr_threads;
+		workers[i].cpu = (first_cpu + i) % nr_cpus;
+		if (pthread_create(&workers[i].thread, NULL, replay_slice, &workers[i])) {
+			fprintf(stderr, "ERR: starting thread %d\n", i);
+			return EXIT_FAIL;
+		}
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	print_actions(&rp);
+	print_percentiles(&rp);
+
+	/* Wall time includes the syscalls: what the program costs in practice */
+	printf("\n%-7s %4s %10s %10s\n", "thread", "cpu", "frames", "Mpps");
+	for (i = 0; i < nr_threads; i++) {
+		int n = workers[i].last - workers[i].first;
+
+		printf("%-7d %4d %10d %10.2f\n", i, workers[i].cpu, n,
+		       workers[i].wall_ns ? (double)n * rp.repeat * 1000 / workers[i].wall_ns : 0);
+		if (workers[i].wall_ns > total_wall)
+			total_wall = workers[i].wall_ns;
+	}
+	printf("%-7s %4s %10d %10.2f\n", "total", "", rp.nr_frames,
+	       total_wall ? (double)rp.nr_frames * rp.repeat * 1000 / total_wall : 0);
+
+	print_diffs(&rp, max_diffs);
+
+	bpf_object__close(obj);
+	munmap((void *)buf, size);
+	free(rp.frames);
+	free(rp.results);
+	return EXIT_OK;
+}
@@ -13,161 +13,13 @@
 #include "./common/xdp_stats_kern.h"
 #include <linux/ip.h>   // IPv4 헤더 (struct iphdr)
 #include <linux/icmp.h> // ICMPv4 헤더 (struct icmphdr)
+#include <linux/pkt_cls.h> // TC_ACT_*
 
-/* Header cursor to keep track of current parsing position */
-struct hdr_cursor {
-	void *pos;
-};
-
-struct vlan_hdr {
-	__be16 h_vlan_TCI;
-	__be16 h_vlan_encapsulated_proto;
-};
-
-static __always_inline int proto_is_vlan(__u16 h_proto)
-{
-       return !!(h_proto == bpf_htons(ETH_P_8021Q) || h_proto == bpf_htons(ETH_P_8021AD));
-}
-
-/* IPv4 헤더 파싱 */
-static __always_inline int parse_ip4hdr(struct hdr_cursor *nh,
-					void *data_end,
-					struct iphdr **iphdr)
-{
-	struct iphdr *iph = nh->pos;
-	int hdrsize;
-
-	/* 1. 기본 구조체 크기 검사 (20 bytes) */
-	if (iph + 1 > data_end)
-		return -1;
-
-	/* 2. 실제 헤더 크기 계산 (IHL field * 4) */
-	hdrsize = iph->ihl * 4;
-
-	/* 3. 무결성 검사: 계산된 크기가 기본 크기보다 작으면 에러 */
-	if (hdrsize < sizeof(*iph))
-		return -1;
-
-	/* 4. 가변 길이 경계 검사: 실제 크기만큼 메모리에 있는지 확인 */
-	if ((void *)iph + hdrsize > data_end)
-		return -1;
-
-	/* 커서 이동 및 포인터 저장 */
-	nh->pos += hdrsize;
-	*iphdr = iph;
-
-	return iph->protocol; /* 다음 프로토콜 (TCP/UDP/ICMP 등) 반환 */
-}
-
-/* Assignment 5: ICMPv4 헤더 파싱 */
-static __always_inline int parse_icmp4hdr(struct hdr_cursor *nh,
-					  void *data_end,
-					  struct icmphdr **icmphdr)
-{
-	struct icmphdr *icmph = nh->pos;
-
-	/* 1. 경계 검사 */
-	if (icmph + 1 > data_end)
-		return -1;
-
-	/* 2. IPv4 Ping Request(Type 8) 확인 */
-	/* 참고: ICMPv6는 128번이지만, IPv4 ICMP는 8번입니다. */
-	if (icmph->type != ICMP_ECHO)
-		return -1;
-
-	nh->pos = icmph + 1;
-	*icmphdr = icmph;
-
-	/* 시퀀스 번호 반환 (Network Byte Order -> Host Byte Order) */
-	return bpf_ntohs(icmph->un.echo.sequence);
-}
-
-
-
-/*  패킷 파싱을 위한 헬퍼 함수
-	기능: 각 헬퍼 함수는 패킷 헤더를 파싱하며, 안전을 위해 메모리 범위(Bounds) 검사를 수행합니다.
-	반환값:
-		성공 시: 포함된 **콘텐츠의 타입(Type)**을 반환합니다.
-		실패 시: -1을 반환합니다.
-	'콘텐츠 타입'의 의미:
-		Ethernet/IP: 다음 계층의 프로토콜 번호 (예: 이더넷의 h_proto, IPv6의 nexthdr).
-		ICMP: ICMP 메시지의 type 필드 값.
-	데이터 형식: 모든 반환 값은 네트워크 바이트 오더(Big Endian) 형태입니다.
+/* 이더넷(VLAN 포함)/IPv4/IPv6/ICMP 파싱 헬퍼와 parse_flow() 는 공용 헤더에 있음.
+ * (예전 로컬 parse_ethhdr 는 VLAN 을 건너뛰면서 eth->h_proto 를 패킷에 덮어썼음)
  */
-static __always_inline int parse_ethhdr(struct hdr_cursor *nh,
-					void *data_end,
-					struct ethhdr **ethhdr)
-{
-	struct ethhdr *eth = nh->pos;
-	int hdrsize = sizeof(*eth);
-
-	/* 1. 이더넷 헤더 크기만큼 경계 검사 */
-	if (nh->pos + hdrsize > data_end)
-		return -1;
-
-	nh->pos += hdrsize;
-	*ethhdr = eth;
-    
-    /* 2. VLAN 태그 파싱 루프 */
-    /* VLAN이 중첩될 수 있으므로 루프로 처리 */
-    #pragma unroll
-    for (int i = 0; i < 2; i++) {  // 보통 VLAN은 최대 2개까지만 겹쳐서 사용
-        if (proto_is_vlan(eth->h_proto)) {
-            struct vlan_hdr *vhdr = nh->pos;
-            
-            /* VLAN 헤더 경계 검사 (4바이트) */
-            if (nh->pos + sizeof(struct vlan_hdr) > data_end)
-                return -1;
-            
-            /* 다음 프로토콜 정보 가져오기 (IPv4/IPv6 등) */
-            eth->h_proto = vhdr->h_vlan_encapsulated_proto;
-            
-            /* 커서 이동: VLAN 태그만큼 건너뛰기 */
-            nh->pos += sizeof(struct vlan_hdr);
-        } else {
-            break; /* VLAN이 아니면 루프 종료 */
-        }
-    }
-
-	return eth->h_proto; /* 최종 프로토콜 리턴 */
-}
-
-/* Assignment 2: Implement and use this */
-static __always_inline int parse_ip6hdr(struct hdr_cursor *nh,
-					void *data_end,
-					struct ipv6hdr **ip6hdr)
-{
-       struct ipv6hdr *ip6h = nh->pos;
-
-       if (ip6h + 1 > data_end)
-               return -1;
-       nh->pos = ip6h + 1;
-       *ip6hdr = ip6h;
-       return ip6h->nexthdr;
-}
-
-/* Assignment 3: Implement and use this */
-static __always_inline int parse_icmp6hdr(struct hdr_cursor *nh,
-					  void *data_end,
-					  struct icmp6hdr **icmp6hdr)
-{
-       struct icmp6hdr *icmp6h = nh->pos;
-
-       if (icmp6h + 1 > data_end)
-               return -1;
-
-
-	// [중요] Echo Request (Ping 요청)가 아니면 -1 리턴 (또는 다른 값)
-	// 128: Echo Request, 129: Echo Reply
-	if (icmp6h->icmp6_type != ICMPV6_ECHO_REQUEST) 
-        	return -1;
-
-	nh->pos = icmp6h + 1;
-	*icmp6hdr = icmp6h;
-
-	// Echo Request일 때만 시퀀스 번호가 의미가 있음
-       return bpf_ntohs(icmp6h->icmp6_sequence);
-}
+#include "./common/parsing_helpers.h"
+#include "xdp_flow_meta_kern_user.h"
 
 SEC("xdp")
 int  xdp_parser_func(struct xdp_md *ctx)
@@ -183,8 +35,9 @@ int  xdp_parser_func(struct xdp_md *ctx)
 	// IPv4용 포인터
 	struct iphdr *iph;
 	struct icmphdr *icmp;
-	
+
 	int icmp_seq = -1; // 초기값 설정
+	__u8 frag = 0;
 	__u32 action = XDP_PASS; /* Default action */
 
 	/* These keep track of the next header type and iterator pointer */
@@ -201,17 +54,24 @@ int  xdp_parser_func(struct xdp_md *ctx)
 	if (nh_type == bpf_htons(ETH_P_IPV6)) {
 		// [기존 IPv6 로직]
 		nh_type = parse_ip6hdr(&nh, data_end, &ipv6);
-		
+		// Hop-by-Hop 등 확장 헤더 건너뛰기 (조각이면 ICMPv6 헤더가 없을 수 있음)
+		nh_type = parse_ip6_exthdrs(&nh, data_end, nh_type, &frag);
+		if (frag & FLOW_F_LATER_FRAG) goto out;
+
 		if (nh_type != IPPROTO_ICMPV6) goto out;
-		icmp_seq = parse_icmp6hdr(&nh, data_end, &icmp6);
-		
+		// Echo Request (Ping 요청) 일 때만 시퀀스 번호가 의미가 있음
+		if (parse_icmp6hdr(&nh, data_end, &icmp6) != ICMPV6_ECHO_REQUEST) goto out;
+		icmp_seq = bpf_ntohs(icmp6->icmp6_sequence);
+
 	} else if (nh_type == bpf_htons(ETH_P_IP)) {
 		// [새로운 IPv4 로직]
-		nh_type = parse_ip4hdr(&nh, data_end, &iph);
+		nh_type = parse_iphdr(&nh, data_end, &iph);
 
 		// 프로토콜이 ICMP(1)인지 확인
 		if (nh_type != IPPROTO_ICMP) goto out;
-		icmp_seq = parse_icmp4hdr(&nh, data_end, &icmp);
+		// 참고: ICMPv6는 128번이지만, IPv4 ICMP Echo 는 8번입니다.
+		if (parse_icmphdr(&nh, data_end, &icmp) != ICMP_ECHO) goto out;
+		icmp_seq = bpf_ntohs(icmp->un.echo.sequence);
 
 	} else {
 		// IPv4도 IPv6도 아니면 패스
@@ -229,4 +89,231 @@ out:
 	return xdp_stats_record_action(ctx, action); /* read via xdp_stats */
 }
 
+/* 각 CPU 에서 마지막으로 파싱한 flow key (xdp_parse_bench 가 읽어서 확인) */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, __u32);
+	__type(value, struct flow_key);
+	__uint(max_entries, 1);
+} flow_last SEC(".maps");
+
+/* IPv4 조각 추적: 첫 조각의 포트를 (src, dst, id, proto) 로 기억해서
+ * L4 헤더가 없는 뒤 조각도 같은 flow 로 분류/분산되게 함.
+ * 오래된 항목은 LRU 로 밀려나므로 따로 지우지 않음 (순서가 바뀐 조각 대비).
+ */
+#define FRAG_TRACK_MAX	8192
+
+struct {
+	__uint(type, BPF_MAP_TYPE_LRU_HASH);
+	__type(key, struct frag_key);
+	__type(value, struct frag_ports);
+	__uint(max_entries, FRAG_TRACK_MAX);
+} frag_ports SEC(".maps");
+
+/* parse_flow() 뒤에 호출. 첫 조각이면 포트를 기록하고, 뒤 조각이면 찾아서
+ * key 에 채움 (FLOW_F_PORTS | FLOW_F_FRAG_PORTS). 첫 조각보다 먼저 온
+ * 뒤 조각은 포트 없이 남음.
+ */
+static __always_inline void flow_frag_ports(struct flow_key *key)
+{
+	struct frag_ports *found, ports;
+	struct frag_key fk;
+
+	if (flow_frag_key(key, &fk) < 0)
+		return;
+
+	if (!(key->flags & FLOW_F_LATER_FRAG)) {
+		if (!(key->flags & FLOW_F_PORTS))
+			return;
+		ports.sport = key->sport;
+		ports.dport = key->dport;
+		bpf_map_update_elem(&frag_ports, &fk, &ports, BPF_ANY);
+		return;
+	}
+
+	found = bpf_map_lookup_elem(&frag_ports, &fk);
+	if (!found)
+		return;
+	key->sport = found->sport;
+	key->dport = found->dport;
+	key->flags |= FLOW_F_PORTS | FLOW_F_FRAG_PORTS;
+}
+
+/* parse_flow() 만 하는 프로그램: 프로토콜 조합별 파싱 비용 측정용 */
+SEC("xdp")
+int xdp_flow_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = (void *)(long)ctx->data };
+	struct flow_key *key;
+	__u32 zero = 0;
+
+	key = bpf_map_lookup_elem(&flow_last, &zero);
+	if (!key)
+		return XDP_ABORTED;
+
+	if (parse_flow(&nh, data_end, key) < 0)
+		return XDP_DROP;
+	flow_frag_ports(key);
+	return XDP_PASS;
+}
+
+/* 각 CPU 에서 마지막으로 파싱한 터널 바깥/안쪽 flow key */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, __u32);
+	__type(value, struct tunnel_key);
+	__uint(max_entries, 1);
+} tunnel_last SEC(".maps");
+
+/* VXLAN/GENEVE/GRE/IP-in-IP 이면 안쪽 패킷까지 파싱 (xdp_parse_bench 테스트 벡터용) */
+SEC("xdp")
+int xdp_tunnel_flow_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = (void *)(long)ctx->data };
+	struct tunnel_key *tk;
+	__u32 zero = 0;
+
+	tk = bpf_map_lookup_elem(&tunnel_last, &zero);
+	if (!tk)
+		return XDP_ABORTED;
+
+	if (parse_flow_tunnel(&nh, data_end, tk) < 0)
+		return XDP_DROP;
+	return XDP_PASS;
+}
+
+/* xdp_flow_meta_func 가 받은 패킷을 넘길 AF_XDP 소켓 (rx queue 번호 -> 소켓, xdp_meta_xsk 가 채움) */
+struct {
+	__uint(type, BPF_MAP_TYPE_XSKMAP);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, 64);
+} xsks_map SEC(".maps");
+
+/* 뒤 단계가 metadata 를 쓴 횟수(META_STAT_HIT)와 다시 파싱한 횟수(META_STAT_MISS) */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, __u32);
+	__type(value, __u64);
+	__uint(max_entries, META_STAT_MAX);
+} meta_stats SEC(".maps");
+
+static __always_inline void flow_meta_fill(struct flow_meta *meta,
+					   struct flow_key *key)
+{
+	meta->hash = flow_hash(key);
+	/* IPv6 주소는 32 바이트에 안 들어감: 읽는 쪽이 l3_off 에서 직접 읽음 */
+	meta->saddr = key->h_proto == bpf_htons(ETH_P_IP) ? key->saddr[0] : 0;
+	meta->daddr = key->h_proto == bpf_htons(ETH_P_IP) ? key->daddr[0] : 0;
+	meta->sport = key->sport;
+	meta->dport = key->dport;
+	meta->h_proto = key->h_proto;
+	meta->ip_proto = key->ip_proto;
+	meta->flags = key->flags;
+	meta->vlan_id = key->vlan_id[0];
+	meta->l3_off = key->l3_off;
+	meta->l4_off = key->l4_off;
+	meta->payload_off = key->payload_off;
+	meta->nr_vlans = key->nr_vlans;
+	meta->pad = 0;
+	meta->magic = FLOW_META_MAGIC;
+}
+
+/* parse_flow() 결과를 data_meta 에 써서 넘김. 이 rx queue 에 AF_XDP 소켓이
+ * 있으면 그쪽으로, 없으면 커널(TC 분류기)로 보냄.
+ * 드라이버가 metadata 를 지원하지 않으면 그냥 PASS: 뒤 단계가 다시 파싱함.
+ */
+SEC("xdp")
+int xdp_flow_meta_func(struct xdp_md *ctx)
+{
+	struct hdr_cursor nh = { .pos = (void *)(long)ctx->data };
+	struct flow_meta *meta;
+	struct flow_key key;
+	void *data;
+
+	if (parse_flow(&nh, (void *)(long)ctx->data_end, &key) < 0)
+		return XDP_PASS;
+	flow_frag_ports(&key);
+
+	if (bpf_xdp_adjust_meta(ctx, -(int)sizeof(*meta)))
+		return XDP_PASS;
+	/* adjust_meta 뒤에는 패킷 포인터를 다시 읽어야 함 */
+	meta = (void *)(long)ctx->data_meta;
+	data = (void *)(long)ctx->data;
+	if (meta + 1 > (struct flow_meta *)data)
+		return XDP_PASS;
+	flow_meta_fill(meta, &key);
+
+	return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+}
+
+/* 뒤 단계 공용: data 바로 앞의 flow_meta 를 쓰고, 없으면 다시 파싱해서
+ * buf 에 채움. 파싱도 안 되면 NULL.
+ */
+static __always_inline struct flow_meta *flow_meta_load(void *data_meta,
+							void *data,
+							void *data_end,
+							struct flow_meta *buf)
+{
+	struct hdr_cursor nh = { .pos = data };
+	struct flow_meta *meta = data_meta;
+	__u32 idx = META_STAT_HIT;
+	struct flow_key key;
+	__u64 *cnt;
+
+	if (meta + 1 > (struct flow_meta *)data || meta->magic != FLOW_META_MAGIC) {
+		if (parse_flow(&nh, data_end, &key) < 0)
+			return NULL;
+		flow_frag_ports(&key);
+		flow_meta_fill(buf, &key);
+		meta = buf;
+		idx = META_STAT_MISS;
+	}
+
+	cnt = bpf_map_lookup_elem(&meta_stats, &idx);
+	if (cnt)
+		*cnt += 1;
+	return meta;
+}
+
+/* TC ingress 분류기: XDP 가 구한 flow hash 를 skb 에 넣어서 RPS/RFS 와
+ * 스택이 flow dissector 를 다시 돌리지 않게 함.
+ * tc filter add dev <ifname> ingress bpf da obj xdp_prog_kern.o sec tc
+ */
+SEC("tc")
+int tc_flow_meta_func(struct __sk_buff *skb)
+{
+	struct flow_meta buf, *meta;
+
+	meta = flow_meta_load((void *)(long)skb->data_meta,
+			      (void *)(long)skb->data,
+			      (void *)(long)skb->data_end, &buf);
+	if (meta)
+		bpf_set_hash(skb, meta->hash);
+	return TC_ACT_OK;
+}
+
+/* 같은 소비 로직의 XDP 판: BPF_PROG_TEST_RUN 은 XDP 에서만 metadata 를
+ * 넣어 줄 수 있어서, xdp_parse_bench 가 이걸로 metadata 유무에 따른 비용을 잼
+ */
+SEC("xdp")
+int xdp_meta_consumer_func(struct xdp_md *ctx)
+{
+	struct flow_meta buf, *meta;
+
+	meta = flow_meta_load((void *)(long)ctx->data_meta,
+			      (void *)(long)ctx->data,
+			      (void *)(long)ctx->data_end, &buf);
+	return meta ? XDP_PASS : XDP_DROP;
+}
+
+/* 벤치마크 기준선: BPF_PROG_TEST_RUN 자체 비용 */
+SEC("xdp")
+int xdp_pass_func(struct xdp_md *ctx)
+{
+	return XDP_PASS;
+}
+
 char _license[] SEC("license") = "GPL";
@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# XDP L2 브리지(xdp_bridge) 포워딩 성능 측정
+# (root 권한 필요, docker 없이 호스트에서 실행)
+#
+#   h0 (g0) ---- (p0) br (p1) ---- (s1) h1
+#                      (p2) ---- (s2) h2
+#
+# h0 에서 pktgen 으로 소스 MAC 을 N 개로 바꿔가며 h1 의 MAC 으로 보냅니다.
+#  1. h1 MAC 을 아직 모를 때: p1, p2 로 flood (BPF_F_BROADCAST)
+#  2. h1 이 프레임을 하나 보낸 뒤: p1 으로만 unicast
+# 각 단계에서 h1, h2 가 받은 Mpps 를 출력합니다. (소스 MAC N 개가 모두 fdb 에 학습됨)
+#
+# 사용법: sudo ./bench_bridge.sh [소스 MAC 수] [측정 시간(초)] [pktgen 스레드 수]
+
+MACS=${1:-50000}
+DURATION=${2:-10}
+THREADS=${3:-2}
+NS="bb-h0 bb-br bb-h1 bb-h2"
+
+cleanup() {
+    [ -e /proc/net/pktgen/pgctrl ] && ip netns exec bb-h0 sh -c "echo stop > /proc/net/pktgen/pgctrl" 2>/dev/null
+    [ -n "$BR_PID" ] && kill $BR_PID 2>/dev/null
+    wait 2>/dev/null
+    for ns in $NS; do ip netns del $ns 2>/dev/null; done
+}
+trap cleanup EXIT
+
+make xdp_prog_kern.o xdp_loader xdp_bridge > /dev/null || exit 1
+modprobe pktgen || exit 1
+
+# 1. 네임스페이스 + veth 구성
+for ns in $NS; do ip netns add $ns; done
+ip link add g0 netns bb-h0 type veth peer name p0 netns bb-br
+ip link add s1 netns bb-h1 type veth peer name p1 netns bb-br
+ip link add s2 netns bb-h2 type veth peer name p2 netns bb-br
+ip -n bb-h1 addr add 10.10.0.1/24 dev s1
+for ns in $NS; do ip -n $ns link set lo up; done
+ip -n bb-h0 link set g0 up
+ip -n bb-h1 link set s1 up
+ip -n bb-h2 link set s2 up
+for p in p0 p1 p2; do ip -n bb-br link set $p up; done
+
+# h1, h2: XDP 로 받아서 버림 (veth 로 redirect 된 패킷은 받는 쪽에 XDP 프로그램이 있어야 함)
+for h in 1 2; do
+    ip netns exec bb-h$h sh -c "mount -t bpf bpf /sys/fs/bpf && \
+        ./xdp_loader -q -N --dev s$h --filename xdp_prog_kern.o --progname xdp_drop_func" || exit 1
+done
+
+# 브리지: 백그라운드로 실행 (종료 시 cleanup 에서 kill)
+ip netns exec bb-br sh -c "mount -t bpf bpf /sys/fs/bpf && exec ./xdp_bridge -q p0 p1 p2" &
+BR_PID=$!
+sleep 1
+
+S1_MAC=$(ip netns exec bb-h1 cat /sys/class/net/s1/address)
+
+# 2. pktgen 설정 (스레드마다 소스 MAC 범위를 나눠서 전체 MACS 개)
+pg() {
+    ip netns exec bb-h0 sh -c "echo '$2' > /proc/net/pktgen/$1"
+}
+for i in $(seq 0 $((THREADS - 1))); do
+    pg kpktgend_$i "rem_device_all"
+    pg kpktgend_$i "add_device g0@$i"
+    pg g0@$i "count 0"
+    pg g0@$i "clone_skb 0"
+    pg g0@$i "pkt_size 60"
+    pg g0@$i "delay 0"
+    pg g0@$i "dst 10.10.0.1"
+    pg g0@$i "dst_mac $S1_MAC"
+    pg g0@$i "src_mac 02:00:00:$(printf %02x $i):00:00"
+    pg g0@$i "src_mac_count $((MACS / THREADS))"
+done
+
+rx() {
+    ip netns exec bb-h$1 cat /sys/class/net/s$1/statistics/rx_packets
+}
+
+run() {
+    local name=$1 b1 b2 a1 a2 pg_pid
+
+    ip netns exec bb-h0 sh -c "echo start > /proc/net/pktgen/pgctrl" &
+    pg_pid=$!
+    sleep 1 # 워밍업 (소스 MAC 학습)
+    b1=$(rx 1); b2=$(rx 2)
+    sleep $DURATION
+    a1=$(rx 1); a2=$(rx 2)
+    ip netns exec bb-h0 sh -c "echo stop > /proc/net/pktgen/pgctrl"
+    wait $pg_pid
+
+    echo "$name $(( (a1 - b1) / DURATION )) $(( (a2 - b2) / DURATION ))" | \
+        awk '{ printf "%-8s h1 %8.3f Mpps   h2 %8.3f Mpps\n", $1, $2 / 1e6, $3 / 1e6 }'
+}
+
+echo "source MACs: $MACS"
+run flood
+
+# h1 이 브로드캐스트(ARP) 를 하나 보내면 p1 에 h1 MAC 이 학습됨
+ip netns exec bb-h1 ping -c 1 -W 1 10.10.0.2 > /dev/null
+run unicast
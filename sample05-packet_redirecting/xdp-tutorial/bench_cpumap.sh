@@ -0,0 +1,113 @@
+#!/bin/bash
+
+# cpumap 소프트웨어 RSS 확장성 측정 (xdp_cpumap_rss_func -> xdp_cpumap_router_func)
+# (root 권한 필요, docker 없이 호스트에서 실행)
+#
+#   gen (g0) ---- (r0) router (r1) ---- (s0) sink
+#   10.10.1.2    10.10.1.1   10.10.2.1    10.10.2.2
+#
+# pktgen 스레드 하나(CPU 0)가 보내므로 r0 의 XDP 는 전부 CPU 0 에서 돕니다.
+# r0 의 1 단계는 흐름 해시로 CPU 를 고르기만 하고, 라우팅(bpf_fib_lookup)은
+# cpumap 의 CPU 1..N 에서 돌게 해서 CPU 수에 따른 포워딩 Mpps 를 출력합니다.
+# ("0 CPU" 는 cpumap 없이 CPU 0 에서 바로 포워딩한 기준값)
+#
+# 사용법: sudo ./bench_cpumap.sh [최대 CPU 수] [측정 시간(초)] [native|skb]
+
+MAX_CPUS=${1:-$(($(nproc) - 1))}
+DURATION=${2:-10}
+MODE=${3:-native}
+NS="cb-gen cb-router cb-sink"
+BPFFS=/tmp/cb-bpffs
+
+[ "$MODE" = skb ] && LOAD_MODE=-S || LOAD_MODE=-N
+[ "$MODE" = skb ] && XDP_OFF=xdpgeneric || XDP_OFF=xdpdrv
+
+cleanup() {
+    [ -e /proc/net/pktgen/pgctrl ] && ip netns exec cb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl" 2>/dev/null
+    wait 2>/dev/null
+    for ns in $NS; do ip netns del $ns 2>/dev/null; done
+    umount $BPFFS 2>/dev/null && rmdir $BPFFS
+}
+trap cleanup EXIT
+
+if [ "$MAX_CPUS" -lt 1 ] || [ "$MAX_CPUS" -ge "$(nproc)" ]; then
+    echo "최대 CPU 수는 1 ~ $(($(nproc) - 1)) (CPU 0 은 pktgen 용)"
+    exit 1
+fi
+
+make xdp_prog_kern.o xdp_loader xdp_prog_user xdp_cpumap_user > /dev/null || exit 1
+modprobe pktgen || exit 1
+
+# 1. 네임스페이스 + veth 구성
+for ns in $NS; do ip netns add $ns; done
+ip link add g0 netns cb-gen type veth peer name r0 netns cb-router
+ip link add r1 netns cb-router type veth peer name s0 netns cb-sink
+
+ip -n cb-gen addr add 10.10.1.2/24 dev g0
+ip -n cb-router addr add 10.10.1.1/24 dev r0
+ip -n cb-router addr add 10.10.2.1/24 dev r1
+ip -n cb-sink addr add 10.10.2.2/24 dev s0
+for ns in $NS; do ip -n $ns link set lo up; done
+ip -n cb-gen link set g0 up
+ip -n cb-router link set r0 up
+ip -n cb-router link set r1 up
+ip -n cb-sink link set s0 up
+ip netns exec cb-router sysctl -qw net.ipv4.ip_forward=1
+
+R0_MAC=$(ip netns exec cb-router cat /sys/class/net/r0/address)
+S0_MAC=$(ip netns exec cb-sink cat /sys/class/net/s0/address)
+ip -n cb-router neigh add 10.10.2.2 lladdr $S0_MAC dev r1 nud permanent
+
+# sink: XDP 로 받아서 버림
+ip netns exec cb-sink sh -c "mount -t bpf bpf /sys/fs/bpf && \
+    ./xdp_loader -q $LOAD_MODE --dev s0 --filename xdp_prog_kern.o --progname xdp_drop_func" || exit 1
+
+# router 는 ip netns exec 를 여러 번 하므로, 호스트에 만든 bpffs 를 매번 bind 해서
+# xdp_loader 가 고정한 맵을 xdp_cpumap_user 가 다시 찾을 수 있게 함
+mkdir -p $BPFFS && mount -t bpf bpf $BPFFS || exit 1
+router() {
+    ip netns exec cb-router sh -c "mount --bind $BPFFS /sys/fs/bpf && $1"
+}
+
+# router: r0 에 1 단계, tx_port 에 r1
+router "./xdp_loader -q $LOAD_MODE --dev r0 --filename xdp_prog_kern.o --progname xdp_cpumap_rss_func && \
+    ./xdp_prog_user -q --dev r0 --redirect-dev r1 > /dev/null" || exit 1
+
+# 2. pktgen 설정 (스레드 하나, 소스 포트를 섞어서 흐름을 여러 개로)
+pg() {
+    ip netns exec cb-gen sh -c "echo '$2' > /proc/net/pktgen/$1"
+}
+pg kpktgend_0 "rem_device_all"
+pg kpktgend_0 "add_device g0"
+pg g0 "count 0"
+pg g0 "clone_skb 0"
+pg g0 "pkt_size 60"
+pg g0 "delay 0"
+pg g0 "dst 10.10.2.2"
+pg g0 "dst_mac $R0_MAC"
+pg g0 "udp_src_min 1024"
+pg g0 "udp_src_max 65535"
+pg g0 "flag UDPSRC_RND"
+
+rx() {
+    ip netns exec cb-sink cat /sys/class/net/s0/statistics/rx_packets
+}
+
+# 3. 2 단계 CPU 를 0 ~ MAX_CPUS 개로 바꿔가며 측정
+for n in $(seq 0 $MAX_CPUS); do
+    [ $n -eq 0 ] && cpus=none || cpus=1-$n
+    router "./xdp_cpumap_user -q r0 $cpus" || exit 1
+
+    ip netns exec cb-gen sh -c "echo start > /proc/net/pktgen/pgctrl" &
+    sleep 1 # 워밍업
+    before=$(rx)
+    sleep $DURATION
+    after=$(rx)
+    ip netns exec cb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl"
+    wait
+
+    echo "$n $(( (after - before) / DURATION ))" | \
+        awk '{ printf "%2d CPU %8.3f Mpps forwarded\n", $1, $2 / 1e6 }'
+done
+
+ip -n cb-router link set dev r0 $XDP_OFF off
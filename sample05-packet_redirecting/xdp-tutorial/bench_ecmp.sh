@@ -0,0 +1,50 @@
+#!/bin/bash
+
+# ECMP 그룹 분산 확인 (xdp_lpm_router_func)
+# (root 권한 필요, docker 없이 호스트에서 실행)
+#
+# netns 하나에 veth 한 쌍을 만들고 16.0.0.0/24 라우트 N 개를 게이트웨이
+# M 개 (192.168.100.2 ~) 로 가는 multipath 라우트로 넣은 뒤,
+# xdp_lpm_bench 로 소스 포트를 섞은 패킷을 돌려 게이트웨이별 비율을 출력합니다.
+# 게이트웨이 k 의 MAC 은 02:00:00:00:00:0k 입니다.
+#
+# 사용법: sudo ./bench_ecmp.sh [게이트웨이 수] [라우트 수]   (기본: 4 1000)
+
+GWS=${1:-4}
+ROUTES=${2:-1000}
+NS=ecmp-bench
+
+cleanup() {
+    ip netns del $NS 2>/dev/null
+    rm -f /tmp/ecmp_routes.batch
+}
+trap cleanup EXIT
+
+make xdp_prog_kern.o xdp_loader xdp_lpm_sync xdp_lpm_bench > /dev/null || exit 1
+
+ip netns add $NS
+ip -n $NS link add veth0 type veth peer name veth1
+ip -n $NS addr add 192.168.100.1/24 dev veth0
+ip -n $NS addr add 192.168.101.1/24 dev veth1
+ip -n $NS link set lo up
+ip -n $NS link set veth0 up
+ip -n $NS link set veth1 up
+ip netns exec $NS sysctl -qw net.ipv4.ip_forward=1
+
+NEXTHOPS=""
+for k in $(seq 2 $((GWS + 1))); do
+    ip -n $NS neigh add 192.168.100.$k lladdr 02:00:00:00:00:$(printf %02x $k) dev veth0 nud permanent
+    NEXTHOPS="$NEXTHOPS nexthop via 192.168.100.$k dev veth0"
+done
+
+awk -v n=$ROUTES -v nh="$NEXTHOPS" 'BEGIN {
+    for (i = 0; i < n; i++)
+        printf "route add %d.%d.%d.0/24 proto static%s\n",
+            16 + int(i / 65536), int(i / 256) % 256, i % 256, nh
+}' > /tmp/ecmp_routes.batch
+ip -n $NS -batch /tmp/ecmp_routes.batch || exit 1
+
+ip netns exec $NS sh -c "mount -t bpf bpf /sys/fs/bpf && \
+    ./xdp_loader -q -S --dev veth1 --progname xdp_lpm_router_func && \
+    ./xdp_lpm_sync --oneshot -q veth1 && \
+    ./xdp_lpm_bench veth1 $ROUTES" || exit 1
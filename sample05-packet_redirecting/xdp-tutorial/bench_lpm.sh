@@ -0,0 +1,51 @@
+#!/bin/bash
+
+# LPM 포워딩 엔진(xdp_lpm_router_func) vs bpf_fib_lookup(xdp_router_func) 비교
+# (root 권한 필요, docker 없이 호스트에서 실행)
+#
+# netns 하나에 veth 한 쌍을 만들고, 16.0.0.0 부터 /24 라우트 N 개를
+# 192.168.100.2 (veth0) 로 넣은 뒤 xdp_lpm_sync 로 LPM 맵에 복사하고
+# xdp_lpm_bench 로 두 프로그램의 패킷당 처리 시간을 잽니다.
+#
+# 사용법: sudo ./bench_lpm.sh [라우트 수...]   (기본: 1000 100000 1000000)
+
+SIZES=${*:-"1000 100000 1000000"}
+NS=lpm-bench
+
+cleanup() {
+    ip netns del $NS 2>/dev/null
+    rm -f /tmp/lpm_routes.batch
+}
+trap cleanup EXIT
+
+make xdp_prog_kern.o xdp_loader xdp_lpm_sync xdp_lpm_bench > /dev/null || exit 1
+
+ip netns add $NS
+ip -n $NS link add veth0 type veth peer name veth1
+ip -n $NS addr add 192.168.100.1/24 dev veth0
+ip -n $NS addr add 192.168.101.1/24 dev veth1
+ip -n $NS link set lo up
+ip -n $NS link set veth0 up
+ip -n $NS link set veth1 up
+ip -n $NS neigh add 192.168.100.2 lladdr 02:00:00:00:00:02 dev veth0 nud permanent
+ip netns exec $NS sysctl -qw net.ipv4.ip_forward=1
+
+for n in $SIZES; do
+    # 1. 커널 라우팅 테이블 채우기
+    ip -n $NS route flush proto static
+    awk -v n=$n 'BEGIN {
+        for (i = 0; i < n; i++)
+            printf "route add %d.%d.%d.0/24 via 192.168.100.2 dev veth0 proto static\n",
+                16 + int(i / 65536), int(i / 256) % 256, i % 256
+    }' > /tmp/lpm_routes.batch
+    ip -n $NS -batch /tmp/lpm_routes.batch || exit 1
+
+    # 2. veth1 에 LPM 라우터를 붙여 맵을 고정하고, 라우트를 맵으로 복사한 뒤 측정
+    # (ip netns exec 는 /sys 를 새로 마운트하므로 bpffs 도 매번 마운트)
+    ip netns exec $NS sh -c "mount -t bpf bpf /sys/fs/bpf && \
+        ./xdp_loader -q -S --dev veth1 --progname xdp_lpm_router_func && \
+        ./xdp_lpm_sync --oneshot -q veth1 && \
+        ./xdp_lpm_bench veth1 $n" || exit 1
+
+    ip -n $NS link set dev veth1 xdpgeneric off
+done
@@ -0,0 +1,114 @@
+#!/bin/bash
+
+# MPLS 레이블 스위칭 성능 비교: 커널 mpls_router vs xdp_mpls_func
+# (root 권한 필요, docker 없이 호스트에서 실행)
+#
+#   gen (g0) ---- (l0) lsr (l1) ---- (s0) sink
+#   10.10.1.2    10.10.1.1   10.10.2.1    10.10.2.2
+#
+# gen 에서 pktgen 으로 레이블 100 (TTL 64, IPv4 UDP 페이로드) 을 붙인 64 바이트 프레임을 보내고,
+# lsr 이 swap (100 -> 200), push (100 -> 300/200), pop (PHP, IPv4 로 내보냄) 한 패킷 수를
+# sink 의 s0 (xdp_drop_func) 수신 카운터로 세서 Mpps 로 출력합니다.
+#
+# 사용법: sudo ./bench_mpls.sh [측정 시간(초)] [pktgen 스레드 수]
+
+DURATION=${1:-10}
+THREADS=${2:-2}
+NS="mb-gen mb-lsr mb-sink"
+
+cleanup() {
+    [ -e /proc/net/pktgen/pgctrl ] && ip netns exec mb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl" 2>/dev/null
+    wait 2>/dev/null
+    for ns in $NS; do ip netns del $ns 2>/dev/null; done
+}
+trap cleanup EXIT
+
+make xdp_prog_kern.o xdp_loader xdp_mpls > /dev/null || exit 1
+modprobe pktgen || exit 1
+modprobe mpls_router || exit 1
+
+# 1. 네임스페이스 + veth 구성
+for ns in $NS; do ip netns add $ns; done
+ip link add g0 netns mb-gen type veth peer name l0 netns mb-lsr
+ip link add l1 netns mb-lsr type veth peer name s0 netns mb-sink
+
+ip -n mb-gen addr add 10.10.1.2/24 dev g0
+ip -n mb-lsr addr add 10.10.1.1/24 dev l0
+ip -n mb-lsr addr add 10.10.2.1/24 dev l1
+ip -n mb-sink addr add 10.10.2.2/24 dev s0
+for ns in $NS; do ip -n $ns link set lo up; done
+ip -n mb-gen link set g0 up
+ip -n mb-lsr link set l0 up
+ip -n mb-lsr link set l1 up
+ip -n mb-sink link set s0 up
+
+# 커널 MPLS: 레이블 테이블 크기, l0 에서 MPLS 수신 허용
+ip netns exec mb-lsr sysctl -qw net.mpls.platform_labels=1000
+ip netns exec mb-lsr sysctl -qw net.mpls.conf.l0.input=1
+ip netns exec mb-lsr sysctl -qw net.ipv4.ip_forward=1
+
+L0_MAC=$(ip netns exec mb-lsr cat /sys/class/net/l0/address)
+S0_MAC=$(ip netns exec mb-sink cat /sys/class/net/s0/address)
+ip -n mb-lsr neigh add 10.10.2.2 lladdr $S0_MAC dev l1 nud permanent
+
+# sink: native XDP 로 받아서 버림 (veth 로 redirect 된 패킷은 받는 쪽에 XDP 프로그램이 있어야 함)
+ip netns exec mb-sink sh -c "mount -t bpf bpf /sys/fs/bpf && \
+    ./xdp_loader -q -N --dev s0 --filename xdp_prog_kern.o --progname xdp_drop_func" || exit 1
+
+# 2. pktgen 설정 (레이블 100, TTL 64: 00064040, BoS 는 pktgen 이 붙임)
+pg() {
+    ip netns exec mb-gen sh -c "echo '$2' > /proc/net/pktgen/$1"
+}
+for i in $(seq 0 $((THREADS - 1))); do
+    pg kpktgend_$i "rem_device_all"
+    pg kpktgend_$i "add_device g0@$i"
+    pg g0@$i "count 0"
+    pg g0@$i "clone_skb 0"
+    pg g0@$i "pkt_size 60"
+    pg g0@$i "delay 0"
+    pg g0@$i "mpls 00064040"
+    pg g0@$i "dst 10.10.2.2"
+    pg g0@$i "dst_mac $L0_MAC"
+    pg g0@$i "udp_src_min 1024"
+    pg g0@$i "udp_src_max 1279"
+    pg g0@$i "flag UDPSRC_RND"
+done
+
+rx() {
+    ip netns exec mb-sink cat /sys/class/net/s0/statistics/rx_packets
+}
+
+measure() {
+    local before after
+
+    ip netns exec mb-gen sh -c "echo start > /proc/net/pktgen/pgctrl" &
+    sleep 1 # 워밍업
+    before=$(rx)
+    sleep $DURATION
+    after=$(rx)
+    ip netns exec mb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl"
+    wait
+    echo $(( (after - before) / DURATION ))
+}
+
+# 3. 같은 레이블 동작을 커널 라우트 / XDP ILM 항목으로 걸고 측정
+run() {
+    local op=$1 kroute=$2 xop=$3 kernel xdp
+
+    ip -n mb-lsr -f mpls route replace 100 $kroute via inet 10.10.2.2 dev l1
+    kernel=$(measure)
+    ip -n mb-lsr -f mpls route del 100
+
+    ip netns exec mb-lsr sh -c "mount -t bpf bpf /sys/fs/bpf && \
+        ./xdp_loader -q -N --dev l0 --filename xdp_prog_kern.o --progname xdp_mpls_func && \
+        ./xdp_mpls l0 100 $xop dev l1 via $S0_MAC" || exit 1
+    xdp=$(measure)
+    ip -n mb-lsr link set dev l0 xdpdrv off
+
+    echo "$op $kernel $xdp" | \
+        awk '{ printf "%-6s kernel %8.3f Mpps   xdp %8.3f Mpps\n", $1, $2 / 1e6, $3 / 1e6 }'
+}
+
+run swap "as 200" "swap 200"
+run push "as 300/200" "push 300/200"
+run pop "" "pop"
@@ -0,0 +1,92 @@
+#!/bin/bash
+
+# NO_NEIGH 처리 비교: 전부 커널로 넘기기 vs neigh_pending 으로 제한
+# (root 권한 필요, docker 없이 호스트에서 실행)
+#
+#   gen (g0) ---- (r0) router (r1) ---- (s0) sink
+#   10.10.1.2    10.10.1.1   10.10.2.1    10.10.2.2
+#
+# gen 에서 pktgen 으로 10.10.2.10 ~ 10.10.2.250 (응답하지 않는 주소) 로 보내서
+# router 의 이웃 캐시가 계속 비어 있는 상태(cold cache)를 만들고,
+# 측정 시간 동안 전체 CPU 중 커널(system+irq+softirq) 이 쓴 비율을 비교합니다.
+# (pktgen 스레드가 쓰는 CPU 도 포함되므로 두 결과의 차이를 보면 됩니다)
+#
+# 사용법: sudo ./bench_neigh.sh [측정 시간(초)] [pktgen 스레드 수]
+
+DURATION=${1:-10}
+THREADS=${2:-2}
+NS="nb-gen nb-router nb-sink"
+
+cleanup() {
+    [ -e /proc/net/pktgen/pgctrl ] && ip netns exec nb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl" 2>/dev/null
+    wait 2>/dev/null
+    for ns in $NS; do ip netns del $ns 2>/dev/null; done
+}
+trap cleanup EXIT
+
+make xdp_prog_kern.o xdp_prog_kern_neigh_pass.o xdp_loader xdp_prog_user > /dev/null || exit 1
+modprobe pktgen || exit 1
+
+# 1. 네임스페이스 + veth 구성
+for ns in $NS; do ip netns add $ns; done
+ip link add g0 netns nb-gen type veth peer name r0 netns nb-router
+ip link add r1 netns nb-router type veth peer name s0 netns nb-sink
+
+ip -n nb-gen addr add 10.10.1.2/24 dev g0
+ip -n nb-router addr add 10.10.1.1/24 dev r0
+ip -n nb-router addr add 10.10.2.1/24 dev r1
+ip -n nb-sink addr add 10.10.2.2/24 dev s0
+for ns in $NS; do ip -n $ns link set lo up; done
+ip -n nb-gen link set g0 up
+ip -n nb-router link set r0 up
+ip -n nb-router link set r1 up
+ip -n nb-sink link set s0 up
+ip netns exec nb-router sysctl -qw net.ipv4.ip_forward=1
+
+R0_MAC=$(ip netns exec nb-router cat /sys/class/net/r0/address)
+
+# 2. pktgen 설정 (목적지 주소를 섞어서 해석 안 되는 이웃 241 개)
+pg() {
+    ip netns exec nb-gen sh -c "echo '$2' > /proc/net/pktgen/$1"
+}
+for i in $(seq 0 $((THREADS - 1))); do
+    pg kpktgend_$i "rem_device_all"
+    pg kpktgend_$i "add_device g0@$i"
+    pg g0@$i "count 0"
+    pg g0@$i "clone_skb 0"
+    pg g0@$i "pkt_size 60"
+    pg g0@$i "delay 0"
+    pg g0@$i "dst_min 10.10.2.10"
+    pg g0@$i "dst_max 10.10.2.250"
+    pg g0@$i "dst_mac $R0_MAC"
+    pg g0@$i "flag IPDST_RND"
+done
+
+# /proc/stat 의 cpu 줄: user nice system idle iowait irq softirq ...
+cpu_sample() {
+    awk '/^cpu / { print $4 + $7 + $8, $2 + $3 + $4 + $5 + $6 + $7 + $8 }' /proc/stat
+}
+
+# 3. 라우터 프로그램을 바꿔가며 측정
+run() {
+    local name=$1 obj=$2 k0 t0 k1 t1
+
+    ip -n nb-router neigh flush dev r1
+    ip netns exec nb-router sh -c "mount -t bpf bpf /sys/fs/bpf && \
+        ./xdp_loader -q -N --dev r0 --filename $obj --progname xdp_router_func && \
+        ./xdp_prog_user -q --dev r0 --redirect-dev r1 > /dev/null" || exit 1
+
+    ip netns exec nb-gen sh -c "echo start > /proc/net/pktgen/pgctrl" &
+    read k0 t0 < <(cpu_sample)
+    sleep $DURATION
+    read k1 t1 < <(cpu_sample)
+    ip netns exec nb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl"
+    wait
+
+    echo "$name $((k1 - k0)) $((t1 - t0))" | \
+        awk '{ printf "%-10s kernel CPU %5.1f%% of all CPUs\n", $1, 100 * $2 / $3 }'
+    ip -n nb-router link set dev r0 xdpdrv off
+}
+
+run pass-all xdp_prog_kern_neigh_pass.o
+run limited xdp_prog_kern.o
@@ -0,0 +1,98 @@
+#!/bin/bash
+
+# xdp_router_func 포워딩 성능 비교: bpf_redirect() vs devmap (bpf_redirect_map)
+# (root 권한 필요, docker 없이 호스트에서 실행)
+#
+#   gen (g0) ---- (r0) router (r1) ---- (s0) sink
+#   10.10.1.2    10.10.1.1   10.10.2.1    10.10.2.2
+#
+# gen 에서 pktgen 으로 sink 를 향한 64 바이트 UDP 를 보내고,
+# router 의 r0 에 붙은 xdp_router_func 가 FIB 조회 후 r1 로 내보낸 패킷 수를
+# sink 의 s0 (xdp_drop_func) 수신 카운터로 세서 Mpps 로 출력합니다.
+#
+# 사용법: sudo ./bench_redirect.sh [측정 시간(초)] [pktgen 스레드 수]
+
+DURATION=${1:-10}
+THREADS=${2:-2}
+NS="rb-gen rb-router rb-sink"
+
+cleanup() {
+    [ -e /proc/net/pktgen/pgctrl ] && ip netns exec rb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl" 2>/dev/null
+    wait 2>/dev/null
+    for ns in $NS; do ip netns del $ns 2>/dev/null; done
+}
+trap cleanup EXIT
+
+make xdp_prog_kern.o xdp_prog_kern_redirect.o xdp_loader xdp_prog_user > /dev/null || exit 1
+modprobe pktgen || exit 1
+
+# 1. 네임스페이스 + veth 구성
+for ns in $NS; do ip netns add $ns; done
+ip link add g0 netns rb-gen type veth peer name r0 netns rb-router
+ip link add r1 netns rb-router type veth peer name s0 netns rb-sink
+
+ip -n rb-gen addr add 10.10.1.2/24 dev g0
+ip -n rb-router addr add 10.10.1.1/24 dev r0
+ip -n rb-router addr add 10.10.2.1/24 dev r1
+ip -n rb-sink addr add 10.10.2.2/24 dev s0
+for ns in $NS; do ip -n $ns link set lo up; done
+ip -n rb-gen link set g0 up
+ip -n rb-router link set r0 up
+ip -n rb-router link set r1 up
+ip -n rb-sink link set s0 up
+ip netns exec rb-router sysctl -qw net.ipv4.ip_forward=1
+
+R0_MAC=$(ip netns exec rb-router cat /sys/class/net/r0/address)
+S0_MAC=$(ip netns exec rb-sink cat /sys/class/net/s0/address)
+# bpf_fib_lookup 이 NO_NEIGH 로 스택에 넘기지 않도록 이웃 항목 고정
+ip -n rb-router neigh add 10.10.2.2 lladdr $S0_MAC dev r1 nud permanent
+
+# sink: native XDP 로 받아서 버림 (veth 로 redirect 된 패킷은 받는 쪽에 XDP 프로그램이 있어야 함)
+ip netns exec rb-sink sh -c "mount -t bpf bpf /sys/fs/bpf && \
+    ./xdp_loader -q -N --dev s0 --filename xdp_prog_kern.o --progname xdp_drop_func" || exit 1
+
+# 2. pktgen 설정 (스레드마다 g0@N 장치, 소스 포트를 섞어서 흐름을 여러 개로)
+pg() {
+    ip netns exec rb-gen sh -c "echo '$2' > /proc/net/pktgen/$1"
+}
+for i in $(seq 0 $((THREADS - 1))); do
+    pg kpktgend_$i "rem_device_all"
+    pg kpktgend_$i "add_device g0@$i"
+    pg g0@$i "count 0"
+    pg g0@$i "clone_skb 0"
+    pg g0@$i "pkt_size 60"
+    pg g0@$i "delay 0"
+    pg g0@$i "dst 10.10.2.2"
+    pg g0@$i "dst_mac $R0_MAC"
+    pg g0@$i "udp_src_min 1024"
+    pg g0@$i "udp_src_max 1279"
+    pg g0@$i "flag UDPSRC_RND"
+done
+
+rx() {
+    ip netns exec rb-sink cat /sys/class/net/s0/statistics/rx_packets
+}
+
+# 3. 라우터 프로그램을 바꿔가며 측정
+run() {
+    local name=$1 obj=$2 before after
+
+    ip netns exec rb-router sh -c "mount -t bpf bpf /sys/fs/bpf && \
+        ./xdp_loader -q -N --dev r0 --filename $obj --progname xdp_router_func && \
+        ./xdp_prog_user -q --dev r0 --redirect-dev r1 > /dev/null" || exit 1
+
+    ip netns exec rb-gen sh -c "echo start > /proc/net/pktgen/pgctrl" &
+    sleep 1 # 워밍업
+    before=$(rx)
+    sleep $DURATION
+    after=$(rx)
+    ip netns exec rb-gen sh -c "echo stop > /proc/net/pktgen/pgctrl"
+    wait
+
+    echo "$name $(( (after - before) / DURATION ))" | \
+        awk '{ printf "%-12s %8.3f Mpps forwarded\n", $1, $2 / 1e6 }'
+    ip -n rb-router link set dev r0 xdpdrv off
+}
+
+run bpf_redirect xdp_prog_kern_redirect.o
+run devmap xdp_prog_kern.o
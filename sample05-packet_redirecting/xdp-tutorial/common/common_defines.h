@@ -27,6 +27,8 @@ struct config {
 	int xsk_if_queue;
 	bool xsk_poll_mode;
 	bool unload_all;
+	bool fib_stats;
+	char config_file[512];
 };
 
 /* Defined in common_params.o */
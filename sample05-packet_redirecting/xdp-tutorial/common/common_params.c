@@ -182,6 +182,13 @@ void parse_cmdline_args(int argc, char **argv,
 		case 4: /* --unload-all */
 			cfg->unload_all = true;
 			break;
+		case 5: /* --fib */
+			cfg->fib_stats = true;
+			break;
+		case 6: /* --config */
+			dest  = (char *)&cfg->config_file;
+			strncpy(dest, optarg, sizeof(cfg->config_file) - 1);
+			break;
 		case 'h':
 			full_help = true;
 			/* fall-through */
@@ -28,6 +28,7 @@
 #include <linux/icmpv6.h>
 #include <linux/udp.h>
 #include <linux/tcp.h>
+#include <linux/mpls.h>
 
 /* Header cursor to keep track of current parsing position */
 struct hdr_cursor {
@@ -129,6 +130,76 @@ static __always_inline int parse_ethhdr(struct hdr_cursor *nh,
 	return parse_ethhdr_vlan(nh, data_end, ethhdr, NULL);
 }
 
+/* Allow users of header file to redefine MPLS max depth */
+#ifndef MPLS_MAX_DEPTH
+#define MPLS_MAX_DEPTH 4
+#endif
+
+/* Struct for collecting labels after parsing via parse_mpls_stack */
+struct collect_mpls {
+	__u32 label[MPLS_MAX_DEPTH];
+	int depth;
+};
+
+static __always_inline int proto_is_mpls(__u16 h_proto)
+{
+	return !!(h_proto == bpf_htons(ETH_P_MPLS_UC) ||
+		  h_proto == bpf_htons(ETH_P_MPLS_MC));
+}
+
+/* Walks the MPLS label stack at nh->pos down to the bottom-of-stack entry,
+ * leaving nh->pos on the payload and *top on the outermost entry.
+ *
+ * MPLS doesn't say what it carries, so the payload type is guessed from
+ * the IP version nibble: ETH_P_IP or ETH_P_IPV6 (network-byte-order), or
+ * 0 for anything else (pseudowires, control words). A stack deeper than
+ * MPLS_MAX_DEPTH, or cut short by the end of the packet, returns -1.
+ */
+static __always_inline int parse_mpls_stack(struct hdr_cursor *nh,
+					    void *data_end,
+					    struct mpls_label **top,
+					    struct collect_mpls *labels)
+{
+	struct mpls_label *lse = nh->pos;
+	__u8 *payload;
+	int i;
+
+	*top = lse;
+
+	/* Same unrolling as parse_ethhdr_vlan() */
+	#pragma unroll
+	for (i = 0; i < MPLS_MAX_DEPTH; i++) {
+		if (lse + 1 > data_end)
+			return -1;
+
+		if (labels) { /* collect labels */
+			labels->label[i] = (bpf_ntohl(lse->entry) &
+					    MPLS_LS_LABEL_MASK) >> MPLS_LS_LABEL_SHIFT;
+			labels->depth = i + 1;
+		}
+
+		if (lse->entry & bpf_htonl(MPLS_LS_S_MASK))
+			break;
+		lse++;
+	}
+	if (i == MPLS_MAX_DEPTH)
+		return -1;
+
+	nh->pos = lse + 1;
+	payload = nh->pos;
+	if (payload + 1 > data_end)
+		return 0;
+
+	switch (*payload >> 4) {
+	case 4:
+		return bpf_htons(ETH_P_IP);
+	case 6:
+		return bpf_htons(ETH_P_IPV6);
+	default:
+		return 0;
+	}
+}
+
 static __always_inline int parse_ip6hdr(struct hdr_cursor *nh,
 					void *data_end,
 					struct ipv6hdr **ip6hdr)
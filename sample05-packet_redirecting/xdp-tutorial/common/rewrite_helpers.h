@@ -12,6 +12,7 @@
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/if_ether.h>
+#include <linux/mpls.h>
 
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_endian.h>
@@ -107,6 +108,80 @@ static __always_inline int vlan_tag_push(struct xdp_md *ctx,
 	return 0;
 }
 
+/* Builds an MPLS label stack entry, in network byte order */
+static __always_inline __be32 mpls_lse(__u32 label, __u8 tc, int bos, __u8 ttl)
+{
+	return bpf_htonl((label << MPLS_LS_LABEL_SHIFT) |
+			 ((__u32)tc << MPLS_LS_TC_SHIFT) |
+			 (bos ? MPLS_LS_S_MASK : 0) |
+			 ttl);
+}
+
+/* Pops the outermost MPLS label stack entry off the packet. next_proto is
+ * the EtherType of what follows it: ETH_P_MPLS_UC, unless the entry was the
+ * bottom of the stack. Returns 0 on success, -1 on failure.
+ */
+static __always_inline int mpls_label_pop(struct xdp_md *ctx, struct ethhdr *eth,
+					  __be16 next_proto)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	struct mpls_label *lse;
+	struct ethhdr eth_cpy;
+
+	if (!proto_is_mpls(eth->h_proto))
+		return -1;
+
+	lse = (void *)(eth + 1);
+	if (lse + 1 > data_end)
+		return -1;
+
+	__builtin_memcpy(&eth_cpy, eth, sizeof(eth_cpy));
+
+	if (bpf_xdp_adjust_head(ctx, (int)sizeof(*lse)))
+		return -1;
+
+	eth = (void *)(long)ctx->data;
+	data_end = (void *)(long)ctx->data_end;
+	if (eth + 1 > data_end)
+		return -1;
+
+	__builtin_memcpy(eth, &eth_cpy, sizeof(*eth));
+	eth->h_proto = next_proto;
+	return 0;
+}
+
+/* Pushes a new label stack entry (see mpls_lse()) after the Ethernet
+ * header. The caller sets its bottom-of-stack bit: only when the packet
+ * wasn't MPLS already. Returns 0 on success, -1 on failure.
+ */
+static __always_inline int mpls_label_push(struct xdp_md *ctx,
+		struct ethhdr *eth, __be32 entry)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	struct mpls_label *lse;
+	struct ethhdr eth_cpy;
+
+	__builtin_memcpy(&eth_cpy, eth, sizeof(eth_cpy));
+
+	if (bpf_xdp_adjust_head(ctx, 0 - (int)sizeof(*lse)))
+		return -1;
+
+	data_end = (void *)(long)ctx->data_end;
+	eth = (void *)(long)ctx->data;
+	if (eth + 1 > data_end)
+		return -1;
+
+	__builtin_memcpy(eth, &eth_cpy, sizeof(*eth));
+
+	lse = (void *)(eth + 1);
+	if (lse + 1 > data_end)
+		return -1;
+
+	lse->entry = entry;
+	eth->h_proto = bpf_htons(ETH_P_MPLS_UC);
+	return 0;
+}
+
 /*
  * Swaps destination and source MAC addresses inside an Ethernet header
  */
@@ -16,4 +16,8 @@ echo "make"
 ./xdp_loader xdp_prog_kern.o -S --dev eth0 --progname xdp_router_func
 ./xdp_loader xdp_prog_kern.o -S --dev eth1 --progname xdp_router_func
 
+# 라우터가 redirect 할 수 있는 출구 인터페이스를 tx_port devmap 에 등록
+./xdp_prog_user --dev eth0 --redirect-dev eth1
+./xdp_prog_user --dev eth1 --redirect-dev eth0
+
 tail -f /dev/null
\ No newline at end of file
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP learning L2 bridge\n"
+	" - Attaches xdp_bridge_func to every <ifname> from one object, so the\n"
+	"   ports share the fdb (MAC table) and bridge_ports maps\n"
+	" - Ages learned MACs out of fdb in batches until interrupted, then detaches\n"
+	" - Maps are pinned under /sys/fs/bpf/xdp_bridge while running\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+
+#include "./common/common_defines.h"
+
+#include "xdp_bridge_kern_user.h"
+
+#define PIN_DIR		"/sys/fs/bpf/xdp_bridge"
+#define AGE_BATCH	4096
+#define MAX_STATICS	64
+
+struct mac_key {
+	unsigned char addr[ETH_ALEN];
+};
+
+static int ifindexes[BRIDGE_MAX_PORTS];
+static int nr_ports;
+static __u32 xdp_flags = XDP_FLAGS_DRV_MODE;
+static volatile bool exiting;
+
+/* Scratch for one ageing pass; static, fdb can hold BRIDGE_MAX_MACS */
+static struct mac_key batch_keys[AGE_BATCH];
+static struct fdb_entry batch_vals[AGE_BATCH];
+static struct mac_key expired[BRIDGE_MAX_MACS];
+
+static void sig_handler(int sig)
+{
+	exiting = true;
+}
+
+static __u64 now_ns(void)
+{
+	struct timespec ts;
+
+	/* Same clock as bpf_ktime_get_ns() */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int parse_mac(const char *str, unsigned char mac[ETH_ALEN])
+{
+	char end;
+
+	if (sscanf(str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx%c", &mac[0], &mac[1],
+		   &mac[2], &mac[3], &mac[4], &mac[5], &end) != 6)
+		return -1;
+	return 0;
+}
+
+/* -m <mac>@<ifname>: a static entry, never learned over or aged */
+static int add_static(int fdb_fd, char *arg)
+{
+	struct fdb_entry entry = { .flags = FDB_F_STATIC };
+	unsigned char mac[ETH_ALEN];
+	char *at = strchr(arg, '@');
+
+	if (!at)
+		return -1;
+	*at = '\0';
+	entry.ifindex = if_nametoindex(at + 1);
+	if (!entry.ifindex || parse_mac(arg, mac) < 0)
+		return -1;
+	if (bpf_map_update_elem(fdb_fd, mac, &entry, 0) < 0) {
+		fprintf(stderr, "ERR: adding static %s: %s\n", arg, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Collect every expired learned entry with batched lookups, then delete
+ * them with batched deletes. An entry refreshed between the two steps is
+ * deleted anyway and relearned from its next frame.
+ */
+static int age_fdb(int fdb_fd, __u64 max_age_ns, int *total)
+{
+	DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	__u32 batch, count, n_expired = 0, done, i;
+	__u64 now = now_ns();
+	bool first = true;
+	int err;
+
+	*total = 0;
+	for (;;) {
+		count = AGE_BATCH;
+		err = bpf_map_lookup_batch(fdb_fd, first ? NULL : &batch, &batch,
+					   batch_keys, batch_vals, &count, &opts);
+		if (err < 0 && errno != ENOENT) {
+			fprintf(stderr, "ERR: reading fdb: %s\n", strerror(errno));
+			return -1;
+		}
+		first = false;
+
+		for (i = 0; i < count; i++) {
+			if (batch_vals[i].flags & FDB_F_STATIC)
+				continue;
+			if (now - batch_vals[i].updated > max_age_ns &&
+			    n_expired < BRIDGE_MAX_MACS)
+				expired[n_expired++] = batch_keys[i];
+		}
+		*total += count;
+		if (err < 0)
+			break;	/* ENOENT: no more entries */
+	}
+
+	for (done = 0; done < n_expired; done += count) {
+		count = n_expired - done;
+		if (bpf_map_delete_batch(fdb_fd, &expired[done], &count, &opts) < 0 &&
+		    errno != ENOENT) {
+			fprintf(stderr, "ERR: deleting from fdb: %s\n", strerror(errno));
+			return -1;
+		}
+		/* ENOENT: a MAC re-learned on another CPU meanwhile, skip it */
+		if (count < n_expired - done)
+			count++;
+	}
+
+	*total -= n_expired;
+	return n_expired;
+}
+
+static void detach_all(void)
+{
+	int i;
+
+	for (i = 0; i < nr_ports; i++)
+		bpf_xdp_detach(ifindexes[i], xdp_flags, NULL);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-S] [-q] [-a ageing_sec] [-m mac@ifname]... <ifname> <ifname>...\n\n", prog);
+	printf("  -S  attach in SKB (generic) mode instead of native\n");
+	printf("  -a  forget MACs not seen for this long (default 300)\n");
+	printf("  -m  add a static fdb entry\n\n");
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+int main(int argc, char **argv)
+{
+	int fdb_fd, ports_fd, prog_fd, opt, i, n, total;
+	char *statics[MAX_STATICS];
+	int nr_statics = 0, ageing = 300;
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	bool quiet = false;
+
+	while ((opt = getopt(argc, argv, "Sqa:m:")) != -1) {
+		switch (opt) {
+		case 'S':
+			xdp_flags = XDP_FLAGS_SKB_MODE;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 'a':
+			ageing = atoi(optarg);
+			break;
+		case 'm':
+			if (nr_statics < MAX_STATICS)
+				statics[nr_statics++] = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		}
+	}
+	if (argc - optind < 2 || argc - optind > BRIDGE_MAX_PORTS || ageing <= 0) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+	for (i = optind; i < argc; i++) {
+		ifindexes[nr_ports] = if_nametoindex(argv[i]);
+		if (!ifindexes[nr_ports]) {
+			fprintf(stderr, "ERR: unknown interface %s\n", argv[i]);
+			return EXIT_FAIL_OPTION;
+		}
+		nr_ports++;
+	}
+
+	obj = bpf_object__open_file("xdp_prog_kern.o", NULL);
+	if (libbpf_get_error(obj) || bpf_object__load(obj)) {
+		fprintf(stderr, "ERR: loading xdp_prog_kern.o\n");
+		return EXIT_FAIL_BPF;
+	}
+	prog = bpf_object__find_program_by_name(obj, "xdp_bridge_func");
+	fdb_fd = bpf_object__find_map_fd_by_name(obj, "fdb");
+	ports_fd = bpf_object__find_map_fd_by_name(obj, "bridge_ports");
+	if (!prog || fdb_fd < 0 || ports_fd < 0) {
+		fprintf(stderr, "ERR: xdp_bridge_func or its maps not found\n");
+		return EXIT_FAIL_BPF;
+	}
+	prog_fd = bpf_program__fd(prog);
+
+	for (i = 0; i < nr_statics; i++) {
+		if (add_static(fdb_fd, statics[i]) < 0) {
+			fprintf(stderr, "ERR: invalid static entry %s\n", statics[i]);
+			return EXIT_FAIL_OPTION;
+		}
+	}
+
+	/* Ports must be in the devmap before any of them can flood */
+	for (i = 0; i < nr_ports; i++) {
+		if (bpf_map_update_elem(ports_fd, &ifindexes[i], &ifindexes[i], 0) < 0) {
+			fprintf(stderr, "ERR: adding ifindex %d to bridge_ports: %s\n",
+				ifindexes[i], strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+	}
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+
+	for (i = 0; i < nr_ports; i++) {
+		if (bpf_xdp_attach(ifindexes[i], prog_fd, xdp_flags, NULL) < 0) {
+			fprintf(stderr, "ERR: attaching to %s: %s\n",
+				argv[optind + i], strerror(errno));
+			nr_ports = i;
+			detach_all();
+			return EXIT_FAIL_XDP;
+		}
+	}
+
+	bpf_object__unpin_maps(obj, PIN_DIR);
+	if (bpf_object__pin_maps(obj, PIN_DIR))
+		fprintf(stderr, "WARN: pinning maps to %s failed\n", PIN_DIR);
+
+	if (!quiet)
+		printf("bridging %d ports (%s mode), ageing %ds\n", nr_ports,
+		       xdp_flags == XDP_FLAGS_SKB_MODE ? "skb" : "native", ageing);
+
+	while (!exiting) {
+		sleep(1);
+		n = age_fdb(fdb_fd, (__u64)ageing * 1000000000ULL, &total);
+		if (n < 0)
+			break;
+		if (!quiet && n)
+			printf("fdb: %d MACs, %d aged out\n", total, n);
+	}
+
+	detach_all();
+	bpf_object__unpin_maps(obj, PIN_DIR);
+	bpf_object__close(obj);
+	return EXIT_OK;
+}
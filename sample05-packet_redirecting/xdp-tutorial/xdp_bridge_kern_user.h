@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Used by xdp_bridge_func (kernel side) and by xdp_bridge (userspace),
+ * for sharing the MAC table layout.
+ */
+#ifndef __XDP_BRIDGE_KERN_USER_H
+#define __XDP_BRIDGE_KERN_USER_H
+
+#define BRIDGE_MAX_MACS		65536
+#define BRIDGE_MAX_PORTS	64
+
+/* A learned entry is refreshed at most this often, so a busy flow
+ * doesn't write its fdb entry (and bounce the cache line) per packet
+ */
+#define FDB_REFRESH_NS		1000000000ULL
+
+/* struct fdb_entry flags */
+#define FDB_F_STATIC		(1U << 0)	/* never learned over, never aged */
+
+/* Value of the fdb map, keyed by MAC address */
+struct fdb_entry {
+	__u32 ifindex;
+	__u32 flags;
+	__u64 updated;		/* bpf_ktime_get_ns() (CLOCK_MONOTONIC) */
+};
+
+#endif /* __XDP_BRIDGE_KERN_USER_H */
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP cpumap software RSS setup\n"
+	" - For xdp_cpumap_rss_func attached by xdp_loader to <ifname>\n"
+	" - Installs xdp_cpumap_router_func on every CPU in <cpulist> (e.g. 1-3,6)\n"
+	"   and spreads flows over them; \"none\" forwards on the receiving CPU again\n"
+	" - CPUs that xdp_qos gave to a class stay in cpu_map\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <linux/bpf.h>
+
+#include "./common/common_defines.h"
+
+#include "xdp_qos_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+#define DEFAULT_QSIZE	2048
+#define CPUMAP_MAX_CPUS	64	/* cpu_map size in xdp_prog_kern.c */
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+/* Share the maps xdp_loader pinned, so the second stage uses the same
+ * tx_port and stats as the front stage
+ */
+static int reuse_pinned_maps(struct bpf_object *obj, const char *pin_dir)
+{
+	char path[PATH_MAX];
+	struct bpf_map *map;
+	int fd;
+
+	bpf_object__for_each_map(map, obj) {
+		snprintf(path, PATH_MAX, "%s/%s", pin_dir, bpf_map__name(map));
+		fd = bpf_obj_get(path);
+		if (fd < 0) {
+			fprintf(stderr, "ERR: opening %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+		if (bpf_map__reuse_fd(map, fd))
+			return -1;
+	}
+	return 0;
+}
+
+/* "1-3,6" -> cpus[] = { 1, 2, 3, 6 }, returns the count or -1 */
+static int parse_cpulist(const char *str, __u32 *cpus, int max_cpus)
+{
+	char *end;
+	long lo, hi;
+	int n = 0;
+
+	if (!strcmp(str, "none"))
+		return 0;
+
+	while (*str) {
+		lo = strtol(str, &end, 10);
+		if (end == str)
+			return -1;
+		hi = lo;
+		if (*end == '-') {
+			str = end + 1;
+			hi = strtol(str, &end, 10);
+			if (end == str)
+				return -1;
+		}
+		if (lo < 0 || hi < lo || hi >= max_cpus || n + hi - lo + 1 > max_cpus)
+			return -1;
+		while (lo <= hi)
+			cpus[n++] = lo++;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -1;
+		str = end;
+	}
+	return n;
+}
+
+static int map_fd(struct bpf_object *obj, const char *name)
+{
+	struct bpf_map *map = bpf_object__find_map_by_name(obj, name);
+
+	if (!map) {
+		fprintf(stderr, "ERR: map %s not found\n", name);
+		return -1;
+	}
+	return bpf_map__fd(map);
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_cpumap_val val = { .qsize = DEFAULT_QSIZE };
+	int cpu_map_fd, avail_fd, count_fd, qos_fd, max_cpus;
+	__u32 cpus[128], key, zero = 0;
+	struct qos_class cls;
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	char pin_dir[PATH_MAX];
+	bool quiet = false;
+	bool *selected;
+	int opt, n, i;
+
+	while ((opt = getopt(argc, argv, "qs:")) != -1) {
+		switch (opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 's':
+			val.qsize = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (argc - optind != 2 || !val.qsize) {
+usage:
+		printf("Usage: %s [-q] [-s qsize] <ifname> <cpulist|none>\n\n", argv[0]);
+		printf("DOCUMENTATION:\n %s\n", __doc__);
+		return EXIT_FAIL_OPTION;
+	}
+
+	max_cpus = libbpf_num_possible_cpus();
+	if (max_cpus > (int)(sizeof(cpus) / sizeof(cpus[0])))
+		max_cpus = sizeof(cpus) / sizeof(cpus[0]);
+
+	n = parse_cpulist(argv[optind + 1], cpus, max_cpus);
+	if (n < 0) {
+		fprintf(stderr, "ERR: invalid cpu list %s (%d possible CPUs)\n",
+			argv[optind + 1], max_cpus);
+		return EXIT_FAIL_OPTION;
+	}
+
+	obj = bpf_object__open_file("xdp_prog_kern.o", NULL);
+	if (libbpf_get_error(obj)) {
+		fprintf(stderr, "ERR: opening xdp_prog_kern.o\n");
+		return EXIT_FAIL_BPF;
+	}
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[optind]);
+	if (reuse_pinned_maps(obj, pin_dir) || bpf_object__load(obj)) {
+		fprintf(stderr, "ERR: loading xdp_prog_kern.o with maps from %s\n", pin_dir);
+		return EXIT_FAIL_BPF;
+	}
+
+	prog = bpf_object__find_program_by_name(obj, "xdp_cpumap_router_func");
+	cpu_map_fd = map_fd(obj, "cpu_map");
+	avail_fd = map_fd(obj, "cpus_available");
+	count_fd = map_fd(obj, "cpus_count");
+	qos_fd = map_fd(obj, "qos_classes");
+	if (!prog || cpu_map_fd < 0 || avail_fd < 0 || count_fd < 0 || qos_fd < 0)
+		return EXIT_FAIL_BPF;
+	val.bpf_prog.fd = bpf_program__fd(prog);
+
+	/* CPUs above CPUMAP_MAX_CPUS can't be used (nor left in cpu_map) */
+	if (max_cpus > CPUMAP_MAX_CPUS)
+		max_cpus = CPUMAP_MAX_CPUS;
+	selected = calloc(max_cpus, sizeof(*selected));
+	if (!selected)
+		return EXIT_FAIL;
+
+	/* New CPUs first, then the list the front stage reads, then drop the
+	 * old CPUs: frames are never steered to a CPU without a kthread.
+	 * cpu_map entries hold a reference to the program, so it stays
+	 * loaded after we exit.
+	 */
+	for (i = 0; i < n; i++) {
+		if (cpus[i] >= (__u32)max_cpus) {
+			fprintf(stderr, "ERR: cpu %u above cpu_map size %d\n", cpus[i], max_cpus);
+			return EXIT_FAIL_OPTION;
+		}
+		if (bpf_map_update_elem(cpu_map_fd, &cpus[i], &val, 0) < 0) {
+			fprintf(stderr, "ERR: adding cpu %u to cpu_map: %s\n",
+				cpus[i], strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+		selected[cpus[i]] = true;
+	}
+	for (key = 0; key < (__u32)n; key++) {
+		if (bpf_map_update_elem(avail_fd, &key, &cpus[key], 0) < 0) {
+			fprintf(stderr, "ERR: updating cpus_available: %s\n", strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+	}
+	if (bpf_map_update_elem(count_fd, &zero, &n, 0) < 0) {
+		fprintf(stderr, "ERR: updating cpus_count: %s\n", strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	/* xdp_qos_func redirects these itself, keep their kthreads */
+	for (key = 0; key < QOS_MAX_CLASSES; key++) {
+		if (bpf_map_lookup_elem(qos_fd, &key, &cls) == 0 &&
+		    (cls.flags & QOS_F_CPU) && cls.cpu < (__u32)max_cpus)
+			selected[cls.cpu] = true;
+	}
+	for (key = 0; key < (__u32)max_cpus; key++) {
+		if (!selected[key])
+			bpf_map_delete_elem(cpu_map_fd, &key);
+	}
+
+	if (!quiet) {
+		printf("%s: ", argv[optind]);
+		if (!n)
+			printf("forwarding on the receiving CPU\n");
+		for (i = 0; i < n; i++)
+			printf("%u%s", cpus[i], i == n - 1 ? "" : ",");
+		if (n)
+			printf(" (qsize %u)\n", val.qsize);
+	}
+
+	free(selected);
+	bpf_object__close(obj);
+	return EXIT_OK;
+}
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP LPM forwarding benchmark\n"
+	" - Runs xdp_router_func (bpf_fib_lookup) and xdp_lpm_router_func (LPM maps)\n"
+	"   with BPF_PROG_TEST_RUN on packets to random installed routes\n"
+	" - Expects <routes> /24 routes from 16.0.0.0 in the kernel table and\n"
+	"   mirrored by xdp_lpm_sync into the maps pinned under /sys/fs/bpf/<ifname>\n"
+	"   (bench_lpm.sh sets all of that up)\n"
+	" - UDP source ports are random, so multipath routes spread over their\n"
+	"   members; the share per next-hop MAC is printed (bench_ecmp.sh)\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+
+#include "./common/common_defines.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+#define ROUTE_BASE	0x10000000	/* 16.0.0.0, route i is ROUTE_BASE + (i << 8) / 24 */
+#define PKT_LEN		64
+/* Redirected frames carry the egress ifindex in data_meta (egress_meta_set),
+ * and the test run copies the metadata out in front of the packet
+ */
+#define META_MAX	sizeof(__u32)
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+static const char *progs[] = { "xdp_router_func", "xdp_lpm_router_func" };
+
+static void build_packet(unsigned char *pkt, __u32 daddr, __u16 sport)
+{
+	struct ethhdr *eth = (struct ethhdr *)pkt;
+	struct iphdr *iph = (struct iphdr *)(eth + 1);
+	struct udphdr *udph = (struct udphdr *)(iph + 1);
+
+	memset(pkt, 0, PKT_LEN);
+	eth->h_proto = htons(ETH_P_IP);
+	iph->version = 4;
+	iph->ihl = 5;
+	iph->tot_len = htons(PKT_LEN - sizeof(*eth));
+	iph->ttl = 64;
+	iph->protocol = IPPROTO_UDP;
+	iph->saddr = inet_addr("192.168.101.2");
+	iph->daddr = daddr;
+	udph->source = htons(sport);
+	udph->dest = htons(9);
+	udph->len = htons(PKT_LEN - sizeof(*eth) - sizeof(*iph));
+}
+
+/* Share the maps xdp_loader pinned, so the LPM program sees what xdp_lpm_sync wrote */
+static int reuse_pinned_maps(struct bpf_object *obj, const char *pin_dir)
+{
+	char path[PATH_MAX];
+	struct bpf_map *map;
+	int fd;
+
+	bpf_object__for_each_map(map, obj) {
+		snprintf(path, PATH_MAX, "%s/%s", pin_dir, bpf_map__name(map));
+		fd = bpf_obj_get(path);
+		if (fd < 0) {
+			fprintf(stderr, "ERR: opening %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+		if (bpf_map__reuse_fd(map, fd))
+			return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char pkt[PKT_LEN], out[META_MAX + PKT_LEN];
+	struct bpf_object *obj;
+	char pin_dir[PATH_MAX];
+	int prog_fd[2];
+	__u64 total_ns[2] = {}, miss[2] = {};
+	__u64 dmac_hits[256] = {};	/* by last byte of the output dmac */
+	__u32 routes, ifindex;
+	int i, p, iterations, members = 0;
+
+	if (argc < 3) {
+		printf("Usage: %s <ifname> <routes> [iterations]\n\n", argv[0]);
+		printf("DOCUMENTATION:\n %s\n", __doc__);
+		return EXIT_FAIL_OPTION;
+	}
+	ifindex = if_nametoindex(argv[1]);
+	routes = atoi(argv[2]);
+	iterations = argc > 3 ? atoi(argv[3]) : 100000;
+	if (!ifindex || !routes || iterations <= 0) {
+		fprintf(stderr, "ERR: invalid arguments\n");
+		return EXIT_FAIL_OPTION;
+	}
+
+	obj = bpf_object__open_file("xdp_prog_kern.o", NULL);
+	if (libbpf_get_error(obj)) {
+		fprintf(stderr, "ERR: opening xdp_prog_kern.o\n");
+		return EXIT_FAIL_BPF;
+	}
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[1]);
+	if (reuse_pinned_maps(obj, pin_dir) || bpf_object__load(obj)) {
+		fprintf(stderr, "ERR: loading xdp_prog_kern.o with maps from %s\n", pin_dir);
+		return EXIT_FAIL_BPF;
+	}
+	for (p = 0; p < 2; p++) {
+		struct bpf_program *prog = bpf_object__find_program_by_name(obj, progs[p]);
+
+		if (!prog) {
+			fprintf(stderr, "ERR: program %s not found\n", progs[p]);
+			return EXIT_FAIL_BPF;
+		}
+		prog_fd[p] = bpf_program__fd(prog);
+	}
+
+	/* repeat = 1 with a new random destination every run, so the
+	 * lookup walks a different path each time instead of a hot one
+	 */
+	for (i = 0; i < iterations; i++) {
+		__u32 route = (__u32)rand() % routes;
+
+		build_packet(pkt, htonl(ROUTE_BASE + (route << 8) + 1),
+			     1024 + (__u16)(rand() % 60000));
+
+		for (p = 0; p < 2; p++) {
+			struct xdp_md ctx = {
+				.data_end = sizeof(pkt),
+				.ingress_ifindex = ifindex,
+			};
+			LIBBPF_OPTS(bpf_test_run_opts, opts,
+				.data_in = pkt,
+				.data_size_in = sizeof(pkt),
+				.data_out = out,
+				.data_size_out = sizeof(out),
+				.ctx_in = &ctx,
+				.ctx_size_in = sizeof(ctx),
+				.repeat = 1,
+			);
+
+			if (bpf_prog_test_run_opts(prog_fd[p], &opts)) {
+				fprintf(stderr, "ERR: test run: %s\n", strerror(errno));
+				return EXIT_FAIL_BPF;
+			}
+			if (opts.retval != XDP_REDIRECT)
+				miss[p]++;
+			else if (p == 1)
+				dmac_hits[out[opts.data_size_out - PKT_LEN + ETH_ALEN - 1]]++;
+			total_ns[p] += opts.duration;
+		}
+	}
+
+	for (p = 0; p < 2; p++)
+		printf("routes %-8u %-20s %8.2f ns/pkt (%llu of %d not redirected)\n",
+		       routes, progs[p], (double)total_ns[p] / iterations,
+		       (unsigned long long)miss[p], iterations);
+
+	for (i = 0; i < 256; i++)
+		members += dmac_hits[i] != 0;
+	if (members > 1) {
+		for (i = 0; i < 256; i++) {
+			if (dmac_hits[i])
+				printf("  next hop ..:%02x %6.2f%%\n", i,
+				       100.0 * dmac_hits[i] / (iterations - miss[1]));
+		}
+	}
+
+	bpf_object__close(obj);
+	return EXIT_OK;
+}
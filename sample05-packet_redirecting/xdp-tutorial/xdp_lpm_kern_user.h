@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Used by xdp_lpm_router_func (kernel side) and by xdp_lpm_sync and
+ * xdp_lpm_bench (userspace), for sharing the LPM forwarding maps layout.
+ */
+#ifndef __XDP_LPM_KERN_USER_H
+#define __XDP_LPM_KERN_USER_H
+
+/* Sized for a full IPv4 table plus one /32 per known neighbour */
+#define LPM_MAX_ROUTES		(1 << 21)
+#define LPM_MAX_NEXTHOPS	4096
+
+/* Reserved next-hop ids, set up by xdp_lpm_sync on start */
+#define NH_ID_DROP		0	/* blackhole/unreachable/prohibit routes */
+#define NH_ID_KERNEL		1	/* connected prefix, neighbour not known */
+#define NH_ID_FIRST		2	/* first dynamically allocated id */
+
+/* lpm_routes value with this bit set is an nh_groups index (multipath) */
+#define NH_ID_GROUP		(1U << 31)
+#define ECMP_MAX_GROUPS		1024
+#define ECMP_BUCKETS		64	/* power of two, flow hash is masked */
+
+/* struct lpm_nexthop flags */
+#define NH_F_VALID		(1U << 0)	/* dmac resolved, can forward */
+#define NH_F_DROP		(1U << 1)
+
+/* Key of the lpm_routes map, prefixlen must come first */
+struct lpm_key {
+	__u32 prefixlen;
+	__u32 addr;		/* network byte order */
+};
+
+/* Value of the nexthops map */
+struct lpm_nexthop {
+	__u32 ifindex;
+	__u32 flags;
+	unsigned char smac[ETH_ALEN];
+	unsigned char dmac[ETH_ALEN];
+};
+
+/* Value of the nh_groups map: flow hash bucket -> next-hop id.
+ * Members are spread over the buckets by weight.
+ */
+struct lpm_nh_group {
+	__u32 buckets[ECMP_BUCKETS];
+};
+
+#endif /* __XDP_LPM_KERN_USER_H */
@@ -0,0 +1,778 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP LPM route sync\n"
+	" - Mirrors IPv4 main table routes and neighbours into the lpm_routes,\n"
+	"   nexthops and nh_groups maps that xdp_loader pinned under /sys/fs/bpf/<ifname>\n"
+	" - Dumps everything once, then follows rtnetlink events incrementally\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+#include "./common/common_defines.h"
+#include "./common/common_user_bpf_xdp.h"
+
+#include "xdp_lpm_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+#define MAX_INSTANCES	16
+#define NL_BUFSIZE	(64 * 1024)
+#define ROUTE_HASH_BITS	20
+
+/* Neighbour states with a usable link-layer address */
+#define NUD_USABLE (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT)
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+/* Each interface xdp_loader attached to has its own copy of the maps */
+struct lpm_maps {
+	int routes_fd;
+	int nexthops_fd;
+	int nh_groups_fd;
+	int tx_port_fd;
+};
+
+static struct lpm_maps maps[MAX_INSTANCES];
+static int nr_maps;
+
+/* Userspace view of the nexthops map: (addr, ifindex) -> id.
+ * refs counts the routes, neighbour /32s and groups using the entry;
+ * it is freed when the last one goes.
+ */
+struct nh_entry {
+	bool used;
+	__u32 refs;
+	__u32 gen;	/* sync_gen when the neighbour was last seen resolved */
+	__u32 addr;
+	__u32 ifindex;
+	struct lpm_nexthop val;
+};
+
+static struct nh_entry nh_table[LPM_MAX_NEXTHOPS];
+
+/* Userspace view of the nh_groups map. Identical groups are shared.
+ * A group holds one reference on each of its members.
+ */
+struct grp_entry {
+	bool used;
+	__u32 refs;
+	int n;
+	__u32 ids[ECMP_BUCKETS];
+	struct lpm_nh_group val;
+};
+
+static struct grp_entry grp_table[ECMP_MAX_GROUPS];
+
+/* Userspace view of lpm_routes. Each prefix remembers who installed it:
+ * a main table route (kept with enough of it to match a later delete)
+ * and, for /32s, a resolved neighbour. Both hold a reference on their
+ * next hop or group. gen_route is the sync_gen of the dump or event
+ * that last saw the route, so a resync can sweep what the dump missed.
+ */
+struct route_entry {
+	struct route_entry *next;
+	__u32 addr;
+	__u32 prefixlen;
+	bool has_route;
+	bool has_neigh;
+	bool in_map;
+	__u8 rt_type;
+	__u32 rt_prio;
+	__u32 rt_gw;
+	__u32 rt_oif;
+	__u32 gen_route;
+	__u32 route_nh;
+	__u32 neigh_nh;
+	__u32 installed;	/* lpm_routes value, if in_map */
+};
+
+static struct route_entry *route_hash[1 << ROUTE_HASH_BITS];
+static __u32 sync_gen;
+static bool quiet;
+
+static void nh_write(__u32 id)
+{
+	struct lpm_nexthop *val = &nh_table[id].val;
+	int i;
+
+	for (i = 0; i < nr_maps; i++) {
+		if (bpf_map_update_elem(maps[i].nexthops_fd, &id, val, 0) < 0)
+			fprintf(stderr, "WARN: updating nexthop %u: %s\n",
+				id, strerror(errno));
+
+		/* Make sure the egress port can be redirected to; an entry
+		 * xdp_port_vlan set up (parent device, egress program) is kept
+		 */
+		if (val->ifindex) {
+			struct bpf_devmap_val port = { .ifindex = val->ifindex };
+
+			bpf_map_update_elem(maps[i].tx_port_fd, &val->ifindex,
+					    &port, BPF_NOEXIST);
+		}
+	}
+}
+
+static int get_ifhwaddr(__u32 ifindex, unsigned char *mac)
+{
+	struct ifreq ifr = {};
+	int fd, err;
+
+	if (!if_indextoname(ifindex, ifr.ifr_name))
+		return -1;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	err = ioctl(fd, SIOCGIFHWADDR, &ifr);
+	close(fd);
+	if (err < 0)
+		return -1;
+
+	memcpy(mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	return 0;
+}
+
+/* Find or allocate the next hop for a gateway/neighbour on ifindex,
+ * and take a reference on it. An unresolved entry punts to the kernel.
+ */
+static int nh_get(__u32 addr, __u32 ifindex)
+{
+	int id, free_id = -1;
+
+	for (id = NH_ID_FIRST; id < LPM_MAX_NEXTHOPS; id++) {
+		if (!nh_table[id].used) {
+			if (free_id < 0)
+				free_id = id;
+			continue;
+		}
+		if (nh_table[id].addr == addr && nh_table[id].ifindex == ifindex) {
+			nh_table[id].refs++;
+			return id;
+		}
+	}
+
+	if (free_id < 0) {
+		fprintf(stderr, "WARN: nexthops map full\n");
+		return -1;
+	}
+
+	id = free_id;
+	memset(&nh_table[id], 0, sizeof(nh_table[id]));
+	nh_table[id].used = true;
+	nh_table[id].refs = 1;
+	nh_table[id].addr = addr;
+	nh_table[id].ifindex = ifindex;
+	nh_table[id].val.ifindex = ifindex;
+	if (get_ifhwaddr(ifindex, nh_table[id].val.smac) < 0)
+		fprintf(stderr, "WARN: no MAC address for ifindex %u\n", ifindex);
+	nh_write(id);
+	return id;
+}
+
+/* Drop a reference on a next hop or group (reserved ids aren't counted).
+ * A freed next hop is written back cleared, so the slot punts until reused.
+ */
+static void nh_put(__u32 id)
+{
+	struct grp_entry *g;
+	int i;
+
+	if (id & NH_ID_GROUP) {
+		g = &grp_table[id & ~NH_ID_GROUP];
+		if (!g->used || --g->refs)
+			return;
+		g->used = false;
+		for (i = 0; i < g->n; i++)
+			nh_put(g->ids[i]);
+		return;
+	}
+
+	if (id < NH_ID_FIRST || !nh_table[id].used || --nh_table[id].refs)
+		return;
+	memset(&nh_table[id], 0, sizeof(nh_table[id]));
+	nh_write(id);
+}
+
+static void parse_rtattr(struct rtattr **tb, int max, struct rtattr *rta, int len)
+{
+	memset(tb, 0, sizeof(*tb) * (max + 1));
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type <= max)
+			tb[rta->rta_type] = rta;
+	}
+}
+
+/* Spread members over the buckets in proportion to their weights,
+ * interleaved (smooth weighted round-robin) rather than in runs.
+ */
+static void fill_buckets(const __u32 *ids, const int *weights, int n,
+			 struct lpm_nh_group *grp)
+{
+	int current[ECMP_BUCKETS] = {};
+	int total = 0, i, b, best;
+
+	for (i = 0; i < n; i++)
+		total += weights[i];
+
+	for (b = 0; b < ECMP_BUCKETS; b++) {
+		best = 0;
+		for (i = 0; i < n; i++) {
+			current[i] += weights[i];
+			if (current[i] > current[best])
+				best = i;
+		}
+		current[best] -= total;
+		grp->buckets[b] = ids[best];
+	}
+}
+
+/* Find or allocate the nh_groups entry for a multipath route and take
+ * a reference on it. The member references the caller passes in move to
+ * a new group, or are dropped when an identical group already exists.
+ */
+static int group_get(const __u32 *ids, const int *weights, int n, __u32 *nh_id)
+{
+	struct lpm_nh_group grp;
+	int gid, free_id = -1, i;
+
+	fill_buckets(ids, weights, n, &grp);
+
+	for (gid = 0; gid < ECMP_MAX_GROUPS; gid++) {
+		if (!grp_table[gid].used) {
+			if (free_id < 0)
+				free_id = gid;
+			continue;
+		}
+		if (!memcmp(&grp_table[gid].val, &grp, sizeof(grp))) {
+			grp_table[gid].refs++;
+			for (i = 0; i < n; i++)
+				nh_put(ids[i]);
+			*nh_id = NH_ID_GROUP | gid;
+			return 0;
+		}
+	}
+
+	if (free_id < 0) {
+		fprintf(stderr, "WARN: nh_groups map full\n");
+		for (i = 0; i < n; i++)
+			nh_put(ids[i]);
+		return -1;
+	}
+
+	gid = free_id;
+	grp_table[gid].used = true;
+	grp_table[gid].refs = 1;
+	grp_table[gid].n = n;
+	memcpy(grp_table[gid].ids, ids, n * sizeof(ids[0]));
+	grp_table[gid].val = grp;
+	for (i = 0; i < nr_maps; i++) {
+		if (bpf_map_update_elem(maps[i].nh_groups_fd, &gid, &grp, 0) < 0)
+			fprintf(stderr, "WARN: updating nh group %d: %s\n",
+				gid, strerror(errno));
+	}
+	*nh_id = NH_ID_GROUP | gid;
+	return 0;
+}
+
+/* RTA_MULTIPATH -> ECMP group (or a plain next hop if only one is usable),
+ * with a reference taken on it
+ */
+static int multipath_get(struct rtattr *mp, __u32 *nh_id)
+{
+	struct rtnexthop *rtnh = RTA_DATA(mp);
+	int len = RTA_PAYLOAD(mp);
+	struct rtattr *tb[RTA_MAX + 1];
+	int weights[ECMP_BUCKETS];
+	__u32 ids[ECMP_BUCKETS];
+	int n = 0, id;
+
+	for (; RTNH_OK(rtnh, len) && n < ECMP_BUCKETS;
+	     len -= NLMSG_ALIGN(rtnh->rtnh_len), rtnh = RTNH_NEXT(rtnh)) {
+		__u32 gw = 0;
+
+		parse_rtattr(tb, RTA_MAX, RTNH_DATA(rtnh), rtnh->rtnh_len - sizeof(*rtnh));
+		if (tb[RTA_GATEWAY])
+			gw = *(__u32 *)RTA_DATA(tb[RTA_GATEWAY]);
+
+		id = gw ? nh_get(gw, rtnh->rtnh_ifindex) : NH_ID_KERNEL;
+		if (id < 0)
+			continue;
+		ids[n] = id;
+		weights[n] = rtnh->rtnh_hops + 1;
+		n++;
+	}
+
+	if (n == 0)
+		return -1;
+	if (n == 1) {
+		*nh_id = ids[0];
+		return 0;
+	}
+	return group_get(ids, weights, n, nh_id);
+}
+
+static void route_update(__u32 addr, __u32 prefixlen, __u32 nh_id, bool add)
+{
+	struct lpm_key key = { .prefixlen = prefixlen, .addr = addr };
+	int i;
+
+	for (i = 0; i < nr_maps; i++) {
+		if (add) {
+			if (bpf_map_update_elem(maps[i].routes_fd, &key, &nh_id, 0) < 0)
+				fprintf(stderr, "WARN: adding route: %s\n", strerror(errno));
+		} else {
+			/* ENOENT is fine: e.g. a route we skipped on add */
+			bpf_map_delete_elem(maps[i].routes_fd, &key);
+		}
+	}
+}
+
+static struct route_entry **route_slot(__u32 addr, __u32 prefixlen)
+{
+	__u32 h = (addr * 0x9e3779b1U) ^ prefixlen;
+	struct route_entry **pe;
+
+	pe = &route_hash[h >> (32 - ROUTE_HASH_BITS)];
+	while (*pe && ((*pe)->addr != addr || (*pe)->prefixlen != prefixlen))
+		pe = &(*pe)->next;
+	return pe;
+}
+
+static struct route_entry *route_get(__u32 addr, __u32 prefixlen)
+{
+	struct route_entry **pe = route_slot(addr, prefixlen);
+
+	if (!*pe) {
+		*pe = calloc(1, sizeof(**pe));
+		if (!*pe) {
+			fprintf(stderr, "WARN: out of memory for routes\n");
+			return NULL;
+		}
+		(*pe)->addr = addr;
+		(*pe)->prefixlen = prefixlen;
+	}
+	return *pe;
+}
+
+/* Write the entry's current value to lpm_routes, or remove it (and the
+ * entry) once nothing installs it. A neighbour /32 wins over an on-link
+ * route to the same address, which would only punt to the kernel, but
+ * not over a gateway or blackhole route.
+ */
+static void route_commit(struct route_entry *e)
+{
+	struct route_entry **pe;
+	__u32 val;
+
+	if (!e->has_route && !e->has_neigh) {
+		if (e->in_map)
+			route_update(e->addr, e->prefixlen, 0, false);
+		pe = route_slot(e->addr, e->prefixlen);
+		*pe = e->next;
+		free(e);
+		return;
+	}
+
+	if (e->has_neigh && (!e->has_route || e->route_nh == NH_ID_KERNEL))
+		val = e->neigh_nh;
+	else
+		val = e->route_nh;
+	if (!e->in_map || e->installed != val) {
+		route_update(e->addr, e->prefixlen, val, true);
+		e->installed = val;
+		e->in_map = true;
+	}
+}
+
+static void route_del(struct route_entry *e)
+{
+	__u32 old = e->route_nh;
+
+	e->has_route = false;
+	route_commit(e);
+	nh_put(old);
+}
+
+static void neigh_del(struct route_entry *e)
+{
+	__u32 old = e->neigh_nh;
+
+	e->has_neigh = false;
+	route_commit(e);
+	nh_put(old);
+}
+
+/* The map holds one route per prefix: with several main table routes to
+ * the same prefix (different metrics), the lowest metric seen is kept.
+ * A delete only removes the entry if it is for that same route. TOS
+ * routes are ignored, the XDP lookup can't match on TOS.
+ */
+static void handle_route(struct nlmsghdr *nlh)
+{
+	struct rtmsg *rtm = NLMSG_DATA(nlh);
+	struct rtattr *tb[RTA_MAX + 1];
+	__u32 table, dst = 0, gw = 0, oif = 0, prio = 0;
+	bool add = nlh->nlmsg_type == RTM_NEWROUTE;
+	struct route_entry *e;
+	__u32 nh_id, old;
+	int id;
+
+	if (rtm->rtm_family != AF_INET || rtm->rtm_tos)
+		return;
+
+	parse_rtattr(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(nlh));
+
+	table = tb[RTA_TABLE] ? *(__u32 *)RTA_DATA(tb[RTA_TABLE]) : rtm->rtm_table;
+	if (table != RT_TABLE_MAIN)
+		return;
+
+	if (tb[RTA_DST])
+		dst = *(__u32 *)RTA_DATA(tb[RTA_DST]);
+	if (tb[RTA_GATEWAY])
+		gw = *(__u32 *)RTA_DATA(tb[RTA_GATEWAY]);
+	if (tb[RTA_OIF])
+		oif = *(__u32 *)RTA_DATA(tb[RTA_OIF]);
+	if (tb[RTA_PRIORITY])
+		prio = *(__u32 *)RTA_DATA(tb[RTA_PRIORITY]);
+
+	if (!add) {
+		e = *route_slot(dst, rtm->rtm_dst_len);
+		if (e && e->has_route && e->rt_type == rtm->rtm_type &&
+		    e->rt_prio == prio && e->rt_gw == gw && e->rt_oif == oif)
+			route_del(e);
+		return;
+	}
+
+	switch (rtm->rtm_type) {
+	case RTN_UNICAST:
+	case RTN_BLACKHOLE:
+	case RTN_UNREACHABLE:
+	case RTN_PROHIBIT:
+		break;
+	default:
+		return;
+	}
+
+	e = *route_slot(dst, rtm->rtm_dst_len);
+	if (e && e->has_route && e->gen_route == sync_gen && e->rt_prio < prio)
+		return;
+
+	if (rtm->rtm_type != RTN_UNICAST) {
+		nh_id = NH_ID_DROP;
+	} else if (tb[RTA_MULTIPATH]) {
+		if (multipath_get(tb[RTA_MULTIPATH], &nh_id))
+			return;
+	} else if (oif) {
+		id = gw ? nh_get(gw, oif) : NH_ID_KERNEL;
+		if (id < 0)
+			return;
+		nh_id = id;
+	} else {
+		return;
+	}
+
+	e = route_get(dst, rtm->rtm_dst_len);
+	if (!e) {
+		nh_put(nh_id);
+		return;
+	}
+	old = e->has_route ? e->route_nh : NH_ID_DROP;
+	e->has_route = true;
+	e->rt_type = rtm->rtm_type;
+	e->rt_prio = prio;
+	e->rt_gw = gw;
+	e->rt_oif = oif;
+	e->gen_route = sync_gen;
+	e->route_nh = nh_id;
+	route_commit(e);
+	nh_put(old);
+}
+
+/* A resolved neighbour validates its next hop (used by gateway routes)
+ * and gets a /32 so on-link hosts don't fall back to NH_ID_KERNEL.
+ * When it goes, only that /32 is removed; a main table route to the
+ * same address stays or is put back.
+ */
+static void handle_neigh(struct nlmsghdr *nlh)
+{
+	struct ndmsg *ndm = NLMSG_DATA(nlh);
+	struct rtattr *tb[NDA_MAX + 1];
+	struct route_entry *e;
+	struct nh_entry *nh;
+	__u32 addr, old;
+	bool had;
+	int id;
+
+	if (ndm->ndm_family != AF_INET)
+		return;
+
+	parse_rtattr(tb, NDA_MAX, RTM_RTA(ndm), RTM_PAYLOAD(nlh));
+	if (!tb[NDA_DST])
+		return;
+	addr = *(__u32 *)RTA_DATA(tb[NDA_DST]);
+
+	if (nlh->nlmsg_type == RTM_NEWNEIGH && (ndm->ndm_state & NUD_USABLE) &&
+	    tb[NDA_LLADDR] && RTA_PAYLOAD(tb[NDA_LLADDR]) == ETH_ALEN) {
+		id = nh_get(addr, ndm->ndm_ifindex);
+		if (id < 0)
+			return;
+		nh = &nh_table[id];
+		memcpy(nh->val.dmac, RTA_DATA(tb[NDA_LLADDR]), ETH_ALEN);
+		nh->val.flags |= NH_F_VALID;
+		nh->gen = sync_gen;
+		nh_write(id);
+
+		e = route_get(addr, 32);
+		if (!e) {
+			nh_put(id);
+			return;
+		}
+		had = e->has_neigh;
+		old = e->neigh_nh;
+		e->has_neigh = true;
+		e->neigh_nh = id;
+		route_commit(e);
+		if (had)
+			nh_put(old);
+		return;
+	}
+
+	/* Gone or unreachable: punt to the kernel until it resolves again */
+	for (id = NH_ID_FIRST; id < LPM_MAX_NEXTHOPS; id++) {
+		nh = &nh_table[id];
+		if (!nh->used || nh->addr != addr || nh->ifindex != ndm->ndm_ifindex)
+			continue;
+		if (nh->val.flags & NH_F_VALID) {
+			nh->val.flags &= ~NH_F_VALID;
+			nh_write(id);
+		}
+		e = *route_slot(addr, 32);
+		if (e && e->has_neigh && e->neigh_nh == (__u32)id)
+			neigh_del(e);
+		break;
+	}
+}
+
+/* Returns 1 when NLMSG_DONE was seen (end of a dump) */
+static int handle_msgs(char *buf, int len)
+{
+	struct nlmsghdr *nlh;
+
+	for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+		switch (nlh->nlmsg_type) {
+		case NLMSG_DONE:
+			return 1;
+		case NLMSG_ERROR:
+			fprintf(stderr, "ERR: netlink error in dump\n");
+			return -1;
+		case RTM_NEWROUTE:
+		case RTM_DELROUTE:
+			handle_route(nlh);
+			break;
+		case RTM_NEWNEIGH:
+		case RTM_DELNEIGH:
+			handle_neigh(nlh);
+			break;
+		}
+	}
+	return 0;
+}
+
+static int dump(int fd, int type)
+{
+	static char buf[NL_BUFSIZE];
+	struct {
+		struct nlmsghdr nlh;
+		struct rtmsg rtm;
+	} req = {
+		.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg)),
+		.nlh.nlmsg_type = type,
+		.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+		.rtm.rtm_family = AF_INET,
+	};
+	int len, ret;
+
+	/* struct ndmsg starts with the family too, so one request fits both */
+	if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+		fprintf(stderr, "ERR: netlink send: %s\n", strerror(errno));
+		return -1;
+	}
+
+	do {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			fprintf(stderr, "ERR: netlink recv: %s\n", strerror(errno));
+			return -1;
+		}
+		ret = handle_msgs(buf, len);
+	} while (ret == 0);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/* After a resync dump: drop routes the dump didn't report and neighbours
+ * it didn't report resolved, i.e. whatever changed while events were lost
+ */
+static void sweep(void)
+{
+	struct route_entry *e, *next;
+	struct nh_entry *nh;
+	__u32 id;
+	int b;
+
+	for (id = NH_ID_FIRST; id < LPM_MAX_NEXTHOPS; id++) {
+		nh = &nh_table[id];
+		if (nh->used && (nh->val.flags & NH_F_VALID) && nh->gen != sync_gen) {
+			nh->val.flags &= ~NH_F_VALID;
+			nh_write(id);
+		}
+	}
+
+	for (b = 0; b < (1 << ROUTE_HASH_BITS); b++) {
+		for (e = route_hash[b]; e; e = next) {
+			bool stale_route = e->has_route && e->gen_route != sync_gen;
+
+			next = e->next;
+			/* neigh_del only frees e if it has no route left */
+			if (e->has_neigh && !(nh_table[e->neigh_nh].val.flags & NH_F_VALID))
+				neigh_del(e);
+			if (stale_route)
+				route_del(e);
+		}
+	}
+}
+
+static int sync_all(void)
+{
+	int fd, err;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0) {
+		fprintf(stderr, "ERR: netlink socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* Neighbours first, so gateway routes find their next hop resolved */
+	sync_gen++;
+	err = dump(fd, RTM_GETNEIGH);
+	if (!err)
+		err = dump(fd, RTM_GETROUTE);
+	close(fd);
+	if (!err)
+		sweep();
+	return err;
+}
+
+static int open_maps(const char *ifname, struct lpm_maps *m)
+{
+	char pin_dir[PATH_MAX];
+
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, ifname);
+	m->routes_fd = open_bpf_map_file(pin_dir, "lpm_routes", NULL);
+	m->nexthops_fd = open_bpf_map_file(pin_dir, "nexthops", NULL);
+	m->nh_groups_fd = open_bpf_map_file(pin_dir, "nh_groups", NULL);
+	m->tx_port_fd = open_bpf_map_file(pin_dir, "tx_port", NULL);
+	if (m->routes_fd < 0 || m->nexthops_fd < 0 || m->nh_groups_fd < 0 ||
+	    m->tx_port_fd < 0)
+		return -1;
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [--oneshot] [-q] <ifname>...\n\n", prog);
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+int main(int argc, char **argv)
+{
+	static char buf[NL_BUFSIZE];
+	struct sockaddr_nl sa = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_NEIGH,
+	};
+	bool oneshot = false;
+	int rcvbuf = 16 * 1024 * 1024;
+	int i, fd, len;
+	__u32 id;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--oneshot")) {
+			oneshot = true;
+		} else if (!strcmp(argv[i], "-q")) {
+			quiet = true;
+		} else if (argv[i][0] == '-') {
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		} else if (nr_maps == MAX_INSTANCES) {
+			fprintf(stderr, "ERR: too many interfaces (max %d)\n", MAX_INSTANCES);
+			return EXIT_FAIL_OPTION;
+		} else if (open_maps(argv[i], &maps[nr_maps++]) < 0) {
+			return EXIT_FAIL_BPF;
+		}
+	}
+	if (!nr_maps) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	/* Reserved next hops */
+	nh_table[NH_ID_DROP].val.flags = NH_F_DROP;
+	nh_write(NH_ID_DROP);
+	nh_write(NH_ID_KERNEL);
+
+	/* Subscribe before dumping so no change falls in between */
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		fprintf(stderr, "ERR: netlink subscribe: %s\n", strerror(errno));
+		return EXIT_FAIL;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	if (sync_all() < 0)
+		return EXIT_FAIL;
+
+	if (!quiet) {
+		for (i = 0, id = NH_ID_FIRST; id < LPM_MAX_NEXTHOPS; id++)
+			i += nh_table[id].used;
+		printf("Initial sync done: %d next hops\n", i);
+	}
+	if (oneshot)
+		return EXIT_OK;
+
+	for (;;) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				/* Lost events: start over from a full dump */
+				fprintf(stderr, "WARN: netlink overrun, resyncing\n");
+				if (sync_all() < 0)
+					return EXIT_FAIL;
+				continue;
+			}
+			fprintf(stderr, "ERR: netlink recv: %s\n", strerror(errno));
+			return EXIT_FAIL;
+		}
+		handle_msgs(buf, len);
+	}
+
+	return EXIT_OK;
+}
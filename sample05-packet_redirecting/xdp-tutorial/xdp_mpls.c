@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP MPLS label switching table\n"
+	" - Sets what xdp_mpls_func on <ifname> does with an incoming label:\n"
+	"   swap it, swap it and push one more, or pop it, then send the frame\n"
+	"   out of <port> to the next hop MAC\n"
+	" - Adds <port> to tx_port when it isn't there yet\n"
+	" - Uses the maps xdp_loader pinned under /sys/fs/bpf/<ifname>\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <bpf/bpf.h>
+
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/mpls.h>
+
+#include "./common/common_defines.h"
+#include "./common/common_user_bpf_xdp.h"
+
+#include "xdp_mpls_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s <ifname> <label> swap <out> dev <port> via <mac> [smac <mac>]\n", prog);
+	printf("       %s <ifname> <label> push <top>/<out> dev <port> via <mac> [smac <mac>]\n", prog);
+	printf("       %s <ifname> <label> pop dev <port> via <mac> [smac <mac>]\n", prog);
+	printf("       %s <ifname> <label> del\n", prog);
+	printf("       %s <ifname> show\n\n", prog);
+	printf("  smac defaults to the address of <port>\n\n");
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+static int parse_mac(const char *str, unsigned char mac[ETH_ALEN])
+{
+	char end;
+
+	if (sscanf(str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx%c", &mac[0], &mac[1],
+		   &mac[2], &mac[3], &mac[4], &mac[5], &end) != 6)
+		return -1;
+	return 0;
+}
+
+/* Labels 0-15 are reserved; outgoing ones may still be the explicit
+ * nulls (0, 2), but implicit null (3) is spelled "pop"
+ */
+static int parse_label(const char *str, __u32 *label, int incoming)
+{
+	char *end;
+	long val;
+
+	val = strtol(str, &end, 10);
+	if (end == str || (*end && *end != '/') || val < 0 || val > MPLS_LABEL_MAX)
+		return -1;
+	if (incoming ? val < MPLS_LABEL_FIRST_UNRESERVED : val == MPLS_LABEL_IMPLNULL)
+		return -1;
+	*label = val;
+	return 0;
+}
+
+static int port_mac(const char *port, unsigned char mac[ETH_ALEN])
+{
+	char path[PATH_MAX], buf[32];
+	FILE *f;
+	int err;
+
+	snprintf(path, PATH_MAX, "/sys/class/net/%s/address", port);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	err = fgets(buf, sizeof(buf), f) ? 0 : -1;
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	return err ? err : parse_mac(buf, mac);
+}
+
+static const char *op_name(__u32 op)
+{
+	switch (op) {
+	case MPLS_OP_SWAP:	return "swap";
+	case MPLS_OP_PUSH:	return "push";
+	case MPLS_OP_POP:	return "pop";
+	default:		return "?";
+	}
+}
+
+static int show(int ilm_fd)
+{
+	__u32 key, *prev = NULL;
+	char ifname[IF_NAMESIZE];
+	struct mpls_ilm ilm;
+	char out[32];
+	__u32 next;
+
+	while (bpf_map_get_next_key(ilm_fd, prev, &next) == 0) {
+		key = next;
+		prev = &key;
+		if (bpf_map_lookup_elem(ilm_fd, &key, &ilm))
+			continue;
+		if (!if_indextoname(ilm.ifindex, ifname))
+			snprintf(ifname, sizeof(ifname), "#%u", ilm.ifindex);
+		if (ilm.op == MPLS_OP_SWAP)
+			snprintf(out, sizeof(out), "%u", ilm.out_label[0]);
+		else if (ilm.op == MPLS_OP_PUSH)
+			snprintf(out, sizeof(out), "%u/%u", ilm.out_label[0], ilm.out_label[1]);
+		else
+			out[0] = '\0';
+		printf("%-7u %-4s %-15s dev %-16s via %02x:%02x:%02x:%02x:%02x:%02x\n",
+		       key, op_name(ilm.op), out, ifname,
+		       ilm.dmac[0], ilm.dmac[1], ilm.dmac[2],
+		       ilm.dmac[3], ilm.dmac[4], ilm.dmac[5]);
+	}
+	return EXIT_OK;
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_devmap_val dev = {};
+	struct mpls_ilm ilm = {};
+	char pin_dir[PATH_MAX];
+	int ilm_fd, tx_fd, arg;
+	const char *port;
+	int have_smac = 0;
+	__u32 label;
+	char *slash;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[1]);
+	ilm_fd = open_bpf_map_file(pin_dir, "mpls_ilm", NULL);
+	tx_fd = open_bpf_map_file(pin_dir, "tx_port", NULL);
+	if (ilm_fd < 0 || tx_fd < 0)
+		return EXIT_FAIL_BPF;
+
+	if (argc == 3 && !strcmp(argv[2], "show"))
+		return show(ilm_fd);
+
+	if (argc < 4 || parse_label(argv[2], &label, 1) < 0 || strchr(argv[2], '/')) {
+		fprintf(stderr, "ERR: invalid incoming label %s\n", argv[2]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	if (argc == 4 && !strcmp(argv[3], "del")) {
+		if (bpf_map_delete_elem(ilm_fd, &label) < 0 && errno != ENOENT) {
+			fprintf(stderr, "ERR: deleting label %u: %s\n", label, strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+		return EXIT_OK;
+	}
+
+	arg = 3;
+	if (!strcmp(argv[arg], "swap") && arg + 1 < argc) {
+		ilm.op = MPLS_OP_SWAP;
+		if (parse_label(argv[arg + 1], &ilm.out_label[0], 0) < 0 ||
+		    strchr(argv[arg + 1], '/'))
+			goto bad_label;
+		arg += 2;
+	} else if (!strcmp(argv[arg], "push") && arg + 1 < argc) {
+		ilm.op = MPLS_OP_PUSH;
+		slash = strchr(argv[arg + 1], '/');
+		if (!slash || parse_label(argv[arg + 1], &ilm.out_label[0], 0) < 0 ||
+		    parse_label(slash + 1, &ilm.out_label[1], 0) < 0 || strchr(slash + 1, '/'))
+			goto bad_label;
+		arg += 2;
+	} else if (!strcmp(argv[arg], "pop")) {
+		ilm.op = MPLS_OP_POP;
+		arg++;
+	} else {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	if (arg + 4 > argc || strcmp(argv[arg], "dev") || strcmp(argv[arg + 2], "via")) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+	port = argv[arg + 1];
+	ilm.ifindex = if_nametoindex(port);
+	if (!ilm.ifindex) {
+		fprintf(stderr, "ERR: unknown interface %s\n", port);
+		return EXIT_FAIL_OPTION;
+	}
+	if (parse_mac(argv[arg + 3], ilm.dmac) < 0) {
+		fprintf(stderr, "ERR: invalid MAC address %s\n", argv[arg + 3]);
+		return EXIT_FAIL_OPTION;
+	}
+	arg += 4;
+
+	if (arg + 2 == argc && !strcmp(argv[arg], "smac")) {
+		if (parse_mac(argv[arg + 1], ilm.smac) < 0) {
+			fprintf(stderr, "ERR: invalid MAC address %s\n", argv[arg + 1]);
+			return EXIT_FAIL_OPTION;
+		}
+		have_smac = 1;
+		arg += 2;
+	}
+	if (arg != argc) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+	if (!have_smac && port_mac(port, ilm.smac) < 0) {
+		fprintf(stderr, "ERR: can't read the MAC address of %s, use smac\n", port);
+		return EXIT_FAIL_OPTION;
+	}
+
+	/* Port first, so the label never redirects to a missing entry. An
+	 * existing one is kept: it may carry a devmap program (xdp_port_vlan)
+	 */
+	dev.ifindex = ilm.ifindex;
+	if (bpf_map_update_elem(tx_fd, &ilm.ifindex, &dev, BPF_NOEXIST) < 0 &&
+	    errno != EEXIST) {
+		fprintf(stderr, "ERR: adding %s to tx_port: %s\n", port, strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	if (bpf_map_update_elem(ilm_fd, &label, &ilm, 0) < 0) {
+		fprintf(stderr, "ERR: updating label %u: %s\n", label, strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	return EXIT_OK;
+
+bad_label:
+	fprintf(stderr, "ERR: invalid outgoing label %s\n", argv[arg + 1]);
+	return EXIT_FAIL_OPTION;
+}
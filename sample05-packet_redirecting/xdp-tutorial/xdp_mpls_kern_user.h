@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Used by xdp_mpls_func (kernel side) and by xdp_mpls (userspace),
+ * for sharing the label table (ILM) layout.
+ */
+#ifndef __XDP_MPLS_KERN_USER_H
+#define __XDP_MPLS_KERN_USER_H
+
+#define MPLS_ILM_MAX		65536
+#define MPLS_LABEL_MAX		0xfffff		/* 20 bits */
+
+/* What xdp_mpls_func does with the incoming top label. Labels are listed
+ * top first, as in "ip -f mpls route add <in> as <top>/<next> ...".
+ */
+#define MPLS_OP_SWAP		1	/* replace it with out_label[0] */
+#define MPLS_OP_PUSH		2	/* replace it with out_label[1], push out_label[0] */
+#define MPLS_OP_POP		3	/* remove it; at the bottom of the stack, forward the IP payload */
+
+/* Value of the mpls_ilm map, keyed by the incoming label (__u32) */
+struct mpls_ilm {
+	__u32 op;		/* MPLS_OP_* */
+	__u32 out_label[2];
+	__u32 ifindex;		/* egress port, must be in tx_port */
+	unsigned char smac[6];
+	unsigned char dmac[6];
+};
+
+#endif /* __XDP_MPLS_KERN_USER_H */
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP router neighbour warm-up\n"
+	" - Follows rtnetlink neighbour events and removes next hops from the\n"
+	"   neigh_pending map under /sys/fs/bpf/<ifname> once ARP/ND settles,\n"
+	"   so xdp_router_func stops rate-limiting them right away\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+#include "./common/common_defines.h"
+#include "./common/common_user_bpf_xdp.h"
+
+#include "xdp_router_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+#define MAX_INSTANCES	16
+#define NL_BUFSIZE	(64 * 1024)
+
+/* Neighbour states with a usable link-layer address */
+#define NUD_USABLE (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT)
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+/* Each interface xdp_loader attached to has its own neigh_pending */
+static int pending_fds[MAX_INSTANCES];
+static int nr_maps;
+static bool quiet;
+
+/* After lost events we don't know what resolved: start from empty,
+ * which costs at most one extra frame per pending next hop
+ */
+static void flush_all(void)
+{
+	struct neigh_key key;
+	int i;
+
+	for (i = 0; i < nr_maps; i++) {
+		while (bpf_map_get_next_key(pending_fds[i], NULL, &key) == 0)
+			bpf_map_delete_elem(pending_fds[i], &key);
+	}
+}
+
+static void handle_neigh(struct nlmsghdr *nlh)
+{
+	struct ndmsg *ndm = NLMSG_DATA(nlh);
+	struct neigh_key key = {};
+	struct rtattr *rta;
+	char addr[INET6_ADDRSTRLEN];
+	int len, i, deleted = 0;
+
+	if (ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6)
+		return;
+
+	/* Still resolving: the rate limit is doing its job */
+	if (nlh->nlmsg_type == RTM_NEWNEIGH && (ndm->ndm_state & NUD_INCOMPLETE))
+		return;
+
+	len = RTM_PAYLOAD(nlh);
+	for (rta = RTM_RTA(ndm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == NDA_DST)
+			break;
+	}
+	if (!RTA_OK(rta, len) || RTA_PAYLOAD(rta) > sizeof(key.addr))
+		return;
+
+	key.ifindex = ndm->ndm_ifindex;
+	key.family = ndm->ndm_family;
+	memcpy(key.addr, RTA_DATA(rta), RTA_PAYLOAD(rta));
+
+	for (i = 0; i < nr_maps; i++)
+		deleted += bpf_map_delete_elem(pending_fds[i], &key) == 0;
+
+	if (!quiet && deleted) {
+		inet_ntop(key.family, key.addr, addr, sizeof(addr));
+		printf("%s (ifindex %u) %s\n", addr, key.ifindex,
+		       nlh->nlmsg_type == RTM_DELNEIGH ? "deleted" :
+		       ndm->ndm_state & NUD_USABLE ? "resolved" : "failed");
+	}
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-q] <ifname>...\n\n", prog);
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+int main(int argc, char **argv)
+{
+	static char buf[NL_BUFSIZE];
+	struct sockaddr_nl sa = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = RTMGRP_NEIGH,
+	};
+	int rcvbuf = 4 * 1024 * 1024;
+	char pin_dir[PATH_MAX];
+	struct nlmsghdr *nlh;
+	int i, fd, len;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-q")) {
+			quiet = true;
+		} else if (argv[i][0] == '-') {
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		} else if (nr_maps == MAX_INSTANCES) {
+			fprintf(stderr, "ERR: too many interfaces (max %d)\n", MAX_INSTANCES);
+			return EXIT_FAIL_OPTION;
+		} else {
+			snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[i]);
+			pending_fds[nr_maps] = open_bpf_map_file(pin_dir, "neigh_pending", NULL);
+			if (pending_fds[nr_maps++] < 0)
+				return EXIT_FAIL_BPF;
+		}
+	}
+	if (!nr_maps) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		fprintf(stderr, "ERR: netlink subscribe: %s\n", strerror(errno));
+		return EXIT_FAIL;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	for (;;) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				fprintf(stderr, "WARN: netlink overrun, flushing neigh_pending\n");
+				flush_all();
+				continue;
+			}
+			fprintf(stderr, "ERR: netlink recv: %s\n", strerror(errno));
+			return EXIT_FAIL;
+		}
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == RTM_NEWNEIGH || nlh->nlmsg_type == RTM_DELNEIGH)
+				handle_neigh(nlh);
+		}
+	}
+
+	return EXIT_OK;
+}
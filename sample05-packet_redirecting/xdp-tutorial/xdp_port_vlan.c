@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP router egress VLAN ports\n"
+	" - Configures how xdp_router_func sends frames out of <port>: tagged\n"
+	"   with a VLAN id or untagged, optionally with a fixed source MAC\n"
+	" - <port> may be a VLAN subinterface (e.g. eth0.100): its tx_port entry\n"
+	"   then points at the parent device, for router-on-a-stick\n"
+	" - Installs xdp_egress_vlan_func as the devmap program of the entry,\n"
+	"   using the maps xdp_loader pinned under /sys/fs/bpf/<ifname>\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+
+#include "./common/common_defines.h"
+#include "./common/common_user_bpf_xdp.h"
+
+#include "xdp_router_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s <ifname> <port> vlan <id> [smac <mac>]\n", prog);
+	printf("       %s <ifname> <port> untagged [smac <mac>]\n", prog);
+	printf("       %s <ifname> <port> del\n", prog);
+	printf("       %s <ifname> show\n\n", prog);
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+static int parse_mac(const char *str, unsigned char mac[ETH_ALEN])
+{
+	char end;
+
+	if (sscanf(str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx%c", &mac[0], &mac[1],
+		   &mac[2], &mac[3], &mac[4], &mac[5], &end) != 6)
+		return -1;
+	return 0;
+}
+
+/* Stacked devices (VLAN) can't transmit XDP frames themselves; sysfs
+ * lists the device below them as a lower_<name> link
+ */
+static __u32 lower_ifindex(const char *port, __u32 ifindex)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	__u32 lower = 0;
+	DIR *dir;
+
+	snprintf(path, PATH_MAX, "/sys/class/net/%s", port);
+	dir = opendir(path);
+	if (!dir)
+		return ifindex;
+	while ((de = readdir(dir))) {
+		if (!strncmp(de->d_name, "lower_", 6)) {
+			lower = if_nametoindex(de->d_name + 6);
+			break;
+		}
+	}
+	closedir(dir);
+	return lower ? lower : ifindex;
+}
+
+/* Load the object against the pinned maps, so the egress program reads
+ * the same port_vlan the tool writes
+ */
+static int load_egress_prog(const char *pin_dir)
+{
+	char path[PATH_MAX];
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	struct bpf_map *map;
+	int fd;
+
+	obj = bpf_object__open_file("xdp_prog_kern.o", NULL);
+	if (libbpf_get_error(obj)) {
+		fprintf(stderr, "ERR: opening xdp_prog_kern.o\n");
+		return -1;
+	}
+	bpf_object__for_each_map(map, obj) {
+		snprintf(path, PATH_MAX, "%s/%s", pin_dir, bpf_map__name(map));
+		fd = bpf_obj_get(path);
+		if (fd < 0 || bpf_map__reuse_fd(map, fd)) {
+			fprintf(stderr, "ERR: reusing %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+	}
+	if (bpf_object__load(obj)) {
+		fprintf(stderr, "ERR: loading xdp_prog_kern.o with maps from %s\n", pin_dir);
+		return -1;
+	}
+	prog = bpf_object__find_program_by_name(obj, "xdp_egress_vlan_func");
+	if (!prog) {
+		fprintf(stderr, "ERR: xdp_egress_vlan_func not found\n");
+		return -1;
+	}
+	/* tx_port entries keep their own reference: the object can go */
+	return bpf_program__fd(prog);
+}
+
+static int show(int vlan_fd, int tx_fd)
+{
+	struct bpf_devmap_val dev;
+	char ifname[IF_NAMESIZE];
+	char lower[IF_NAMESIZE];
+	struct port_vlan cfg;
+	__u32 key, *prev = NULL;
+	__u32 next;
+
+	while (bpf_map_get_next_key(vlan_fd, prev, &next) == 0) {
+		key = next;
+		prev = &key;
+		if (bpf_map_lookup_elem(vlan_fd, &key, &cfg))
+			continue;
+		if (!if_indextoname(key, ifname))
+			snprintf(ifname, sizeof(ifname), "#%u", key);
+		printf("%-16s ", ifname);
+		if (cfg.vlan_id)
+			printf("vlan %-4u ", cfg.vlan_id);
+		else
+			printf("untagged  ");
+		if (cfg.flags & PORT_F_SMAC)
+			printf("smac %02x:%02x:%02x:%02x:%02x:%02x ",
+			       cfg.smac[0], cfg.smac[1], cfg.smac[2],
+			       cfg.smac[3], cfg.smac[4], cfg.smac[5]);
+		if (bpf_map_lookup_elem(tx_fd, &key, &dev) < 0) {
+			printf("(not in tx_port)\n");
+			continue;
+		}
+		if (!if_indextoname(dev.ifindex, lower))
+			snprintf(lower, sizeof(lower), "#%u", dev.ifindex);
+		printf("via %s%s\n", lower, dev.bpf_prog.id ? "" : " (no egress program)");
+	}
+	return EXIT_OK;
+}
+
+int main(int argc, char **argv)
+{
+	struct bpf_devmap_val dev = {};
+	struct port_vlan cfg = {};
+	char pin_dir[PATH_MAX];
+	int vlan_fd, tx_fd;
+	__u32 port;
+	char *end;
+	long val;
+	int arg;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[1]);
+	vlan_fd = open_bpf_map_file(pin_dir, "port_vlan", NULL);
+	tx_fd = open_bpf_map_file(pin_dir, "tx_port", NULL);
+	if (vlan_fd < 0 || tx_fd < 0)
+		return EXIT_FAIL_BPF;
+
+	if (argc == 3 && !strcmp(argv[2], "show"))
+		return show(vlan_fd, tx_fd);
+
+	if (argc < 4) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+	port = if_nametoindex(argv[2]);
+	if (!port) {
+		fprintf(stderr, "ERR: unknown interface %s\n", argv[2]);
+		return EXIT_FAIL_OPTION;
+	}
+	dev.ifindex = lower_ifindex(argv[2], port);
+
+	if (argc == 4 && !strcmp(argv[3], "del")) {
+		/* A subinterface can't be sent to directly: leave it to the kernel */
+		if (dev.ifindex != port)
+			bpf_map_delete_elem(tx_fd, &port);
+		else if (bpf_map_update_elem(tx_fd, &port, &dev, 0) < 0)
+			fprintf(stderr, "WARN: resetting tx_port entry: %s\n", strerror(errno));
+		if (bpf_map_delete_elem(vlan_fd, &port) < 0 && errno != ENOENT) {
+			fprintf(stderr, "ERR: deleting port_vlan entry: %s\n", strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+		return EXIT_OK;
+	}
+
+	arg = 3;
+	if (!strcmp(argv[arg], "vlan") && arg + 1 < argc) {
+		val = strtol(argv[arg + 1], &end, 10);
+		if (*end || val < 1 || val > 4094) {
+			fprintf(stderr, "ERR: invalid VLAN id %s\n", argv[arg + 1]);
+			return EXIT_FAIL_OPTION;
+		}
+		cfg.vlan_id = val;
+		arg += 2;
+	} else if (!strcmp(argv[arg], "untagged")) {
+		arg++;
+	} else {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	if (arg + 2 == argc && !strcmp(argv[arg], "smac")) {
+		if (parse_mac(argv[arg + 1], cfg.smac) < 0) {
+			fprintf(stderr, "ERR: invalid MAC address %s\n", argv[arg + 1]);
+			return EXIT_FAIL_OPTION;
+		}
+		cfg.flags |= PORT_F_SMAC;
+		arg += 2;
+	}
+	if (arg != argc) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	dev.bpf_prog.fd = load_egress_prog(pin_dir);
+	if (dev.bpf_prog.fd < 0)
+		return EXIT_FAIL_BPF;
+
+	/* Settings first: the program must never see the entry without them */
+	if (bpf_map_update_elem(vlan_fd, &port, &cfg, 0) < 0) {
+		fprintf(stderr, "ERR: updating port_vlan entry: %s\n", strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	if (bpf_map_update_elem(tx_fd, &port, &dev, 0) < 0) {
+		fprintf(stderr, "ERR: updating tx_port entry: %s\n", strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	return EXIT_OK;
+}
@@ -1,136 +1,322 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 #include <linux/bpf.h>
 #include <linux/in.h>
+#include <linux/if_arp.h>
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_endian.h>
 
 // The parsing helper functions from the sample04-packet_parsing lesson have moved here
 #include "./common/parsing_helpers.h"
+#include "./common/rewrite_helpers.h"
 
 /* Defines xdp_stats_map */
 #include "./common/xdp_stats_kern_user.h"
 #include "./common/xdp_stats_kern.h"
 
+/* Defines lpm_key and lpm_nexthop for xdp_lpm_router_func */
+#include "xdp_lpm_kern_user.h"
+
+/* Defines fdb_entry for xdp_bridge_func */
+#include "xdp_bridge_kern_user.h"
+
+/* Defines vrf_key for xdp_router_func */
+#include "xdp_router_kern_user.h"
+
+/* Defines mpls_ilm for xdp_mpls_func */
+#include "xdp_mpls_kern_user.h"
+
+/* Defines vip_key and vip_entry for xdp_icmp_echo_func */
+#include "xdp_responder_kern_user.h"
+
+/* Defines qos_prefix and qos_class for xdp_qos_func */
+#include "xdp_qos_kern_user.h"
+
 #ifndef memcpy
 #define memcpy(dest, src, n) __builtin_memcpy((dest), (src), (n))
 #endif
 
+/* Egress ports for xdp_router_func, keyed by the ifindex the FIB returns.
+ * Populated by xdp_prog_user --dev <ifname> --redirect-dev <egress>, where
+ * key == value.ifindex. xdp_port_vlan maps VLAN subinterfaces to their
+ * parent device and attaches xdp_egress_vlan_func to the entry.
+ * Redirecting through a devmap lets the kernel queue frames per device
+ * and flush them in bulk at the end of the NAPI poll.
+ */
 struct {
-	__uint(type, BPF_MAP_TYPE_DEVMAP);
+	__uint(type, BPF_MAP_TYPE_DEVMAP_HASH);
 	__type(key, int);
-	__type(value, int);
-	__uint(max_entries, 256);
+	__type(value, struct bpf_devmap_val);
+	__uint(max_entries, 64);
 	//__uint(pinning, LIBBPF_PIN_BY_NAME);
 } tx_port SEC(".maps");
 
 
+/* Source MAC -> destination MAC for the static redirect programs,
+ * written by xdp_prog_user (--src-mac/--dest-mac, or --config in bulk)
+ */
 struct {
 	__uint(type, BPF_MAP_TYPE_HASH);
 	__type(key,  unsigned char[ETH_ALEN]);
 	__type(value, unsigned char[ETH_ALEN]);
-	__uint(max_entries, 1);
+	__uint(max_entries, 4096);
 	//__uint(pinning, LIBBPF_PIN_BY_NAME);
 } redirect_params SEC(".maps");
 
-static __always_inline void swap_src_dst_mac(struct ethhdr *eth)
+/* IPv4 prefixes -> next-hop id, mirrored from the kernel main table
+ * by xdp_lpm_sync. LPM tries must be allocated on demand.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_LPM_TRIE);
+	__type(key, struct lpm_key);
+	__type(value, __u32);
+	__uint(max_entries, LPM_MAX_ROUTES);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+} lpm_routes SEC(".maps");
+
+/* Next-hop id -> egress ifindex and MAC addresses */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, struct lpm_nexthop);
+	__uint(max_entries, LPM_MAX_NEXTHOPS);
+} nexthops SEC(".maps");
+
+/* ECMP next-hop groups, referenced by lpm_routes values with NH_ID_GROUP set */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, struct lpm_nh_group);
+	__uint(max_entries, ECMP_MAX_GROUPS);
+} nh_groups SEC(".maps");
+
+/* from include/net/ip.h */
+static __always_inline int ip_decrease_ttl(struct iphdr *iph)
 {
-       unsigned char   tmp[ETH_ALEN];
-       memcpy(tmp, eth->h_dest, sizeof(eth->h_dest));
-       memcpy(eth->h_dest, eth->h_source, sizeof(eth->h_dest));
-       memcpy(eth->h_source, tmp, sizeof(eth->h_dest));
+	__u32 check = (__u32)iph->check;
+	check += (__u32)bpf_htons(0x0100);
+	iph->check = (__u16)(check + (check >= 0xFFFF));
+	return --iph->ttl;
 }
 
-static __always_inline void swap_src_dst_ipv6(struct ipv6hdr *ipv6)
+/* Routing table per ingress port / VLAN, written by xdp_vrf. Frames
+ * without an entry use the main table (untagged) or go to the kernel
+ * (tagged, their VLAN device does the routing).
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, struct vrf_key);
+	__type(value, __u32);
+	__uint(max_entries, VRF_MAX_ENTRIES);
+} vrf_tables SEC(".maps");
+
+/* Per (ingress, egress, lookup result) counters: shows how much traffic
+ * falls back to the kernel and why. Read by xdp_stats --fib.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+	__type(key, struct fib_stats_key);
+	__type(value, struct datarec);
+	__uint(max_entries, FIB_STATS_MAX);
+} fib_stats SEC(".maps");
+
+static __always_inline void fib_stats_record(struct fib_stats_key *key, __u64 bytes)
 {
-       struct in6_addr tmp;
-       memcpy(&tmp, &ipv6->daddr, sizeof(struct in6_addr));
-       memcpy(&ipv6->daddr, &ipv6->saddr, sizeof(struct in6_addr));
-       memcpy(&ipv6->saddr, &tmp, sizeof(struct in6_addr));
+	struct datarec *rec, zero = {};
+
+	rec = bpf_map_lookup_elem(&fib_stats, key);
+	if (!rec) {
+		/* Full map: the new combination just goes uncounted */
+		bpf_map_update_elem(&fib_stats, key, &zero, BPF_NOEXIST);
+		rec = bpf_map_lookup_elem(&fib_stats, key);
+		if (!rec)
+			return;
+	}
+	/* Per-CPU value, no atomics needed (see xdp_stats_record_action) */
+	rec->rx_packets++;
+	rec->rx_bytes += bytes;
 }
 
-static __always_inline void swap_src_dst_ipv4(struct iphdr *iphdr)
+/* Next hops waiting for ARP/ND. LRU, so a burst towards many cold
+ * destinations can't fill it up. xdp_neigh_warm drops entries as soon
+ * as their neighbour resolves.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_LRU_HASH);
+	__type(key, struct neigh_key);
+	__type(value, __u64);
+	__uint(max_entries, NEIGH_PENDING_MAX);
+} neigh_pending SEC(".maps");
+
+/* NO_NEIGH: let the first frame (and one per NEIGH_RETRY_NS after it)
+ * through to the kernel to start resolution; non-zero means drop this one
+ */
+static __always_inline int neigh_miss_limited(struct bpf_fib_lookup *fib)
 {
-       __be32 tmp;
-       memcpy(&tmp, &iphdr->daddr, sizeof(iphdr->daddr));
-       memcpy(&iphdr->daddr, &iphdr->saddr, sizeof(iphdr->daddr));
-       memcpy(&iphdr->saddr, &tmp, sizeof(iphdr->daddr));	
+	struct neigh_key key = {
+		.ifindex = fib->ifindex,
+		.family = fib->family,
+	};
+	__u64 now = bpf_ktime_get_ns();
+	__u64 *last;
+
+	/* On NO_NEIGH the lookup has already replaced the destination
+	 * with the gateway, so this is the address being resolved
+	 */
+	if (fib->family == AF_INET)
+		key.addr[0] = fib->ipv4_dst;
+	else
+		memcpy(key.addr, fib->ipv6_dst, sizeof(key.addr));
+
+	last = bpf_map_lookup_elem(&neigh_pending, &key);
+	if (last && now - *last < NEIGH_RETRY_NS)
+		return 1;
+
+	bpf_map_update_elem(&neigh_pending, &key, &now, BPF_ANY);
+	return 0;
 }
 
+/* Egress port VLAN/MAC settings, written by xdp_port_vlan */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, __u32);
+	__type(value, struct port_vlan);
+	__uint(max_entries, PORT_VLAN_MAX);
+} port_vlan SEC(".maps");
 
-/* from include/net/ip.h */
-static __always_inline int ip_decrease_ttl(struct iphdr *iph)
+/* The devmap program only sees the real device in egress_ifindex, so a
+ * VLAN subinterface picked by the FIB is handed over in the metadata.
+ * Drivers without metadata support (and SKB mode) fail the adjust, and
+ * the egress side then falls back to the device's own settings.
+ */
+static __always_inline void egress_meta_set(struct xdp_md *ctx, __u32 ifindex)
 {
-	__u32 check = (__u32)iph->check;
-	check += (__u32)bpf_htons(0x0100);
-	iph->check = (__u16)(check + (check >= 0xFFFF));
-	return --iph->ttl;
+	__u32 *meta;
+
+	if (bpf_xdp_adjust_meta(ctx, -(int)sizeof(*meta)))
+		return;
+	meta = (void *)(long)ctx->data_meta;
+	if (meta + 1 > (__u32 *)(long)ctx->data)
+		return;
+	*meta = ifindex;
 }
 
-SEC("xdp")
-int xdp_router_func(struct xdp_md *ctx)
+/* bpf_fib_lookup() forwarding shared by xdp_router_func and the cpumap
+ * second stage; returns the XDP action.
+ */
+static __always_inline int fib_forward(struct xdp_md *ctx)
 {
 	void *data_end = (void *)(long)ctx->data_end;
 	void *data = (void *)(long)ctx->data;
 	struct bpf_fib_lookup fib_params = {};
-	struct ethhdr *eth = data;
+	struct collect_vlans vlans = {};
+	struct hdr_cursor nh;
+	struct vrf_key vkey = {};
+	struct fib_stats_key skey = {
+		.in_ifindex = ctx->ingress_ifindex,
+		.result = FIB_STAT_NO_LOOKUP,
+	};
+	__u64 bytes = data_end - data;
+	struct ethhdr *eth;
 	struct ipv6hdr *ip6h;
 	struct iphdr *iph;
-	__u16 h_proto;
-	__u64 nh_off;
+	__u32 *tbid, flags = 0;
+	int tagged;
+	int h_proto;
 	int rc;
 	int action = XDP_PASS;
 
-	nh_off = sizeof(*eth);
-	if (data + nh_off > data_end) {
+	nh.pos = data;
+	h_proto = parse_ethhdr_vlan(&nh, data_end, &eth, &vlans);
+	if (h_proto < 0) {
 		action = XDP_DROP;
 		goto out;
 	}
 
-	h_proto = eth->h_proto;
+	/* One tag at most; QinQ is left to the kernel */
+	tagged = proto_is_vlan(eth->h_proto);
+	if (tagged && nh.pos != (void *)(eth + 1) + sizeof(struct vlan_hdr))
+		goto out;
+
+	vkey.ifindex = ctx->ingress_ifindex;
+	vkey.vlan_id = tagged ? vlans.id[0] : 0;
+	tbid = bpf_map_lookup_elem(&vrf_tables, &vkey);
+	if (tbid) {
+		fib_params.tbid = *tbid;
+		flags = BPF_FIB_LOOKUP_DIRECT | BPF_FIB_LOOKUP_TBID;
+	} else if (tagged) {
+		goto out;
+	}
+
 	if (h_proto == bpf_htons(ETH_P_IP)) {
-		iph = data + nh_off;
+		iph = nh.pos;
 
 		if (iph + 1 > data_end) {
 			action = XDP_DROP;
 			goto out;
 		}
 
-		if (iph->ttl <= 1)
+		if (iph->ttl <= 1) {
+			skey.result = FIB_STAT_TTL;
 			goto out;
+		}
 
 
        fib_params.family = AF_INET;
        fib_params.l4_protocol  = iph->protocol;
        fib_params.ipv4_src = iph->saddr;
        fib_params.ipv4_dst = iph->daddr;
+       fib_params.tot_len = bpf_ntohs(iph->tot_len);
 
 	} else if (h_proto == bpf_htons(ETH_P_IPV6)) {
 		/* These pointers can be used to assign structures instead of executing memcpy: */
 		struct in6_addr *src = (struct in6_addr *) fib_params.ipv6_src;
 		struct in6_addr *dst = (struct in6_addr *) fib_params.ipv6_dst;
 
-		ip6h = data + nh_off;
+		ip6h = nh.pos;
 		if (ip6h + 1 > data_end) {
 			action = XDP_DROP;
 			goto out;
 		}
 
-		if (ip6h->hop_limit <= 1)
+		if (ip6h->hop_limit <= 1) {
+			skey.result = FIB_STAT_TTL;
 			goto out;
+		}
 
        fib_params.family = AF_INET6;
        fib_params.l4_protocol  = ip6h->nexthdr;
        *src = ip6h->saddr;
        *dst = ip6h->daddr;
+       fib_params.tot_len = sizeof(*ip6h) + bpf_ntohs(ip6h->payload_len);
 	} else {
 		goto out;
 	}
 
 	fib_params.ifindex = ctx->ingress_ifindex;
 
-	rc = bpf_fib_lookup(ctx, &fib_params, sizeof(fib_params), 0);
+	/* tot_len is set, so the lookup also checks the egress MTU */
+	rc = bpf_fib_lookup(ctx, &fib_params, sizeof(fib_params), flags);
+	skey.result = rc;
+	if (rc == BPF_FIB_LKUP_RET_SUCCESS || rc == BPF_FIB_LKUP_RET_NO_NEIGH)
+		skey.out_ifindex = fib_params.ifindex;
+
 	switch (rc) {
 	case BPF_FIB_LKUP_RET_SUCCESS:         /* lookup successful */
+#ifdef ROUTER_BPF_REDIRECT
+		/* Benchmark baseline: unbatched per-packet redirect */
+		action = bpf_redirect(fib_params.ifindex, 0);
+#else
+		/* Egress port not in tx_port: hand the frame to the kernel
+		 * untouched, so it forwards it itself. The redirect only
+		 * happens on return, so the rewrites below still apply.
+		 */
+		action = bpf_redirect_map(&tx_port, fib_params.ifindex, 0);
+		if (action != XDP_REDIRECT) {
+			skey.result = FIB_STAT_NO_TX_PORT;
+			action = XDP_PASS;
+			break;
+		}
+#endif
 		if (h_proto == bpf_htons(ETH_P_IP))
 			ip_decrease_ttl(iph);
 		else if (h_proto == bpf_htons(ETH_P_IPV6))
@@ -139,7 +325,15 @@ int xdp_router_func(struct xdp_md *ctx)
 
         memcpy(eth->h_dest, fib_params.dmac, ETH_ALEN);
         memcpy(eth->h_source, fib_params.smac, ETH_ALEN);
-        action = bpf_redirect(fib_params.ifindex, 0);
+
+		/* Frames leave untagged; xdp_egress_vlan_func tags them per
+		 * egress port if xdp_port_vlan configured one
+		 */
+		if (tagged && vlan_tag_pop(ctx, eth) < 0) {
+			action = XDP_ABORTED;
+			break;
+		}
+		egress_meta_set(ctx, fib_params.ifindex);
 		break;
 	case BPF_FIB_LKUP_RET_BLACKHOLE:    /* dest is blackholed; can be dropped */
 	case BPF_FIB_LKUP_RET_UNREACHABLE:  /* dest is unreachable; can be dropped */
@@ -149,20 +343,988 @@ int xdp_router_func(struct xdp_md *ctx)
 	case BPF_FIB_LKUP_RET_NOT_FWDED:    /* packet is not forwarded */
 	case BPF_FIB_LKUP_RET_FWD_DISABLED: /* fwding is not enabled on ingress */
 	case BPF_FIB_LKUP_RET_UNSUPP_LWT:   /* fwd requires encapsulation */
-	case BPF_FIB_LKUP_RET_NO_NEIGH:     /* no neighbor entry for nh */
 	case BPF_FIB_LKUP_RET_FRAG_NEEDED:  /* fragmentation required to fwd */
 		/* PASS */
 		break;
+	case BPF_FIB_LKUP_RET_NO_NEIGH:     /* no neighbor entry for nh */
+#ifndef ROUTER_NEIGH_PASS_ALL
+		if (neigh_miss_limited(&fib_params)) {
+			skey.result = FIB_STAT_NEIGH_LIMITED;
+			action = XDP_DROP;
+		}
+#endif
+		break;
+	}
+
+out:
+	fib_stats_record(&skey, bytes);
+	return action;
+}
+
+SEC("xdp")
+int xdp_router_func(struct xdp_md *ctx)
+{
+	return xdp_stats_record_action(ctx, fib_forward(ctx));
+}
+
+/* 5-tuple flow hash (murmur3 finalizer rounds) for ECMP member selection */
+static __always_inline __u32 mix32(__u32 h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static __always_inline __u32 flow_hash_v4(struct hdr_cursor *nh, void *data_end,
+					  struct iphdr *iph, int ip_proto)
+{
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+	__u32 ports = 0;
+	__u32 h;
+
+	/* Non-first fragments carry no L4 header: hash on addresses only */
+	if (!(iph->frag_off & bpf_htons(0x1fff))) {
+		if (ip_proto == IPPROTO_TCP && parse_tcphdr(nh, data_end, &tcph) > 0)
+			ports = ((__u32)tcph->source << 16) | tcph->dest;
+		else if (ip_proto == IPPROTO_UDP && parse_udphdr(nh, data_end, &udph) >= 0)
+			ports = ((__u32)udph->source << 16) | udph->dest;
+	}
+
+	h = mix32(iph->saddr);
+	h = mix32(h ^ iph->daddr);
+	h = mix32(h ^ ports);
+	return mix32(h ^ ip_proto);
+}
+
+/* Alternative to xdp_router_func: forwards IPv4 using the lpm_routes and
+ * nexthops maps instead of bpf_fib_lookup(). Anything the maps can't
+ * answer (no route, unresolved neighbour, IPv6) is passed to the kernel.
+ *
+ * Multipath routes point at an nh_groups entry; the flow hash picks one of
+ * its ECMP_BUCKETS buckets, so a flow keeps its member for as long as the
+ * group is unchanged.
+ */
+SEC("xdp")
+int xdp_lpm_router_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct lpm_nh_group *grp;
+	struct hdr_cursor nh;
+	struct lpm_nexthop *nexthop;
+	struct lpm_key key;
+	struct ethhdr *eth;
+	struct iphdr *iph;
+	int eth_type, ip_proto;
+	__u32 *nh_id, id;
+	int action = XDP_PASS;
+
+	nh.pos = data;
+	eth_type = parse_ethhdr(&nh, data_end, &eth);
+	if (eth_type < 0) {
+		action = XDP_DROP;
+		goto out;
+	}
+
+	/* VLAN tagged frames are left to the kernel */
+	if (eth_type != bpf_htons(ETH_P_IP) || eth->h_proto != eth_type)
+		goto out;
+
+	ip_proto = parse_iphdr(&nh, data_end, &iph);
+	if (ip_proto < 0) {
+		action = XDP_DROP;
+		goto out;
+	}
+	if (iph->ttl <= 1)
+		goto out;
+
+	key.prefixlen = 32;
+	key.addr = iph->daddr;
+	nh_id = bpf_map_lookup_elem(&lpm_routes, &key);
+	if (!nh_id)
+		goto out;
+	id = *nh_id;
+
+	if (id & NH_ID_GROUP) {
+		__u32 gid = id & ~NH_ID_GROUP;
+
+		grp = bpf_map_lookup_elem(&nh_groups, &gid);
+		if (!grp)
+			goto out;
+		id = grp->buckets[flow_hash_v4(&nh, data_end, iph, ip_proto) &
+				  (ECMP_BUCKETS - 1)];
+	}
+
+	nexthop = bpf_map_lookup_elem(&nexthops, &id);
+	if (!nexthop)
+		goto out;
+
+	if (nexthop->flags & NH_F_DROP) {
+		action = XDP_DROP;
+		goto out;
+	}
+	if (!(nexthop->flags & NH_F_VALID))
+		goto out;
+
+	/* Egress port not in tx_port: the kernel forwards the untouched frame */
+	action = bpf_redirect_map(&tx_port, nexthop->ifindex, 0);
+	if (action != XDP_REDIRECT) {
+		action = XDP_PASS;
+		goto out;
+	}
+
+	ip_decrease_ttl(iph);
+	memcpy(eth->h_dest, nexthop->dmac, ETH_ALEN);
+	memcpy(eth->h_source, nexthop->smac, ETH_ALEN);
+	egress_meta_set(ctx, nexthop->ifindex);
+
+out:
+	return xdp_stats_record_action(ctx, action);
+}
+
+/* Software RSS for veth / generic XDP, where one CPU sees every packet
+ * of an interface: xdp_cpumap_rss_func hashes the flow and queues the
+ * frame to one of the CPUs in cpus_available, whose cpumap kthread runs
+ * xdp_cpumap_router_func. Both are set up by xdp_cpumap_user.
+ */
+#define CPUMAP_MAX_CPUS		64
+
+struct {
+	__uint(type, BPF_MAP_TYPE_CPUMAP);
+	__type(key, __u32);
+	__type(value, struct bpf_cpumap_val);
+	__uint(max_entries, CPUMAP_MAX_CPUS);
+} cpu_map SEC(".maps");
+
+/* Dense list of the CPUs in cpu_map, first cpus_count[0] entries used */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, CPUMAP_MAX_CPUS);
+} cpus_available SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, 1);
+} cpus_count SEC(".maps");
+
+static __always_inline __u32 flow_hash_v6(struct hdr_cursor *nh, void *data_end,
+					  struct ipv6hdr *ip6h, int ip_proto)
+{
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+	__u32 ports = 0;
+	__u32 h = 0;
+	int i;
+
+	if (ip_proto == IPPROTO_TCP && parse_tcphdr(nh, data_end, &tcph) > 0)
+		ports = ((__u32)tcph->source << 16) | tcph->dest;
+	else if (ip_proto == IPPROTO_UDP && parse_udphdr(nh, data_end, &udph) >= 0)
+		ports = ((__u32)udph->source << 16) | udph->dest;
+
+#pragma unroll
+	for (i = 0; i < 4; i++) {
+		h = mix32(h ^ ip6h->saddr.in6_u.u6_addr32[i]);
+		h = mix32(h ^ ip6h->daddr.in6_u.u6_addr32[i]);
+	}
+	h = mix32(h ^ ports);
+	return mix32(h ^ ip_proto);
+}
+
+/* Front stage: only hashes, so it keeps up with line rate on one CPU.
+ * Stats are recorded once, by the second stage, with the final action.
+ * Also the fallback of xdp_qos_func for classes without their own CPU.
+ */
+static __always_inline int cpumap_rss(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct hdr_cursor nh;
+	struct ethhdr *eth;
+	struct ipv6hdr *ip6h;
+	struct iphdr *iph;
+	__u32 *count, *cpu;
+	__u32 key = 0, hash = 0;
+	int eth_type, ip_proto;
+
+	count = bpf_map_lookup_elem(&cpus_count, &key);
+	if (!count || !*count)
+		return xdp_stats_record_action(ctx, fib_forward(ctx));
+
+	nh.pos = data;
+	eth_type = parse_ethhdr(&nh, data_end, &eth);
+	if (eth_type == bpf_htons(ETH_P_IP)) {
+		ip_proto = parse_iphdr(&nh, data_end, &iph);
+		if (ip_proto >= 0)
+			hash = flow_hash_v4(&nh, data_end, iph, ip_proto);
+	} else if (eth_type == bpf_htons(ETH_P_IPV6)) {
+		ip_proto = parse_ip6hdr(&nh, data_end, &ip6h);
+		if (ip_proto >= 0)
+			hash = flow_hash_v6(&nh, data_end, ip6h, ip_proto);
+	}
+
+	key = hash % *count;
+	cpu = bpf_map_lookup_elem(&cpus_available, &key);
+	if (!cpu)
+		return XDP_PASS;
+
+	/* CPU just removed by xdp_cpumap_user: let the kernel have it */
+	return bpf_redirect_map(&cpu_map, *cpu, XDP_PASS);
+}
+
+SEC("xdp")
+int xdp_cpumap_rss_func(struct xdp_md *ctx)
+{
+	return cpumap_rss(ctx);
+}
+
+/* Second stage, runs on the remote CPU; ingress_ifindex is still the
+ * interface the frame arrived on, so the FIB lookup is unchanged.
+ */
+SEC("xdp/cpumap")
+int xdp_cpumap_router_func(struct xdp_md *ctx)
+{
+	return xdp_stats_record_action(ctx, fib_forward(ctx));
+}
+
+/* L2 bridge, the learning version of the static redirect_params mapping.
+ * xdp_bridge attaches it to every port from one object, so all ports
+ * share fdb and bridge_ports, and ages fdb from userspace.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, unsigned char[ETH_ALEN]);
+	__type(value, struct fdb_entry);
+	__uint(max_entries, BRIDGE_MAX_MACS);
+} fdb SEC(".maps");
+
+/* Bridge ports, keyed by ifindex (key == value). Unknown unicast and
+ * multicast are flooded to all of them but the ingress port.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_DEVMAP_HASH);
+	__type(key, int);
+	__type(value, int);
+	__uint(max_entries, BRIDGE_MAX_PORTS);
+} bridge_ports SEC(".maps");
+
+static __always_inline void fdb_learn(unsigned char *mac, __u32 ifindex)
+{
+	struct fdb_entry *entry, new = {};
+	__u64 now;
+
+	/* Group addresses are never a valid source */
+	if (mac[0] & 1)
+		return;
+
+	now = bpf_ktime_get_ns();
+	entry = bpf_map_lookup_elem(&fdb, mac);
+	if (entry) {
+		if (entry->flags & FDB_F_STATIC)
+			return;
+		if (entry->ifindex == ifindex) {
+			if (now - entry->updated > FDB_REFRESH_NS)
+				entry->updated = now;
+			return;
+		}
+	}
+
+	/* New MAC or moved port. When fdb is full the MAC stays unknown
+	 * and its traffic is flooded until the ager makes room.
+	 */
+	new.ifindex = ifindex;
+	new.updated = now;
+	bpf_map_update_elem(&fdb, mac, &new, BPF_ANY);
+}
+
+SEC("xdp")
+int xdp_bridge_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct fdb_entry *entry;
+	struct ethhdr *eth = data;
+	int action;
+
+	if (eth + 1 > data_end) {
+		action = XDP_DROP;
+		goto out;
+	}
+
+	fdb_learn(eth->h_source, ctx->ingress_ifindex);
+
+	if (!(eth->h_dest[0] & 1)) {
+		entry = bpf_map_lookup_elem(&fdb, eth->h_dest);
+		if (entry) {
+			/* Both ends on the same segment: not ours to forward */
+			if (entry->ifindex == ctx->ingress_ifindex) {
+				action = XDP_DROP;
+				goto out;
+			}
+			action = bpf_redirect_map(&bridge_ports, entry->ifindex, XDP_DROP);
+			goto out;
+		}
+	}
+
+	action = bpf_redirect_map(&bridge_ports, 0,
+				  BPF_F_BROADCAST | BPF_F_EXCLUDE_INGRESS);
+out:
+	return xdp_stats_record_action(ctx, action);
+}
+
+/* Devmap egress program for the router's tx_port entries: runs once per
+ * frame on the way out of the port, after the bulk dequeue, and tags,
+ * retags or untags it (and fixes the source MAC) as port_vlan says
+ */
+SEC("xdp/devmap")
+int xdp_egress_vlan_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	__u32 *meta = (void *)(long)ctx->data_meta;
+	__u32 port = ctx->egress_ifindex;
+	struct ethhdr *eth = data;
+	struct vlan_hdr *vlh;
+	struct port_vlan *cfg;
+
+	if (meta + 1 <= (__u32 *)data)
+		port = *meta;
+
+	cfg = bpf_map_lookup_elem(&port_vlan, &port);
+	if (!cfg)
+		return XDP_PASS;
+
+	if (eth + 1 > data_end)
+		return XDP_DROP;
+
+	/* Before push/pop, which move the Ethernet header */
+	if (cfg->flags & PORT_F_SMAC)
+		memcpy(eth->h_source, cfg->smac, ETH_ALEN);
+
+	if (!proto_is_vlan(eth->h_proto)) {
+		if (cfg->vlan_id && vlan_tag_push(ctx, eth, cfg->vlan_id) < 0)
+			return XDP_DROP;
+		return XDP_PASS;
+	}
+
+	if (!cfg->vlan_id)
+		return vlan_tag_pop(ctx, eth) < 0 ? XDP_DROP : XDP_PASS;
+
+	/* Already tagged: keep the priority bits, swap the VLAN id */
+	vlh = (void *)(eth + 1);
+	if (vlh + 1 > data_end)
+		return XDP_DROP;
+	vlh->h_vlan_TCI = (vlh->h_vlan_TCI & ~bpf_htons(VLAN_VID_MASK)) |
+			  bpf_htons(cfg->vlan_id);
+	return XDP_PASS;
+}
+
+/* MPLS label switching: incoming top label -> label operation and next
+ * hop, written by xdp_mpls. Labels not in the map, expiring TTLs, stacks
+ * deeper than MPLS_MAX_DEPTH, multicast and VLAN tagged frames are left
+ * to the kernel's mpls_router.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, __u32);
+	__type(value, struct mpls_ilm);
+	__uint(max_entries, MPLS_ILM_MAX);
+} mpls_ilm SEC(".maps");
+
+/* Folds a 32-bit ones' complement sum into a checksum field */
+static __always_inline __u16 csum_fold32(__u32 sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+/* Updates a checksum for one 16-bit word changing from old to new,
+ * both as stored in the packet (RFC 1624)
+ */
+static __always_inline void csum_replace2(__sum16 *check, __u16 old, __u16 new)
+{
+	__u32 sum = (__u16)~*check;
+
+	sum += (__u16)~old;
+	sum += new;
+	*check = csum_fold32(sum);
+}
+
+/* Sets the IPv4 TTL, updating the checksum incrementally */
+static __always_inline void ip_set_ttl(struct iphdr *iph, __u8 ttl)
+{
+	__u16 *word = (__u16 *)&iph->ttl;	/* TTL and protocol */
+	__u16 old = *word;
+
+	iph->ttl = ttl;
+	csum_replace2(&iph->check, old, *word);
+}
+
+SEC("xdp")
+int xdp_mpls_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct ipv6hdr *ip6h = NULL;
+	struct iphdr *iph = NULL;
+	struct mpls_label *lse;
+	struct mpls_ilm *ilm;
+	struct hdr_cursor nh;
+	struct ethhdr *eth;
+	__u32 entry, label;
+	int eth_type, payload, bos;
+	__u8 tc, ttl;
+	int action = XDP_PASS;
+
+	nh.pos = data;
+	eth_type = parse_ethhdr(&nh, data_end, &eth);
+	if (eth_type < 0) {
+		action = XDP_DROP;
+		goto out;
+	}
+
+	/* Unicast MPLS directly on Ethernet only */
+	if (eth_type != bpf_htons(ETH_P_MPLS_UC) || eth->h_proto != eth_type)
+		goto out;
+
+	payload = parse_mpls_stack(&nh, data_end, &lse, NULL);
+	if (payload < 0)
+		goto out;
+
+	entry = bpf_ntohl(lse->entry);
+	label = (entry & MPLS_LS_LABEL_MASK) >> MPLS_LS_LABEL_SHIFT;
+	tc = (entry & MPLS_LS_TC_MASK) >> MPLS_LS_TC_SHIFT;
+	bos = !!(entry & MPLS_LS_S_MASK);
+	ttl = entry & MPLS_LS_TTL_MASK;
+
+	/* Expiring: the kernel drops it and sends the ICMP error */
+	if (ttl <= 1)
+		goto out;
+	ttl--;
+
+	ilm = bpf_map_lookup_elem(&mpls_ilm, &label);
+	if (!ilm)
+		goto out;
+
+	switch (ilm->op) {
+	case MPLS_OP_SWAP:
+	case MPLS_OP_PUSH:
+		break;
+	case MPLS_OP_POP:
+		if (!bos)
+			break;
+		/* Penultimate hop popping: the payload must be IP, and takes
+		 * the MPLS TTL (like net.mpls.ip_ttl_propagate, the default)
+		 */
+		if (payload == bpf_htons(ETH_P_IP)) {
+			iph = nh.pos;
+			if (iph + 1 > data_end)
+				goto out;
+		} else if (payload == bpf_htons(ETH_P_IPV6)) {
+			ip6h = nh.pos;
+			if (ip6h + 1 > data_end)
+				goto out;
+		} else {
+			goto out;
+		}
+		break;
+	default:
+		goto out;
+	}
+
+	/* Egress port not in tx_port: the kernel forwards it untouched.
+	 * The redirect only happens on return, so the rewrites below apply.
+	 */
+	action = bpf_redirect_map(&tx_port, ilm->ifindex, 0);
+	if (action != XDP_REDIRECT) {
+		action = XDP_PASS;
+		goto out;
+	}
+
+	/* Before push/pop, which move the Ethernet header */
+	memcpy(eth->h_dest, ilm->dmac, ETH_ALEN);
+	memcpy(eth->h_source, ilm->smac, ETH_ALEN);
+
+	switch (ilm->op) {
+	case MPLS_OP_SWAP:
+		lse->entry = mpls_lse(ilm->out_label[0], tc, bos, ttl);
+		break;
+	case MPLS_OP_PUSH:
+		lse->entry = mpls_lse(ilm->out_label[1], tc, bos, ttl);
+		if (mpls_label_push(ctx, eth, mpls_lse(ilm->out_label[0], tc, 0, ttl)) < 0)
+			action = XDP_ABORTED;
+		break;
+	case MPLS_OP_POP:
+		/* Not the bottom: the next entry keeps its own TTL, as in
+		 * the kernel
+		 */
+		if (iph)
+			ip_set_ttl(iph, ttl);
+		else if (ip6h)
+			ip6h->hop_limit = ttl;
+		if (mpls_label_pop(ctx, eth, bos ? payload : bpf_htons(ETH_P_MPLS_UC)) < 0)
+			action = XDP_ABORTED;
+		break;
+	}
+
+out:
+	return xdp_stats_record_action(ctx, action);
+}
+
+/* VIPs xdp_icmp_echo_func answers for, written by xdp_vip */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__type(key, struct vip_key);
+	__type(value, struct vip_entry);
+	__uint(max_entries, VIP_MAX_ENTRIES);
+} vips SEC(".maps");
+
+/* Replies sent and dropped over the limit, read by xdp_vip show */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, __u32);
+	__type(value, struct datarec);
+	__uint(max_entries, RESP_STAT_MAX);
+} responder_stats SEC(".maps");
+
+/* ARP for IPv4 over Ethernet, the only kind answered */
+struct arp_eth {
+	struct arphdr	hdr;
+	unsigned char	sha[ETH_ALEN];
+	unsigned char	spa[4];
+	unsigned char	tha[ETH_ALEN];
+	unsigned char	tpa[4];
+};
+
+/* Neighbor solicitation / advertisement with one link-layer address
+ * option: source in the NS, target in the NA
+ */
+struct nd_msg_lla {
+	struct icmp6hdr	icmph;
+	struct in6_addr	target;
+	__u8		opt_type;
+	__u8		opt_len;	/* in 8 byte units */
+	unsigned char	opt_lladdr[ETH_ALEN];
+};
+
+#define NDISC_NEIGHBOUR_SOLICITATION	135
+#define NDISC_NEIGHBOUR_ADVERTISEMENT	136
+#define ND_OPT_SOURCE_LL_ADDR	1
+#define ND_OPT_TARGET_LL_ADDR	2
+#define ND_NA_FLAGS		bpf_htonl(0x60000000)	/* solicited, override */
+#define REPLY_TTL		64
+
+/* The part of an NS the NA changes, for one incremental checksum update */
+struct nd_csum_words {
+	struct in6_addr	saddr;
+	struct in6_addr	daddr;
+	__u32		icmp[2];	/* type, code, (checksum as 0), flags */
+	__u32		opt[2];
+};
+
+static __always_inline void nd_csum_save(struct nd_csum_words *w,
+					 struct ipv6hdr *ip6h,
+					 struct nd_msg_lla *nd)
+{
+	w->saddr = ip6h->saddr;
+	w->daddr = ip6h->daddr;
+	memcpy(w->icmp, &nd->icmph, sizeof(w->icmp));
+	((struct icmp6hdr *)w->icmp)->icmp6_cksum = 0;
+	memcpy(w->opt, &nd->opt_type, sizeof(w->opt));
+}
+
+static __always_inline void responder_stats_record(__u32 key, __u64 bytes)
+{
+	struct datarec *rec = bpf_map_lookup_elem(&responder_stats, &key);
+
+	if (!rec)
+		return;
+	rec->rx_packets++;
+	rec->rx_bytes += bytes;
+}
+
+/* Non-zero when the VIP is over its rate. Like neigh_pending, tat is
+ * updated without atomics: CPUs racing on one VIP can let a few replies
+ * more through, never less.
+ */
+static __always_inline int vip_rate_limited(struct vip_entry *vip)
+{
+	__u64 now, tat;
+
+	if (!vip->interval_ns)
+		return 0;
+
+	now = bpf_ktime_get_ns();
+	tat = vip->tat > now ? vip->tat : now;
+	if (tat - now > vip->burst_ns)
+		return 1;
+	vip->tat = tat + vip->interval_ns;
+	return 0;
+}
+
+/* Answers ICMP / ICMPv6 echo requests, ARP requests and neighbor
+ * solicitations for the VIPs in the vips map with XDP_TX, rewriting the
+ * request in place and patching checksums incrementally. Replies over a
+ * VIP's rate are dropped, so a ping or ARP storm never reaches the
+ * kernel. Everything else (other addresses, fragments, DAD, NS without
+ * exactly a source link-layer option) is passed.
+ */
+SEC("xdp")
+int xdp_icmp_echo_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct nd_csum_words before, after;
+	struct icmphdr_common *icmph;
+	struct vip_key key = {};
+	struct vip_entry *vip;
+	struct nd_msg_lla *nd;
+	struct ipv6hdr *ip6h;
+	struct hdr_cursor nh;
+	struct ethhdr *eth;
+	struct arp_eth *arp;
+	struct iphdr *iph;
+	__u64 bytes = data_end - data;
+	__u16 old, *word;
+	__u32 stat, sum;
+	int eth_type;
+	int action = XDP_PASS;
+
+	nh.pos = data;
+	eth_type = parse_ethhdr(&nh, data_end, &eth);
+	if (eth_type < 0) {
+		action = XDP_DROP;
+		goto out;
+	}
+
+	/* Replies are built in place, so VLAN tags go back as they came */
+	if (eth_type == bpf_htons(ETH_P_ARP)) {
+		arp = nh.pos;
+		if (arp + 1 > data_end)
+			goto out;
+		if (arp->hdr.ar_hrd != bpf_htons(ARPHRD_ETHER) ||
+		    arp->hdr.ar_pro != bpf_htons(ETH_P_IP) ||
+		    arp->hdr.ar_hln != ETH_ALEN || arp->hdr.ar_pln != 4 ||
+		    arp->hdr.ar_op != bpf_htons(ARPOP_REQUEST))
+			goto out;
+
+		/* Gratuitous ARP for a VIP is a conflict: the kernel logs it */
+		if (!__builtin_memcmp(arp->spa, arp->tpa, 4))
+			goto out;
+
+		key.family = AF_INET;
+		memcpy(key.addr, arp->tpa, 4);
+		vip = bpf_map_lookup_elem(&vips, &key);
+		if (!vip || !(vip->flags & VIP_F_NEIGH))
+			goto out;
+		if (vip_rate_limited(vip)) {
+			stat = RESP_STAT_LIMITED;
+			action = XDP_DROP;
+			goto count;
+		}
+
+		arp->hdr.ar_op = bpf_htons(ARPOP_REPLY);
+		memcpy(arp->tha, arp->sha, ETH_ALEN);
+		memcpy(arp->tpa, arp->spa, 4);
+		memcpy(arp->sha, vip->mac, ETH_ALEN);
+		memcpy(arp->spa, key.addr, 4);
+		stat = RESP_STAT_ARP;
+	} else if (eth_type == bpf_htons(ETH_P_IP)) {
+		if (parse_iphdr(&nh, data_end, &iph) != IPPROTO_ICMP)
+			goto out;
+		/* Fragmented requests are reassembled by the kernel */
+		if (iph->frag_off & bpf_htons(0x3fff))
+			goto out;
+		if (parse_icmphdr_common(&nh, data_end, &icmph) != ICMP_ECHO ||
+		    icmph->code)
+			goto out;
+
+		key.family = AF_INET;
+		key.addr[0] = iph->daddr;
+		vip = bpf_map_lookup_elem(&vips, &key);
+		if (!vip || !(vip->flags & VIP_F_ECHO))
+			goto out;
+		if (vip_rate_limited(vip)) {
+			stat = RESP_STAT_LIMITED;
+			action = XDP_DROP;
+			goto count;
+		}
+
+		/* The IP header sum doesn't change with the addresses swapped */
+		swap_src_dst_ipv4(iph);
+		ip_set_ttl(iph, REPLY_TTL);
+
+		word = (__u16 *)icmph;	/* type and code */
+		old = *word;
+		icmph->type = ICMP_ECHOREPLY;
+		csum_replace2(&icmph->cksum, old, *word);
+		stat = RESP_STAT_ECHO;
+	} else if (eth_type == bpf_htons(ETH_P_IPV6)) {
+		if (parse_ip6hdr(&nh, data_end, &ip6h) != IPPROTO_ICMPV6)
+			goto out;
+
+		switch (parse_icmphdr_common(&nh, data_end, &icmph)) {
+		case ICMPV6_ECHO_REQUEST:
+			if (icmph->code)
+				goto out;
+
+			key.family = AF_INET6;
+			memcpy(key.addr, &ip6h->daddr, sizeof(key.addr));
+			vip = bpf_map_lookup_elem(&vips, &key);
+			if (!vip || !(vip->flags & VIP_F_ECHO))
+				goto out;
+			if (vip_rate_limited(vip)) {
+				stat = RESP_STAT_LIMITED;
+				action = XDP_DROP;
+				goto count;
+			}
+
+			/* Nor does the pseudo-header sum */
+			swap_src_dst_ipv6(ip6h);
+			ip6h->hop_limit = REPLY_TTL;
+
+			word = (__u16 *)icmph;
+			old = *word;
+			icmph->type = ICMPV6_ECHO_REPLY;
+			csum_replace2(&icmph->cksum, old, *word);
+			stat = RESP_STAT_ECHO6;
+			break;
+		case NDISC_NEIGHBOUR_SOLICITATION:
+			nd = (void *)icmph;
+			if (nd + 1 > data_end)
+				goto out;
+			/* RFC 4861 7.1.1: hop limit 255, code 0. DAD (unspecified
+			 * source) and NS with other options go to the kernel.
+			 */
+			if (ip6h->hop_limit != 255 || icmph->code ||
+			    ip6h->payload_len != bpf_htons(sizeof(*nd)) ||
+			    nd->opt_type != ND_OPT_SOURCE_LL_ADDR || nd->opt_len != 1)
+				goto out;
+			if (!(ip6h->saddr.in6_u.u6_addr32[0] | ip6h->saddr.in6_u.u6_addr32[1] |
+			      ip6h->saddr.in6_u.u6_addr32[2] | ip6h->saddr.in6_u.u6_addr32[3]))
+				goto out;
+
+			key.family = AF_INET6;
+			memcpy(key.addr, &nd->target, sizeof(key.addr));
+			vip = bpf_map_lookup_elem(&vips, &key);
+			if (!vip || !(vip->flags & VIP_F_NEIGH))
+				goto out;
+			if (vip_rate_limited(vip)) {
+				stat = RESP_STAT_LIMITED;
+				action = XDP_DROP;
+				goto count;
+			}
+
+			nd_csum_save(&before, ip6h, nd);
+
+			/* From the target to the soliciting node, which may
+			 * have asked from the solicited-node multicast group
+			 */
+			ip6h->daddr = ip6h->saddr;
+			ip6h->saddr = nd->target;
+			nd->icmph.icmp6_type = NDISC_NEIGHBOUR_ADVERTISEMENT;
+			nd->icmph.icmp6_dataun.un_data32[0] = ND_NA_FLAGS;
+			nd->opt_type = ND_OPT_TARGET_LL_ADDR;
+			memcpy(nd->opt_lladdr, vip->mac, ETH_ALEN);
+
+			nd_csum_save(&after, ip6h, nd);
+			sum = bpf_csum_diff((__be32 *)&before, sizeof(before),
+					    (__be32 *)&after, sizeof(after),
+					    (__u16)~nd->icmph.icmp6_cksum);
+			nd->icmph.icmp6_cksum = csum_fold32(sum);
+			stat = RESP_STAT_NA;
+			break;
+		default:
+			goto out;
+		}
+	} else {
+		goto out;
 	}
 
+	memcpy(eth->h_dest, eth->h_source, ETH_ALEN);
+	memcpy(eth->h_source, vip->mac, ETH_ALEN);
+	action = XDP_TX;
+count:
+	responder_stats_record(stat, bytes);
 out:
 	return xdp_stats_record_action(ctx, action);
 }
 
+/* Traffic classes by destination prefix and port range, written by
+ * xdp_qos. IPv4 prefixes use struct lpm_key, like lpm_routes.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_LPM_TRIE);
+	__type(key, struct lpm_key);
+	__type(value, struct qos_prefix);
+	__uint(max_entries, QOS_MAX_PREFIXES);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+} qos_rules_v4 SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_LPM_TRIE);
+	__type(key, struct qos_key6);
+	__type(value, struct qos_prefix);
+	__uint(max_entries, QOS_MAX_PREFIXES);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+} qos_rules_v6 SEC(".maps");
+
+/* DSCP and CPU per class */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, struct qos_class);
+	__uint(max_entries, QOS_MAX_CLASSES);
+} qos_classes SEC(".maps");
+
+/* Packets and bytes per class, read by xdp_qos show */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, __u32);
+	__type(value, struct datarec);
+	__uint(max_entries, QOS_MAX_CLASSES);
+} qos_stats SEC(".maps");
+
+/* DSCP is the upper 6 bits of the IPv4 TOS byte, ECN the lower 2 */
+static __always_inline void ipv4_set_dscp(struct iphdr *iph, __u8 dscp)
+{
+	__u16 *word = (__u16 *)iph;	/* version, IHL and TOS */
+	__u16 old = *word;
+
+	iph->tos = (dscp << 2) | (iph->tos & 0x03);
+	if (*word != old)
+		csum_replace2(&iph->check, old, *word);
+}
+
+/* The IPv6 traffic class straddles the first two bytes; no checksum
+ * covers it
+ */
+static __always_inline void ipv6_set_dscp(struct ipv6hdr *ip6h, __u8 dscp)
+{
+	__u8 *b = (__u8 *)ip6h;
+	__u8 tclass = ((b[0] & 0x0f) << 4) | (b[1] >> 4);
+
+	tclass = (dscp << 2) | (tclass & 0x03);
+	b[0] = (b[0] & 0xf0) | (tclass >> 4);
+	b[1] = (b[1] & 0x0f) | (tclass << 4);
+}
+
+/* Classification stage in front of the cpumap router: finds the flow's
+ * class (destination prefix, then the first matching protocol / port
+ * rule), rewrites its DSCP, counts it, and steers it to the class's own
+ * CPU, so latency-sensitive traffic doesn't queue behind bulk flows.
+ * Classes without a CPU are spread by flow hash like xdp_cpumap_rss_func.
+ */
+SEC("xdp")
+int xdp_qos_func(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct qos_prefix *prefix = NULL;
+	struct ipv6hdr *ip6h = NULL;
+	struct iphdr *iph = NULL;
+	struct qos_port_rule *rule;
+	struct qos_key6 key6;
+	struct lpm_key key4;
+	struct datarec *rec;
+	struct qos_class *cls;
+	struct hdr_cursor nh;
+	struct ethhdr *eth;
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+	__u32 class_id = QOS_CLASS_DEFAULT;
+	int eth_type, ip_proto = -1;
+	__u16 dport = 0;
+	int ports = 0;
+	int action;
+	int i;
+
+	nh.pos = data;
+	eth_type = parse_ethhdr(&nh, data_end, &eth);
+	if (eth_type == bpf_htons(ETH_P_IP)) {
+		ip_proto = parse_iphdr(&nh, data_end, &iph);
+		if (ip_proto >= 0) {
+			key4.prefixlen = 32;
+			key4.addr = iph->daddr;
+			prefix = bpf_map_lookup_elem(&qos_rules_v4, &key4);
+			/* Later fragments carry no L4 header */
+			ports = !(iph->frag_off & bpf_htons(0x1fff));
+		}
+	} else if (eth_type == bpf_htons(ETH_P_IPV6)) {
+		ip_proto = parse_ip6hdr(&nh, data_end, &ip6h);
+		if (ip_proto >= 0) {
+			key6.prefixlen = 128;
+			memcpy(key6.addr, &ip6h->daddr, sizeof(key6.addr));
+			prefix = bpf_map_lookup_elem(&qos_rules_v6, &key6);
+			ports = 1;
+		}
+	}
+
+	if (prefix) {
+		if (ports && ip_proto == IPPROTO_TCP && parse_tcphdr(&nh, data_end, &tcph) > 0)
+			dport = bpf_ntohs(tcph->dest);
+		else if (ports && ip_proto == IPPROTO_UDP && parse_udphdr(&nh, data_end, &udph) >= 0)
+			dport = bpf_ntohs(udph->dest);
+
+		#pragma unroll
+		for (i = 0; i < QOS_PORT_RULES; i++) {
+			if (i >= prefix->nr_rules)
+				break;
+			rule = &prefix->rules[i];
+			if ((!rule->ip_proto || rule->ip_proto == ip_proto) &&
+			    dport >= rule->port_lo && dport <= rule->port_hi) {
+				class_id = rule->class_id;
+				break;
+			}
+		}
+	}
+
+	cls = bpf_map_lookup_elem(&qos_classes, &class_id);
+	if (!cls)
+		return cpumap_rss(ctx);
+
+	if (cls->flags & QOS_F_REMARK) {
+		if (iph)
+			ipv4_set_dscp(iph, cls->dscp);
+		else if (ip6h)
+			ipv6_set_dscp(ip6h, cls->dscp);
+	}
+
+	/* Per-CPU value, no atomics needed (see xdp_stats_record_action) */
+	rec = bpf_map_lookup_elem(&qos_stats, &class_id);
+	if (rec) {
+		rec->rx_packets++;
+		rec->rx_bytes += data_end - data;
+	}
+
+	/* A class CPU missing from cpu_map falls back to the hash */
+	if (cls->flags & QOS_F_CPU) {
+		action = bpf_redirect_map(&cpu_map, cls->cpu, 0);
+		if (action == XDP_REDIRECT)
+			return action;
+	}
+	return cpumap_rss(ctx);
+}
+
 SEC("xdp")
 int xdp_pass_func(struct xdp_md *ctx)
 {
 	return XDP_PASS;
 }
 
+/* Sink for bench_redirect.sh: counts as received on veth, then drops */
+SEC("xdp")
+int xdp_drop_func(struct xdp_md *ctx)
+{
+	return XDP_DROP;
+}
+
 char _license[] SEC("license") = "GPL";
@@ -1,7 +1,11 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 
 static const char *__doc__ = "XDP redirect helper\n"
-	" - Allows to populate/query tx_port and redirect_params maps\n";
+	" - Adds <redirect-dev> to the tx_port devmap of <dev> (key = ifindex)\n"
+	" - Optionally writes the <src-mac> -> <dest-mac> redirect_params entry\n"
+	" - With --config, makes tx_port and redirect_params match a file of\n"
+	"   \"redirect <ifname>\" and \"mac <src-mac> <dest-mac>\" lines, writing\n"
+	"   only the entries that changed, in batches\n";
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,13 +40,16 @@ static const struct option_wrapper long_options[] = {
 	 "Operate on device <ifname>", "<ifname>", true},
 
 	{{"redirect-dev",         required_argument,	NULL, 'r' },
-	 "Redirect to device <ifname>", "<ifname>", true},
+	 "Redirect to device <ifname>", "<ifname>", false},
 
 	{{"src-mac", required_argument, NULL, 'L' },
-	 "Source MAC address of <dev>", "<mac>", true },
+	 "Source MAC address of <dev>", "<mac>", false },
 
 	{{"dest-mac", required_argument, NULL, 'R' },
-	 "Destination MAC address of <redirect-dev>", "<mac>", true },
+	 "Destination MAC address of <redirect-dev>", "<mac>", false },
+
+	{{"config",      required_argument,	NULL, 6 },
+	 "Sync all entries from <file> instead", "<file>", false},
 
 	{{"quiet",       no_argument,		NULL, 'q' },
 	 "Quiet mode (no output)"},
@@ -50,17 +57,15 @@ static const struct option_wrapper long_options[] = {
 	{{0, 0, NULL,  0 }, NULL, false}
 };
 
-static int parse_mac(char *str, unsigned char mac[ETH_ALEN])
+static int parse_mac(const char *str, unsigned char mac[ETH_ALEN])
 {
 	/* Assignment 3: parse a MAC address in this function and place the
 	 * result in the mac array */
-       int i, j;
-       char tmp[3];
-       tmp[2] = '\0';
-       for (i = 0, j = 0; i < strlen(str); i+=3, j++) {
-               memcpy(tmp, str + i, 2);
-               mac[j] = strtoul(tmp ,NULL, 16);
-       }
+	char end;
+
+	if (sscanf(str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx%c", &mac[0], &mac[1],
+		   &mac[2], &mac[3], &mac[4], &mac[5], &end) != 6)
+		return -1;
 	return 0;
 }
 
@@ -81,6 +86,302 @@ static int write_iface_params(int map_fd, unsigned char *src, unsigned char *des
 	return 0;
 }
 
+/* --config: the file is the whole wanted state of tx_port and
+ * redirect_params. Both maps are read back, diffed against it, and only
+ * new or changed entries are written and stale ones deleted, a batch per
+ * map where the map type supports it.
+ */
+struct entry {
+	__u8 key[8];	/* zero padded, so memcmp() orders any key size */
+	__u8 val[8];
+};
+
+struct entries {
+	struct entry *e;
+	__u32 n;
+	__u32 max;
+};
+
+struct map_sync {
+	const char *name;
+	int fd;
+	__u32 key_size;
+	__u32 val_size;
+	__u32 cmp_size;		/* leading value bytes that make an entry differ */
+	struct entries want;
+	struct entries have;
+};
+
+static struct entry *entries_add(struct entries *ents)
+{
+	struct entry *e;
+
+	if (ents->n == ents->max) {
+		ents->max = ents->max ? ents->max * 2 : 256;
+		e = realloc(ents->e, ents->max * sizeof(*e));
+		if (!e)
+			return NULL;
+		ents->e = e;
+	}
+	e = &ents->e[ents->n++];
+	memset(e, 0, sizeof(*e));
+	return e;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+	return memcmp(((const struct entry *)a)->key,
+		      ((const struct entry *)b)->key, sizeof(((struct entry *)0)->key));
+}
+
+static int parse_config(const char *file, struct map_sync *tx, struct map_sync *macs)
+{
+	char line[256], *kw, *a, *b, *extra;
+	struct bpf_devmap_val port = {};
+	unsigned char mac[ETH_ALEN];
+	struct entry *e;
+	int lineno = 0;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f) {
+		fprintf(stderr, "ERR: opening %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if ((kw = strchr(line, '#')))
+			*kw = '\0';
+		kw = strtok(line, " \t\n");
+		if (!kw)
+			continue;
+		a = strtok(NULL, " \t\n");
+		b = strtok(NULL, " \t\n");
+		extra = strtok(NULL, " \t\n");
+
+		if (!strcmp(kw, "redirect") && a && !b) {
+			port.ifindex = if_nametoindex(a);
+			if (!port.ifindex) {
+				fprintf(stderr, "ERR: %s:%d: unknown interface %s\n", file, lineno, a);
+				goto err;
+			}
+			if (!(e = entries_add(&tx->want)))
+				goto err_mem;
+			memcpy(e->key, &port.ifindex, sizeof(port.ifindex));
+			memcpy(e->val, &port, sizeof(port));
+		} else if (!strcmp(kw, "mac") && a && b && !extra) {
+			if (!(e = entries_add(&macs->want)))
+				goto err_mem;
+			if (parse_mac(a, e->key) < 0 || parse_mac(b, mac) < 0) {
+				fprintf(stderr, "ERR: %s:%d: invalid MAC address\n", file, lineno);
+				goto err;
+			}
+			memcpy(e->val, mac, ETH_ALEN);
+		} else {
+			fprintf(stderr, "ERR: %s:%d: expected \"redirect <ifname>\" or "
+				"\"mac <src-mac> <dest-mac>\"\n", file, lineno);
+			goto err;
+		}
+	}
+	fclose(f);
+	return 0;
+
+err_mem:
+	fprintf(stderr, "ERR: out of memory\n");
+err:
+	fclose(f);
+	return -1;
+}
+
+/* Sort by key; a key listed twice must agree on its value */
+static int want_sort(struct map_sync *m)
+{
+	__u32 i, n = 0;
+
+	qsort(m->want.e, m->want.n, sizeof(struct entry), entry_cmp);
+	for (i = 0; i < m->want.n; i++) {
+		if (n && !entry_cmp(&m->want.e[n - 1], &m->want.e[i])) {
+			if (memcmp(m->want.e[n - 1].val, m->want.e[i].val, m->cmp_size)) {
+				fprintf(stderr, "ERR: conflicting %s entries in config\n", m->name);
+				return -1;
+			}
+			continue;
+		}
+		m->want.e[n++] = m->want.e[i];
+	}
+	m->want.n = n;
+	return 0;
+}
+
+static int map_read(struct map_sync *m)
+{
+	DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	__u8 keys[256 * 8], vals[256 * 8], key[8];
+	__u32 batch, count, i;
+	struct entry *e;
+	bool first = true;
+	int err;
+
+	for (;;) {
+		count = sizeof(keys) / m->key_size;
+		if (count > sizeof(vals) / m->val_size)
+			count = sizeof(vals) / m->val_size;
+		err = bpf_map_lookup_batch(m->fd, first ? NULL : &batch, &batch,
+					   keys, vals, &count, &opts);
+		if (err < 0 && errno != ENOENT) {
+			/* Not for devmaps: walk the keys instead */
+			if (!first)
+				return -1;
+			break;
+		}
+		first = false;
+		for (i = 0; i < count; i++) {
+			if (!(e = entries_add(&m->have)))
+				return -1;
+			memcpy(e->key, keys + i * m->key_size, m->key_size);
+			memcpy(e->val, vals + i * m->val_size, m->val_size);
+		}
+		if (err < 0)
+			goto out;	/* ENOENT: no more entries */
+	}
+
+	first = true;
+	while (bpf_map_get_next_key(m->fd, first ? NULL : key, key) == 0) {
+		first = false;
+		if (!(e = entries_add(&m->have)))
+			return -1;
+		memcpy(e->key, key, m->key_size);
+		if (bpf_map_lookup_elem(m->fd, key, e->val) < 0)
+			m->have.n--;	/* deleted meanwhile */
+	}
+out:
+	qsort(m->have.e, m->have.n, sizeof(struct entry), entry_cmp);
+	return 0;
+}
+
+/* Batch first; whatever the batch didn't do (all of it, if the map type
+ * has no batch ops) is retried one entry at a time
+ */
+static int map_write(struct map_sync *m, __u8 *keys, __u8 *vals, __u32 n)
+{
+	DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	__u32 count = n, i;
+	int err = 0;
+
+	if (!n)
+		return 0;
+	if (vals ? bpf_map_update_batch(m->fd, keys, vals, &count, &opts) == 0 :
+		   bpf_map_delete_batch(m->fd, keys, &count, &opts) == 0)
+		return 0;
+	if (count > n)
+		count = 0;
+
+	for (i = count; i < n; i++) {
+		if (vals ? bpf_map_update_elem(m->fd, keys + i * m->key_size,
+					       vals + i * m->val_size, 0) == 0 :
+			   bpf_map_delete_elem(m->fd, keys + i * m->key_size) == 0 ||
+			   errno == ENOENT)
+			continue;
+		fprintf(stderr, "ERR: %s %s entry: %s\n", vals ? "updating" : "deleting",
+			m->name, strerror(errno));
+		err = -1;
+	}
+	return err;
+}
+
+static int map_sync(struct map_sync *m, bool keep_progs)
+{
+	__u32 w = 0, h = 0, n_upd = 0, n_del = 0;
+	__u8 *upd_keys, *upd_vals, *del_keys;
+	struct bpf_devmap_val *dev;
+	struct entry *we, *he;
+	int cmp, err = -1;
+
+	if (want_sort(m) || map_read(m)) {
+		fprintf(stderr, "ERR: reading %s: %s\n", m->name, strerror(errno));
+		return -1;
+	}
+
+	upd_keys = malloc((m->want.n + 1) * m->key_size);
+	upd_vals = malloc((m->want.n + 1) * m->val_size);
+	del_keys = malloc((m->have.n + 1) * m->key_size);
+	if (!upd_keys || !upd_vals || !del_keys)
+		goto out;
+
+	/* Both sorted by key: one merge pass finds new, changed and stale */
+	while (w < m->want.n || h < m->have.n) {
+		we = w < m->want.n ? &m->want.e[w] : NULL;
+		he = h < m->have.n ? &m->have.e[h] : NULL;
+		cmp = !we ? 1 : !he ? -1 : entry_cmp(we, he);
+
+		if (cmp > 0) {
+			/* tx_port entries with an xdp_port_vlan egress program
+			 * belong to that tool
+			 */
+			dev = (struct bpf_devmap_val *)he->val;
+			if (!keep_progs || !dev->bpf_prog.id)
+				memcpy(del_keys + n_del++ * m->key_size, he->key, m->key_size);
+			h++;
+			continue;
+		}
+		if (cmp < 0 || memcmp(we->val, he->val, m->cmp_size)) {
+			memcpy(upd_keys + n_upd * m->key_size, we->key, m->key_size);
+			memcpy(upd_vals + n_upd++ * m->val_size, we->val, m->val_size);
+		}
+		w++;
+		if (cmp == 0)
+			h++;
+	}
+
+	err = map_write(m, upd_keys, upd_vals, n_upd);
+	err |= map_write(m, del_keys, NULL, n_del);
+	if (verbose)
+		printf("%-16s %6u entries: %u written, %u deleted\n", m->name,
+		       m->want.n, n_upd, n_del);
+out:
+	free(upd_keys);
+	free(upd_vals);
+	free(del_keys);
+	return err;
+}
+
+static int sync_config(const char *pin_dir, const char *file)
+{
+	struct map_sync tx = {
+		.name = "tx_port",
+		.key_size = sizeof(int),
+		.val_size = sizeof(struct bpf_devmap_val),
+		.cmp_size = sizeof(__u32),	/* ifindex, not the program */
+	};
+	struct map_sync macs = {
+		.name = "redirect_params",
+		.key_size = ETH_ALEN,
+		.val_size = ETH_ALEN,
+		.cmp_size = ETH_ALEN,
+	};
+	struct timespec start, end;
+	int err;
+
+	if (parse_config(file, &tx, &macs) < 0)
+		return EXIT_FAIL_OPTION;
+
+	tx.fd = open_bpf_map_file(pin_dir, tx.name, NULL);
+	macs.fd = open_bpf_map_file(pin_dir, macs.name, NULL);
+	if (tx.fd < 0 || macs.fd < 0)
+		return EXIT_FAIL_BPF;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	err = map_sync(&tx, true);
+	err |= map_sync(&macs, false);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (verbose)
+		printf("synced %s in %.2f ms\n", file,
+		       (end.tv_sec - start.tv_sec) * 1e3 +
+		       (end.tv_nsec - start.tv_nsec) / 1e6);
+	return err ? EXIT_FAIL_BPF : EXIT_OK;
+}
+
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
@@ -107,7 +408,7 @@ int main(int argc, char **argv)
 
 	redirect_map = (cfg.ifindex > 0) && (cfg.redirect_ifindex > 0);
 
-	if (cfg.redirect_ifindex > 0 && cfg.ifindex == -1) {
+	if ((cfg.redirect_ifindex > 0 || cfg.config_file[0]) && cfg.ifindex == -1) {
 		fprintf(stderr, "ERR: required option --dev missing\n\n");
 		usage(argv[0], __doc__, long_options, (argc == 1));
 		return EXIT_FAIL_OPTION;
@@ -119,12 +420,15 @@ int main(int argc, char **argv)
 		return EXIT_FAIL_OPTION;
 	}
 
-	if (parse_mac(cfg.src_mac, src) < 0) {
+	if (cfg.config_file[0])
+		return sync_config(pin_dir, cfg.config_file);
+
+	if (cfg.src_mac[0] && parse_mac(cfg.src_mac, src) < 0) {
 		fprintf(stderr, "ERR: can't parse mac address %s\n", cfg.src_mac);
 		return EXIT_FAIL_OPTION;
 	}
 
-	if (parse_mac(cfg.dest_mac, dest) < 0) {
+	if (cfg.dest_mac[0] && parse_mac(cfg.dest_mac, dest) < 0) {
 		fprintf(stderr, "ERR: can't parse mac address %s\n", cfg.dest_mac);
 		return EXIT_FAIL_OPTION;
 	}
@@ -140,11 +444,22 @@ int main(int argc, char **argv)
 	printf("map dir: %s\n", pin_dir);
 
 	if (redirect_map) {
-		/* setup a virtual port for the static redirect */
-		i = 0;
-		bpf_map_update_elem(map_fd, &i, &cfg.redirect_ifindex, 0);
+		/* tx_port is a DEVMAP_HASH keyed by the egress ifindex, which
+		 * is what bpf_fib_lookup() hands back to xdp_router_func */
+		struct bpf_devmap_val port = { .ifindex = cfg.redirect_ifindex };
+
+		i = cfg.redirect_ifindex;
+		if (bpf_map_update_elem(map_fd, &i, &port, 0) < 0) {
+			fprintf(stderr, "ERR: adding ifnum=%d to tx_port: %s\n",
+				cfg.redirect_ifindex, strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
 		printf("redirect from ifnum=%d to ifnum=%d\n", cfg.ifindex, cfg.redirect_ifindex);
 
+		/* MAC rewrite entry is only used by the static redirect programs */
+		if (!cfg.src_mac[0] || !cfg.dest_mac[0])
+			return EXIT_OK;
+
 		/* Assignment 3: open the redirect_params map corresponding to the cfg.ifname interface */
 		map_fd = -1;
 		map_fd = open_bpf_map_file(pin_dir, "redirect_params", NULL);
@@ -0,0 +1,495 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP DSCP classification and remarking\n"
+	" - Sets the classes xdp_qos_func on <ifname> sorts flows into by\n"
+	"   destination prefix, protocol and port, the DSCP each class is\n"
+	"   rewritten to and the CPU it gets to itself\n"
+	" - Classes without a CPU are spread like xdp_cpumap_rss_func\n"
+	"   (see xdp_cpumap_user)\n"
+	" - Uses the maps xdp_loader pinned under /sys/fs/bpf/<ifname>\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+#include <linux/bpf.h>
+
+#include "./common/common_defines.h"
+#include "./common/common_user_bpf_xdp.h"
+#include "./common/xdp_stats_kern_user.h"
+
+#include "xdp_lpm_kern_user.h"
+#include "xdp_qos_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+#define DEFAULT_QSIZE	2048
+#define CPUMAP_MAX_CPUS	64	/* cpu_map size in xdp_prog_kern.c */
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s <ifname> class <id> [dscp <dscp>|keep] [cpu <n>|rss]\n", prog);
+	printf("       %s <ifname> rule <prefix> [proto tcp|udp] [port <lo>[-<hi>]] class <id>\n", prog);
+	printf("       %s <ifname> rule <prefix> del\n", prog);
+	printf("       %s <ifname> show\n\n", prog);
+	printf("  class  0-%d, class %d is for packets no rule matched\n",
+	       QOS_MAX_CLASSES - 1, QOS_CLASS_DEFAULT);
+	printf("  dscp   0-63, ef, cs0-cs7 or af11-af43; keep leaves it as received\n");
+	printf("  cpu    give the class this CPU to itself; rss spreads it by flow hash\n");
+	printf("  rule   appended to the rules of <prefix> (up to %d), the first match wins\n\n",
+	       QOS_PORT_RULES);
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+static int parse_u32(const char *str, __u32 *val)
+{
+	char *end;
+	long v;
+
+	v = strtol(str, &end, 10);
+	if (end == str || *end || v < 0 || v > 0xffffffffL)
+		return -1;
+	*val = v;
+	return 0;
+}
+
+/* RFC 2474 / 2597 / 3246 code points */
+static int parse_dscp(const char *str, __u8 *dscp)
+{
+	__u32 v;
+
+	if (!strcmp(str, "ef")) {
+		*dscp = 46;
+		return 0;
+	}
+	if (!strncmp(str, "cs", 2) && str[2] >= '0' && str[2] <= '7' && !str[3]) {
+		*dscp = (str[2] - '0') << 3;
+		return 0;
+	}
+	if (!strncmp(str, "af", 2) && str[2] >= '1' && str[2] <= '4' &&
+	    str[3] >= '1' && str[3] <= '3' && !str[4]) {
+		*dscp = ((str[2] - '0') << 3) | ((str[3] - '0') << 1);
+		return 0;
+	}
+	if (parse_u32(str, &v) < 0 || v > 63)
+		return -1;
+	*dscp = v;
+	return 0;
+}
+
+static int parse_ports(const char *str, struct qos_port_rule *rule)
+{
+	unsigned int lo, hi;
+	char end;
+	int n;
+
+	n = sscanf(str, "%u-%u%c", &lo, &hi, &end);
+	if (n == 1)
+		hi = lo;
+	else if (n != 2)
+		return -1;
+	if (lo > hi || hi > 65535)
+		return -1;
+	rule->port_lo = lo;
+	rule->port_hi = hi;
+	return 0;
+}
+
+/* "10.0.1.0/24" or "2001:db8::/64" into a qos_rules_v4 / v6 key, host
+ * bits cleared
+ */
+static int parse_prefix(const char *str, struct lpm_key *key4,
+			struct qos_key6 *key6, bool *v6)
+{
+	char buf[INET6_ADDRSTRLEN + 4];
+	__u32 plen, i;
+	char *slash;
+
+	snprintf(buf, sizeof(buf), "%s", str);
+	slash = strchr(buf, '/');
+	if (slash)
+		*slash++ = '\0';
+
+	memset(key6, 0, sizeof(*key6));
+	if (inet_pton(AF_INET, buf, &key4->addr) == 1) {
+		*v6 = false;
+		plen = 32;
+		if (slash && (parse_u32(slash, &plen) < 0 || plen > 32))
+			return -1;
+		key4->prefixlen = plen;
+		key4->addr &= plen ? htonl(~0U << (32 - plen)) : 0;
+		return 0;
+	}
+	if (inet_pton(AF_INET6, buf, key6->addr) == 1) {
+		*v6 = true;
+		plen = 128;
+		if (slash && (parse_u32(slash, &plen) < 0 || plen > 128))
+			return -1;
+		key6->prefixlen = plen;
+		for (i = 0; i < 4; i++) {
+			if (plen >= 32)
+				plen -= 32;
+			else {
+				key6->addr[i] &= plen ? htonl(~0U << (32 - plen)) : 0;
+				plen = 0;
+			}
+		}
+		return 0;
+	}
+	return -1;
+}
+
+/* A lookup in an LPM trie returns the longest match, not the entry of
+ * this exact prefix: walk the keys instead
+ */
+static int find_prefix(int fd, const void *key, size_t key_size,
+		       struct qos_prefix *prefix)
+{
+	unsigned char cur[sizeof(struct qos_key6)], next[sizeof(struct qos_key6)];
+	void *prev = NULL;
+
+	while (bpf_map_get_next_key(fd, prev, next) == 0) {
+		memcpy(cur, next, key_size);
+		prev = cur;
+		if (!memcmp(cur, key, key_size))
+			return bpf_map_lookup_elem(fd, cur, prefix);
+	}
+	return -1;
+}
+
+/* Share the maps xdp_loader pinned, as xdp_cpumap_user does, so the
+ * second stage installed for a class CPU uses the same tx_port and stats
+ */
+static int reuse_pinned_maps(struct bpf_object *obj, const char *pin_dir)
+{
+	char path[PATH_MAX];
+	struct bpf_map *map;
+	int fd;
+
+	bpf_object__for_each_map(map, obj) {
+		snprintf(path, PATH_MAX, "%s/%s", pin_dir, bpf_map__name(map));
+		fd = bpf_obj_get(path);
+		if (fd < 0) {
+			fprintf(stderr, "ERR: opening %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+		if (bpf_map__reuse_fd(map, fd))
+			return -1;
+	}
+	return 0;
+}
+
+/* Starts xdp_cpumap_router_func on cpu, unless it already runs there */
+static int cpu_map_add(int cpu_map_fd, const char *pin_dir, __u32 cpu)
+{
+	struct bpf_cpumap_val val = { .qsize = DEFAULT_QSIZE };
+	struct bpf_program *prog;
+	struct bpf_object *obj;
+	int err = 0;
+
+	if (bpf_map_lookup_elem(cpu_map_fd, &cpu, &val) == 0)
+		return 0;
+
+	obj = bpf_object__open_file("xdp_prog_kern.o", NULL);
+	if (libbpf_get_error(obj)) {
+		fprintf(stderr, "ERR: opening xdp_prog_kern.o\n");
+		return -1;
+	}
+	if (reuse_pinned_maps(obj, pin_dir) || bpf_object__load(obj)) {
+		fprintf(stderr, "ERR: loading xdp_prog_kern.o with maps from %s\n", pin_dir);
+		err = -1;
+		goto out;
+	}
+	prog = bpf_object__find_program_by_name(obj, "xdp_cpumap_router_func");
+	if (!prog) {
+		err = -1;
+		goto out;
+	}
+
+	/* The cpu_map entry holds a reference to the program */
+	val.qsize = DEFAULT_QSIZE;
+	val.bpf_prog.fd = bpf_program__fd(prog);
+	if (bpf_map_update_elem(cpu_map_fd, &cpu, &val, 0) < 0) {
+		fprintf(stderr, "ERR: adding cpu %u to cpu_map: %s\n", cpu, strerror(errno));
+		err = -1;
+	}
+out:
+	bpf_object__close(obj);
+	return err;
+}
+
+/* Drops cpu from cpu_map once neither xdp_cpumap_user nor another class
+ * uses it
+ */
+static void cpu_map_release(const char *pin_dir, int classes_fd, __u32 cpu)
+{
+	int cpu_map_fd, avail_fd, count_fd;
+	struct qos_class cls;
+	__u32 key, zero = 0;
+	__u32 count = 0, c;
+
+	for (key = 0; key < QOS_MAX_CLASSES; key++) {
+		if (bpf_map_lookup_elem(classes_fd, &key, &cls) == 0 &&
+		    (cls.flags & QOS_F_CPU) && cls.cpu == cpu)
+			return;
+	}
+
+	avail_fd = open_bpf_map_file(pin_dir, "cpus_available", NULL);
+	count_fd = open_bpf_map_file(pin_dir, "cpus_count", NULL);
+	cpu_map_fd = open_bpf_map_file(pin_dir, "cpu_map", NULL);
+	if (avail_fd < 0 || count_fd < 0 || cpu_map_fd < 0)
+		return;
+	bpf_map_lookup_elem(count_fd, &zero, &count);
+	for (key = 0; key < count; key++) {
+		if (bpf_map_lookup_elem(avail_fd, &key, &c) == 0 && c == cpu)
+			return;
+	}
+	bpf_map_delete_elem(cpu_map_fd, &cpu);
+}
+
+static int set_class(const char *pin_dir, int classes_fd, int argc, char **argv)
+{
+	struct qos_class cls = {};
+	__u32 id, old_cpu;
+	bool had_cpu;
+	int cpu_map_fd, arg;
+
+	if (parse_u32(argv[3], &id) < 0 || id >= QOS_MAX_CLASSES) {
+		fprintf(stderr, "ERR: invalid class %s\n", argv[3]);
+		return EXIT_FAIL_OPTION;
+	}
+	/* Only the given settings change */
+	bpf_map_lookup_elem(classes_fd, &id, &cls);
+	had_cpu = cls.flags & QOS_F_CPU;
+	old_cpu = cls.cpu;
+
+	for (arg = 4; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "keep")) {
+			cls.flags &= ~QOS_F_REMARK;
+			cls.dscp = 0;
+		} else if (!strcmp(argv[arg], "rss")) {
+			cls.flags &= ~QOS_F_CPU;
+			cls.cpu = 0;
+		} else if (arg + 1 == argc) {
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		} else if (!strcmp(argv[arg], "dscp")) {
+			if (parse_dscp(argv[++arg], &cls.dscp) < 0) {
+				fprintf(stderr, "ERR: invalid DSCP %s\n", argv[arg]);
+				return EXIT_FAIL_OPTION;
+			}
+			cls.flags |= QOS_F_REMARK;
+		} else if (!strcmp(argv[arg], "cpu")) {
+			if (parse_u32(argv[++arg], &cls.cpu) < 0 ||
+			    cls.cpu >= (__u32)libbpf_num_possible_cpus() ||
+			    cls.cpu >= CPUMAP_MAX_CPUS) {
+				fprintf(stderr, "ERR: invalid cpu %s\n", argv[arg]);
+				return EXIT_FAIL_OPTION;
+			}
+			cls.flags |= QOS_F_CPU;
+		} else {
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		}
+	}
+
+	/* The CPU's kthread first, then the class that steers to it */
+	if (cls.flags & QOS_F_CPU) {
+		cpu_map_fd = open_bpf_map_file(pin_dir, "cpu_map", NULL);
+		if (cpu_map_fd < 0 || cpu_map_add(cpu_map_fd, pin_dir, cls.cpu) < 0)
+			return EXIT_FAIL_BPF;
+	}
+	if (bpf_map_update_elem(classes_fd, &id, &cls, 0) < 0) {
+		fprintf(stderr, "ERR: updating class %u: %s\n", id, strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	if (had_cpu && (!(cls.flags & QOS_F_CPU) || cls.cpu != old_cpu))
+		cpu_map_release(pin_dir, classes_fd, old_cpu);
+	return EXIT_OK;
+}
+
+static int set_rule(int v4_fd, int v6_fd, int argc, char **argv)
+{
+	struct qos_port_rule rule = { .port_lo = 0, .port_hi = 65535 };
+	struct qos_prefix prefix = {};
+	struct qos_key6 key6;
+	struct lpm_key key4;
+	bool v6, have_class = false;
+	size_t key_size;
+	void *key;
+	__u32 id;
+	int fd, arg;
+
+	if (parse_prefix(argv[3], &key4, &key6, &v6) < 0) {
+		fprintf(stderr, "ERR: invalid prefix %s\n", argv[3]);
+		return EXIT_FAIL_OPTION;
+	}
+	fd = v6 ? v6_fd : v4_fd;
+	key = v6 ? (void *)&key6 : (void *)&key4;
+	key_size = v6 ? sizeof(key6) : sizeof(key4);
+
+	if (argc == 5 && !strcmp(argv[4], "del")) {
+		if (bpf_map_delete_elem(fd, key) < 0 && errno != ENOENT) {
+			fprintf(stderr, "ERR: deleting %s: %s\n", argv[3], strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+		return EXIT_OK;
+	}
+
+	for (arg = 4; arg + 1 < argc; arg += 2) {
+		if (!strcmp(argv[arg], "proto")) {
+			if (!strcmp(argv[arg + 1], "tcp"))
+				rule.ip_proto = IPPROTO_TCP;
+			else if (!strcmp(argv[arg + 1], "udp"))
+				rule.ip_proto = IPPROTO_UDP;
+			else {
+				fprintf(stderr, "ERR: invalid protocol %s\n", argv[arg + 1]);
+				return EXIT_FAIL_OPTION;
+			}
+		} else if (!strcmp(argv[arg], "port")) {
+			if (parse_ports(argv[arg + 1], &rule) < 0) {
+				fprintf(stderr, "ERR: invalid port range %s\n", argv[arg + 1]);
+				return EXIT_FAIL_OPTION;
+			}
+		} else if (!strcmp(argv[arg], "class")) {
+			if (parse_u32(argv[arg + 1], &id) < 0 || id >= QOS_MAX_CLASSES) {
+				fprintf(stderr, "ERR: invalid class %s\n", argv[arg + 1]);
+				return EXIT_FAIL_OPTION;
+			}
+			rule.class_id = id;
+			have_class = true;
+		} else {
+			break;
+		}
+	}
+	if (arg != argc || !have_class) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	find_prefix(fd, key, key_size, &prefix);
+	if (prefix.nr_rules >= QOS_PORT_RULES) {
+		fprintf(stderr, "ERR: %s already has %d rules\n", argv[3], QOS_PORT_RULES);
+		return EXIT_FAIL_OPTION;
+	}
+	prefix.rules[prefix.nr_rules++] = rule;
+	if (bpf_map_update_elem(fd, key, &prefix, 0) < 0) {
+		fprintf(stderr, "ERR: updating %s: %s\n", argv[3], strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	return EXIT_OK;
+}
+
+static void show_rules(const char *name, const struct qos_prefix *prefix)
+{
+	const struct qos_port_rule *rule;
+	__u32 i;
+
+	for (i = 0; i < prefix->nr_rules && i < QOS_PORT_RULES; i++) {
+		rule = &prefix->rules[i];
+		printf("%-43s %-4s ", i ? "" : name,
+		       rule->ip_proto == IPPROTO_TCP ? "tcp" :
+		       rule->ip_proto == IPPROTO_UDP ? "udp" : "any");
+		if (rule->port_lo == rule->port_hi)
+			printf("port %-11u", rule->port_lo);
+		else
+			printf("port %5u-%-5u", rule->port_lo, rule->port_hi);
+		printf(" class %u\n", rule->class_id);
+	}
+}
+
+static int show(int classes_fd, int stats_fd, int v4_fd, int v6_fd)
+{
+	unsigned int nr_cpus = libbpf_num_possible_cpus();
+	struct datarec values[nr_cpus];
+	char addr[INET6_ADDRSTRLEN], name[INET6_ADDRSTRLEN + 4];
+	struct qos_key6 key6, next6, *prev6 = NULL;
+	struct lpm_key key4, next4, *prev4 = NULL;
+	struct qos_prefix prefix;
+	struct qos_class cls;
+	__u64 packets, bytes;
+	__u32 id, cpu;
+
+	for (id = 0; id < QOS_MAX_CLASSES; id++) {
+		if (bpf_map_lookup_elem(classes_fd, &id, &cls) < 0)
+			continue;
+		packets = bytes = 0;
+		if (bpf_map_lookup_elem(stats_fd, &id, values) == 0) {
+			for (cpu = 0; cpu < nr_cpus; cpu++) {
+				packets += values[cpu].rx_packets;
+				bytes += values[cpu].rx_bytes;
+			}
+		}
+		printf("class %u  ", id);
+		if (cls.flags & QOS_F_REMARK)
+			printf("dscp %-4u", cls.dscp);
+		else
+			printf("dscp keep");
+		if (cls.flags & QOS_F_CPU)
+			printf("  cpu %-3u", cls.cpu);
+		else
+			printf("  cpu rss");
+		printf("  %llu pkts %llu bytes\n", packets, bytes);
+	}
+	printf("\n");
+
+	while (bpf_map_get_next_key(v4_fd, prev4, &next4) == 0) {
+		key4 = next4;
+		prev4 = &key4;
+		if (bpf_map_lookup_elem(v4_fd, &key4, &prefix))
+			continue;
+		inet_ntop(AF_INET, &key4.addr, addr, sizeof(addr));
+		snprintf(name, sizeof(name), "%s/%u", addr, key4.prefixlen);
+		show_rules(name, &prefix);
+	}
+	while (bpf_map_get_next_key(v6_fd, prev6, &next6) == 0) {
+		key6 = next6;
+		prev6 = &key6;
+		if (bpf_map_lookup_elem(v6_fd, &key6, &prefix))
+			continue;
+		inet_ntop(AF_INET6, key6.addr, addr, sizeof(addr));
+		snprintf(name, sizeof(name), "%s/%u", addr, key6.prefixlen);
+		show_rules(name, &prefix);
+	}
+	return EXIT_OK;
+}
+
+int main(int argc, char **argv)
+{
+	int classes_fd, stats_fd, v4_fd, v6_fd;
+	char pin_dir[PATH_MAX];
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[1]);
+	classes_fd = open_bpf_map_file(pin_dir, "qos_classes", NULL);
+	stats_fd = open_bpf_map_file(pin_dir, "qos_stats", NULL);
+	v4_fd = open_bpf_map_file(pin_dir, "qos_rules_v4", NULL);
+	v6_fd = open_bpf_map_file(pin_dir, "qos_rules_v6", NULL);
+	if (classes_fd < 0 || stats_fd < 0 || v4_fd < 0 || v6_fd < 0)
+		return EXIT_FAIL_BPF;
+
+	if (argc == 3 && !strcmp(argv[2], "show"))
+		return show(classes_fd, stats_fd, v4_fd, v6_fd);
+	if (argc >= 4 && !strcmp(argv[2], "class"))
+		return set_class(pin_dir, classes_fd, argc, argv);
+	if (argc >= 5 && !strcmp(argv[2], "rule"))
+		return set_rule(v4_fd, v6_fd, argc, argv);
+
+	usage(argv[0]);
+	return EXIT_FAIL_OPTION;
+}
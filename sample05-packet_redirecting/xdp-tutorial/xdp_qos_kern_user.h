@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Used by xdp_qos_func (kernel side) and by xdp_qos and xdp_cpumap_user
+ * (userspace), for sharing the classification maps layout.
+ */
+#ifndef __XDP_QOS_KERN_USER_H
+#define __XDP_QOS_KERN_USER_H
+
+#define QOS_MAX_PREFIXES	16384
+#define QOS_MAX_CLASSES		8
+#define QOS_PORT_RULES		8
+#define QOS_CLASS_DEFAULT	0	/* no prefix or rule matched */
+
+/* Key of the qos_rules_v6 map (qos_rules_v4 uses struct lpm_key) */
+struct qos_key6 {
+	__u32 prefixlen;
+	__u32 addr[4];		/* network byte order */
+};
+
+/* Destination port range, host byte order. Packets without ports (not
+ * TCP/UDP, later fragments) have port 0.
+ */
+struct qos_port_rule {
+	__u16 port_lo;
+	__u16 port_hi;
+	__u8 ip_proto;		/* IPPROTO_TCP / IPPROTO_UDP, 0: any */
+	__u8 class_id;
+	__u16 pad;
+};
+
+/* Value of the qos_rules_v4/v6 maps, keyed by destination prefix. The
+ * first matching rule gives the class; none matching is QOS_CLASS_DEFAULT.
+ */
+struct qos_prefix {
+	__u32 nr_rules;
+	struct qos_port_rule rules[QOS_PORT_RULES];
+};
+
+/* struct qos_class flags */
+#define QOS_F_REMARK		(1U << 0)	/* rewrite DSCP to dscp */
+#define QOS_F_CPU		(1U << 1)	/* steer to cpu, not by flow hash */
+
+/* Value of the qos_classes map, indexed by class id */
+struct qos_class {
+	__u8 dscp;		/* 0-63 */
+	__u8 flags;		/* QOS_F_* */
+	__u16 pad;
+	__u32 cpu;		/* cpu_map entry reserved for the class */
+};
+
+#endif /* __XDP_QOS_KERN_USER_H */
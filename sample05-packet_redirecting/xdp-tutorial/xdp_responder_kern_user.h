@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Used by xdp_icmp_echo_func (kernel side) and by xdp_vip (userspace),
+ * for sharing the VIP table layout.
+ */
+#ifndef __XDP_RESPONDER_KERN_USER_H
+#define __XDP_RESPONDER_KERN_USER_H
+
+#define VIP_MAX_ENTRIES		1024
+
+/* Replies per second and back to back replies per VIP, unless xdp_vip
+ * is told otherwise
+ */
+#define VIP_DEFAULT_RATE	10000
+#define VIP_DEFAULT_BURST	1000
+
+/* Key of the vips map */
+struct vip_key {
+	__u32 family;		/* AF_INET or AF_INET6 */
+	__u32 addr[4];		/* IPv4 uses addr[0], network byte order */
+};
+
+/* struct vip_entry flags */
+#define VIP_F_ECHO		(1U << 0)	/* answer ICMP / ICMPv6 echo */
+#define VIP_F_NEIGH		(1U << 1)	/* answer ARP / neighbor solicitation */
+
+/* Value of the vips map. The limiter is a GCRA: a reply is allowed while
+ * tat (the time the VIP's budget is used up to) is at most burst_ns
+ * ahead of now, and moves tat interval_ns further.
+ */
+struct vip_entry {
+	unsigned char mac[6];	/* ARP / NA answer, source of every reply */
+	__u16 flags;		/* VIP_F_* */
+	__u32 rate;		/* replies per second, 0: unlimited */
+	__u32 burst;
+	__u32 pad;
+	__u64 interval_ns;	/* 1s / rate */
+	__u64 burst_ns;		/* (burst - 1) * interval_ns */
+	__u64 tat;		/* bpf_ktime_get_ns(), written by the program */
+};
+
+/* responder_stats map indexes, a struct datarec per CPU each */
+#define RESP_STAT_ECHO		0	/* ICMP echo replies */
+#define RESP_STAT_ECHO6		1	/* ICMPv6 echo replies */
+#define RESP_STAT_ARP		2	/* ARP replies */
+#define RESP_STAT_NA		3	/* neighbor advertisements */
+#define RESP_STAT_LIMITED	4	/* over the VIP rate, dropped */
+#define RESP_STAT_MAX		5
+
+#endif /* __XDP_RESPONDER_KERN_USER_H */
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Used by xdp_router_func (kernel side) and by its userspace tools,
+ * for sharing the router maps layout.
+ */
+#ifndef __XDP_ROUTER_KERN_USER_H
+#define __XDP_ROUTER_KERN_USER_H
+
+#define VRF_MAX_ENTRIES		1024
+
+/* Key of the vrf_tables map: ingress port, or one VLAN on it.
+ * vlan_id 0 is the untagged traffic of the port.
+ */
+struct vrf_key {
+	__u32 ifindex;
+	__u16 vlan_id;
+	__u16 pad;
+};
+
+#define FIB_STATS_MAX		4096
+
+/* fib_stats results beyond the BPF_FIB_LKUP_RET_* codes */
+#define FIB_STAT_NO_LOOKUP	0x100	/* not IP, QinQ, or tagged without a VRF */
+#define FIB_STAT_TTL		0x101	/* TTL / hop limit expired */
+#define FIB_STAT_NO_TX_PORT	0x102	/* egress port not in tx_port */
+#define FIB_STAT_NEIGH_LIMITED	0x103	/* NO_NEIGH, dropped by the neigh_pending limit */
+
+/* Key of the fib_stats map, value is a struct datarec per CPU.
+ * out_ifindex is 0 when the lookup didn't pick an egress port.
+ */
+struct fib_stats_key {
+	__u32 in_ifindex;
+	__u32 out_ifindex;
+	__u32 result;		/* BPF_FIB_LKUP_RET_* or FIB_STAT_* */
+};
+
+/* While a next hop's neighbour is unresolved, one frame per
+ * NEIGH_RETRY_NS is passed to the kernel (to queue it and retry ARP/ND)
+ * and the rest are dropped
+ */
+#define NEIGH_PENDING_MAX	1024
+#define NEIGH_RETRY_NS		100000000ULL	/* 100ms */
+
+/* Key of the neigh_pending map: the next hop bpf_fib_lookup() returned
+ * with NO_NEIGH. Value is the __u64 time the last frame was passed.
+ */
+struct neigh_key {
+	__u32 ifindex;
+	__u32 family;		/* AF_INET or AF_INET6 */
+	__u32 addr[4];		/* IPv4 uses addr[0], network byte order */
+};
+
+#define PORT_VLAN_MAX		256
+
+#define PORT_F_SMAC		(1U << 0)	/* rewrite the source MAC to smac */
+
+/* Value of the port_vlan map, keyed by the egress ifindex the FIB
+ * returned (a VLAN subinterface, or a physical port). Applied by the
+ * xdp_egress_vlan_func devmap program of that port.
+ */
+struct port_vlan {
+	__u16 vlan_id;		/* 0: send untagged */
+	__u16 flags;		/* PORT_F_* */
+	unsigned char smac[6];
+	__u16 pad;
+};
+
+#endif /* __XDP_ROUTER_KERN_USER_H */
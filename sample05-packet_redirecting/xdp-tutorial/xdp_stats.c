@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 static const char *__doc__ = "XDP stats program\n"
-	" - Finding xdp_stats_map via --dev name info\n";
+	" - Finding xdp_stats_map via --dev name info\n"
+	" - With --fib, shows the router's fib_stats per (in, out, lookup result)\n"
+	"   and flags rising slow-path (passed to the kernel) rates\n";
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,6 +27,8 @@ static const char *__doc__ = "XDP stats program\n"
 #include "./common/common_user_bpf_xdp.h"
 #include "./common/xdp_stats_kern_user.h"
 
+#include "xdp_router_kern_user.h"
+
 static const struct option_wrapper long_options[] = {
 	{{"help",        no_argument,		NULL, 'h' },
 	 "Show help", false},
@@ -35,6 +39,9 @@ static const struct option_wrapper long_options[] = {
 	{{"quiet",       no_argument,		NULL, 'q' },
 	 "Quiet mode (no output)"},
 
+	{{"fib",         no_argument,		NULL, 5 },
+	 "Show per-interface FIB result rates (xdp_router_func)"},
+
 	{{0, 0, NULL,  0 }}
 };
 
@@ -227,6 +234,194 @@ static int stats_poll(const char *pin_dir, int map_fd, __u32 id,
 	return 0;
 }
 
+/* --fib: fib_stats map, one record per (in, out, result) */
+struct fib_record {
+	struct fib_stats_key key;
+	struct datarec total;
+	double pps;
+};
+
+struct fib_stats_record {
+	__u64 timestamp;
+	bool rated;	/* pps filled in, can be compared against */
+	int count;
+	struct fib_record recs[FIB_STATS_MAX];
+};
+
+/* A slow-path row is flagged when it is at least this busy and grew by
+ * at least SLOW_PATH_GROWTH since the previous period
+ */
+#define SLOW_PATH_MIN_PPS	100
+#define SLOW_PATH_GROWTH	1.5
+
+static const char *fib_result2str(__u32 result)
+{
+	switch (result) {
+	case BPF_FIB_LKUP_RET_SUCCESS:		return "SUCCESS";
+	case BPF_FIB_LKUP_RET_BLACKHOLE:	return "BLACKHOLE";
+	case BPF_FIB_LKUP_RET_UNREACHABLE:	return "UNREACHABLE";
+	case BPF_FIB_LKUP_RET_PROHIBIT:		return "PROHIBIT";
+	case BPF_FIB_LKUP_RET_NOT_FWDED:	return "NOT_FWDED";
+	case BPF_FIB_LKUP_RET_FWD_DISABLED:	return "FWD_DISABLED";
+	case BPF_FIB_LKUP_RET_UNSUPP_LWT:	return "UNSUPP_LWT";
+	case BPF_FIB_LKUP_RET_NO_NEIGH:		return "NO_NEIGH";
+	case BPF_FIB_LKUP_RET_FRAG_NEEDED:	return "FRAG_NEEDED";
+	case FIB_STAT_NO_LOOKUP:		return "NO_LOOKUP";
+	case FIB_STAT_TTL:			return "TTL_EXPIRED";
+	case FIB_STAT_NO_TX_PORT:		return "NO_TX_PORT";
+	case FIB_STAT_NEIGH_LIMITED:		return "NEIGH_LIMITED";
+	default:				return "UNKNOWN";
+	}
+}
+
+/* Everything but forwarded and dropped traffic ends up in the kernel */
+static bool fib_result_is_slow_path(__u32 result)
+{
+	switch (result) {
+	case BPF_FIB_LKUP_RET_SUCCESS:
+	case BPF_FIB_LKUP_RET_BLACKHOLE:
+	case BPF_FIB_LKUP_RET_UNREACHABLE:
+	case BPF_FIB_LKUP_RET_PROHIBIT:
+	case FIB_STAT_NEIGH_LIMITED:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static int fib_key_cmp(const void *a, const void *b)
+{
+	return memcmp(&((const struct fib_record *)a)->key,
+		      &((const struct fib_record *)b)->key,
+		      sizeof(struct fib_stats_key));
+}
+
+static void fib_stats_collect(int map_fd, struct fib_stats_record *rec)
+{
+	unsigned int nr_cpus = libbpf_num_possible_cpus();
+	struct datarec values[nr_cpus];
+	struct fib_stats_key key, *prev_key = NULL;
+	struct fib_record *r;
+	int i;
+
+	rec->timestamp = gettime();
+	rec->rated = false;
+	rec->count = 0;
+
+	while (rec->count < FIB_STATS_MAX &&
+	       bpf_map_get_next_key(map_fd, prev_key, &key) == 0) {
+		prev_key = &rec->recs[rec->count].key;
+		r = &rec->recs[rec->count];
+		r->key = key;
+		if (bpf_map_lookup_elem(map_fd, &key, values) != 0)
+			continue;
+
+		/* Sum values from each CPU */
+		r->total.rx_packets = 0;
+		r->total.rx_bytes = 0;
+		for (i = 0; i < nr_cpus; i++) {
+			r->total.rx_packets += values[i].rx_packets;
+			r->total.rx_bytes   += values[i].rx_bytes;
+		}
+		r->pps = 0;
+		rec->count++;
+	}
+
+	/* Sorted, so rows keep their order and the previous period's
+	 * record can be found with bsearch()
+	 */
+	qsort(rec->recs, rec->count, sizeof(rec->recs[0]), fib_key_cmp);
+}
+
+static void fib_stats_print(struct fib_stats_record *rec,
+			    struct fib_stats_record *prev)
+{
+	char in[IF_NAMESIZE], out[IF_NAMESIZE];
+	double period, slow_pps = 0, prev_slow_pps = 0;
+	struct fib_record *r, *p;
+	__u64 packets, bytes;
+	bool rising;
+	int i;
+
+	period = (double)(rec->timestamp - prev->timestamp) / NANOSEC_PER_SEC;
+	if (period <= 0)
+		return;
+
+	printf("%-10s %-10s %-12s %14s %12s %10s\n",
+	       "in", "out", "result", "pkts", "pps", "Mbits/s");
+
+	for (i = 0; i < rec->count; i++) {
+		r = &rec->recs[i];
+		p = bsearch(r, prev->recs, prev->count, sizeof(prev->recs[0]), fib_key_cmp);
+
+		packets = r->total.rx_packets - (p ? p->total.rx_packets : 0);
+		bytes   = r->total.rx_bytes   - (p ? p->total.rx_bytes : 0);
+		r->pps  = packets / period;
+
+		if (!if_indextoname(r->key.in_ifindex, in))
+			snprintf(in, sizeof(in), "#%u", r->key.in_ifindex);
+		if (!r->key.out_ifindex)
+			snprintf(out, sizeof(out), "-");
+		else if (!if_indextoname(r->key.out_ifindex, out))
+			snprintf(out, sizeof(out), "#%u", r->key.out_ifindex);
+
+		rising = false;
+		if (fib_result_is_slow_path(r->key.result)) {
+			slow_pps += r->pps;
+			if (p)
+				prev_slow_pps += p->pps;
+			rising = prev->rated && r->pps >= SLOW_PATH_MIN_PPS &&
+				 r->pps > (p ? p->pps : 0) * SLOW_PATH_GROWTH;
+		}
+
+		printf("%-10s %-10s %-12s %'14llu %'12.0f %10.2f%s\n",
+		       in, out, fib_result2str(r->key.result),
+		       r->total.rx_packets, r->pps, (bytes * 8) / period / 1000000,
+		       rising ? "  <- slow path rising" : "");
+	}
+
+	rec->rated = true;
+
+	printf("slow path (passed to kernel): %'.0f pps", slow_pps);
+	if (prev->rated && slow_pps >= SLOW_PATH_MIN_PPS && slow_pps > prev_slow_pps * SLOW_PATH_GROWTH)
+		printf("  WARN: up from %'.0f pps", prev_slow_pps);
+	printf("\n\n");
+}
+
+static int fib_stats_poll(const char *pin_dir, int map_fd, __u32 id, int interval)
+{
+	static struct fib_stats_record bufs[2];
+	struct fib_stats_record *rec = &bufs[0], *prev = &bufs[1], *tmp;
+	struct bpf_map_info info = {};
+
+	setlocale(LC_NUMERIC, "en_US");
+
+	fib_stats_collect(map_fd, prev);
+	sleep(interval);
+
+	while (1) {
+		map_fd = open_bpf_map_file(pin_dir, "fib_stats", &info);
+		if (map_fd < 0) {
+			return EXIT_FAIL_BPF;
+		} else if (id != info.id) {
+			printf("BPF map fib_stats changed its ID, restarting\n");
+			close(map_fd);
+			return 0;
+		}
+
+		fib_stats_collect(map_fd, rec);
+		fib_stats_print(rec, prev);
+		close(map_fd);
+
+		tmp = prev;
+		prev = rec;
+		rec = tmp;
+		sleep(interval);
+	}
+
+	return 0;
+}
+
 #ifndef PATH_MAX
 #define PATH_MAX	4096
 #endif
@@ -281,6 +476,17 @@ int main(int argc, char **argv)
 	return EXIT_FAIL_OPTION;
 	}
 
+	while (cfg.fib_stats) {
+		stats_map_fd = open_bpf_map_file(pin_dir, "fib_stats", &info);
+		if (stats_map_fd < 0)
+			return EXIT_FAIL_BPF;
+
+		err = fib_stats_poll(pin_dir, stats_map_fd, info.id, interval);
+		close(stats_map_fd);
+		if (err)
+			return err;
+	}
+
 	for ( ;; ) {
 		stats_map_fd = open_bpf_map_file(pin_dir, "xdp_stats_map", &info);
 		if (stats_map_fd < 0) {
@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP VIP responder table\n"
+	" - Sets the addresses xdp_icmp_echo_func on <ifname> answers ICMP /\n"
+	"   ICMPv6 echo, ARP and neighbor solicitations for, and the rate of\n"
+	"   replies each of them gets; requests over it are dropped\n"
+	" - Uses the maps xdp_loader pinned under /sys/fs/bpf/<ifname>\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h> /* libbpf_num_possible_cpus */
+
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+
+#include "./common/common_defines.h"
+#include "./common/common_user_bpf_xdp.h"
+#include "./common/xdp_stats_kern_user.h"
+
+#include "xdp_responder_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+static const char *stat_names[RESP_STAT_MAX] = {
+	[RESP_STAT_ECHO]	= "echo",
+	[RESP_STAT_ECHO6]	= "echo6",
+	[RESP_STAT_ARP]		= "arp",
+	[RESP_STAT_NA]		= "na",
+	[RESP_STAT_LIMITED]	= "limited",
+};
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s <ifname> add <addr> [mac <mac>] [rate <pps>] [burst <n>] [echo|neigh]\n", prog);
+	printf("       %s <ifname> del <addr>\n", prog);
+	printf("       %s <ifname> show\n\n", prog);
+	printf("  mac   answer ARP / NS with this address (default: the one of <ifname>)\n");
+	printf("  rate  replies per second for this VIP, 0 for no limit (default %d)\n", VIP_DEFAULT_RATE);
+	printf("  burst replies allowed back to back (default %d)\n", VIP_DEFAULT_BURST);
+	printf("  echo  answer only echo requests, neigh only ARP / NS (default both)\n\n");
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+static int parse_mac(const char *str, unsigned char mac[ETH_ALEN])
+{
+	char end;
+
+	if (sscanf(str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx%c", &mac[0], &mac[1],
+		   &mac[2], &mac[3], &mac[4], &mac[5], &end) != 6)
+		return -1;
+	return 0;
+}
+
+static int parse_vip(const char *str, struct vip_key *key)
+{
+	memset(key, 0, sizeof(*key));
+	if (inet_pton(AF_INET, str, key->addr) == 1) {
+		key->family = AF_INET;
+		return 0;
+	}
+	if (inet_pton(AF_INET6, str, key->addr) == 1) {
+		key->family = AF_INET6;
+		return 0;
+	}
+	return -1;
+}
+
+static int parse_u32(const char *str, __u32 *val)
+{
+	char *end;
+	long v;
+
+	v = strtol(str, &end, 10);
+	if (end == str || *end || v < 0 || v > 0xffffffffL)
+		return -1;
+	*val = v;
+	return 0;
+}
+
+static int port_mac(const char *port, unsigned char mac[ETH_ALEN])
+{
+	char path[PATH_MAX], buf[32];
+	FILE *f;
+	int err;
+
+	snprintf(path, PATH_MAX, "/sys/class/net/%s/address", port);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	err = fgets(buf, sizeof(buf), f) ? 0 : -1;
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	return err ? err : parse_mac(buf, mac);
+}
+
+static int show(int vips_fd, int stats_fd)
+{
+	unsigned int nr_cpus = libbpf_num_possible_cpus();
+	struct datarec values[nr_cpus];
+	struct vip_key key, next;
+	struct vip_key *prev = NULL;
+	char addr[INET6_ADDRSTRLEN];
+	struct vip_entry vip;
+	__u64 packets;
+	__u32 i, cpu;
+
+	while (bpf_map_get_next_key(vips_fd, prev, &next) == 0) {
+		key = next;
+		prev = &key;
+		if (bpf_map_lookup_elem(vips_fd, &key, &vip))
+			continue;
+		inet_ntop(key.family, key.addr, addr, sizeof(addr));
+		printf("%-39s mac %02x:%02x:%02x:%02x:%02x:%02x %s%s ", addr,
+		       vip.mac[0], vip.mac[1], vip.mac[2], vip.mac[3], vip.mac[4], vip.mac[5],
+		       vip.flags & VIP_F_ECHO ? "echo " : "",
+		       vip.flags & VIP_F_NEIGH ? (key.family == AF_INET ? "arp" : "nd") : "");
+		if (vip.rate)
+			printf("rate %u/s burst %u\n", vip.rate, vip.burst);
+		else
+			printf("unlimited\n");
+	}
+
+	for (i = 0; i < RESP_STAT_MAX; i++) {
+		if (bpf_map_lookup_elem(stats_fd, &i, values) < 0)
+			continue;
+		packets = 0;
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			packets += values[cpu].rx_packets;
+		printf("%s%s %llu", i ? "  " : "\n", stat_names[i], packets);
+	}
+	printf("\n");
+	return EXIT_OK;
+}
+
+int main(int argc, char **argv)
+{
+	struct vip_entry vip = {
+		.flags = VIP_F_ECHO | VIP_F_NEIGH,
+		.rate = VIP_DEFAULT_RATE,
+		.burst = VIP_DEFAULT_BURST,
+	};
+	char pin_dir[PATH_MAX];
+	int vips_fd, stats_fd, arg;
+	struct vip_key key;
+	int have_mac = 0;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[1]);
+	vips_fd = open_bpf_map_file(pin_dir, "vips", NULL);
+	stats_fd = open_bpf_map_file(pin_dir, "responder_stats", NULL);
+	if (vips_fd < 0 || stats_fd < 0)
+		return EXIT_FAIL_BPF;
+
+	if (argc == 3 && !strcmp(argv[2], "show"))
+		return show(vips_fd, stats_fd);
+
+	if (argc < 4 || parse_vip(argv[3], &key) < 0) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	if (argc == 4 && !strcmp(argv[2], "del")) {
+		if (bpf_map_delete_elem(vips_fd, &key) < 0 && errno != ENOENT) {
+			fprintf(stderr, "ERR: deleting %s: %s\n", argv[3], strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+		return EXIT_OK;
+	}
+	if (strcmp(argv[2], "add")) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	for (arg = 4; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "echo")) {
+			vip.flags = VIP_F_ECHO;
+		} else if (!strcmp(argv[arg], "neigh")) {
+			vip.flags = VIP_F_NEIGH;
+		} else if (arg + 1 == argc) {
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		} else if (!strcmp(argv[arg], "mac")) {
+			if (parse_mac(argv[++arg], vip.mac) < 0) {
+				fprintf(stderr, "ERR: invalid MAC address %s\n", argv[arg]);
+				return EXIT_FAIL_OPTION;
+			}
+			have_mac = 1;
+		} else if (!strcmp(argv[arg], "rate")) {
+			if (parse_u32(argv[++arg], &vip.rate) < 0 || vip.rate > 1000000000) {
+				fprintf(stderr, "ERR: invalid rate %s\n", argv[arg]);
+				return EXIT_FAIL_OPTION;
+			}
+		} else if (!strcmp(argv[arg], "burst")) {
+			if (parse_u32(argv[++arg], &vip.burst) < 0 || !vip.burst) {
+				fprintf(stderr, "ERR: invalid burst %s\n", argv[arg]);
+				return EXIT_FAIL_OPTION;
+			}
+		} else {
+			usage(argv[0]);
+			return EXIT_FAIL_OPTION;
+		}
+	}
+	if (!have_mac && port_mac(argv[1], vip.mac) < 0) {
+		fprintf(stderr, "ERR: can't read the MAC address of %s, use mac\n", argv[1]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	/* The program only adds and compares, no division per packet */
+	if (vip.rate) {
+		vip.interval_ns = 1000000000ULL / vip.rate;
+		vip.burst_ns = (__u64)(vip.burst - 1) * vip.interval_ns;
+	}
+
+	/* Rewriting an entry also resets its limiter */
+	if (bpf_map_update_elem(vips_fd, &key, &vip, 0) < 0) {
+		fprintf(stderr, "ERR: updating %s: %s\n", argv[3], strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	return EXIT_OK;
+}
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+static const char *__doc__ = "XDP router VRF selection\n"
+	" - Sets the routing table xdp_router_func looks up for traffic\n"
+	"   arriving on <ifname> (untagged, or one VLAN of it)\n"
+	" - Uses the vrf_tables map xdp_loader pinned under /sys/fs/bpf/<ifname>\n";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <bpf/bpf.h>
+
+#include <net/if.h>
+
+#include "./common/common_defines.h"
+#include "./common/common_user_bpf_xdp.h"
+
+#include "xdp_router_kern_user.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	4096
+#endif
+
+#define RT_TABLE_MAIN	254
+
+const char *pin_basedir = "/sys/fs/bpf";
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s <ifname> [vlan <id>] table <id|main>\n", prog);
+	printf("       %s <ifname> [vlan <id>] del\n", prog);
+	printf("       %s <ifname> show\n\n", prog);
+	printf("DOCUMENTATION:\n %s\n", __doc__);
+}
+
+static int show(int map_fd)
+{
+	struct vrf_key key, next;
+	struct vrf_key *prev = NULL;
+	char ifname[IF_NAMESIZE];
+	__u32 tbid;
+
+	while (bpf_map_get_next_key(map_fd, prev, &next) == 0) {
+		if (bpf_map_lookup_elem(map_fd, &next, &tbid) == 0) {
+			if (!if_indextoname(next.ifindex, ifname))
+				snprintf(ifname, sizeof(ifname), "#%u", next.ifindex);
+			if (next.vlan_id)
+				printf("%s vlan %-4u table %u\n", ifname, next.vlan_id, tbid);
+			else
+				printf("%s           table %u\n", ifname, tbid);
+		}
+		key = next;
+		prev = &key;
+	}
+	return EXIT_OK;
+}
+
+int main(int argc, char **argv)
+{
+	struct vrf_key key = {};
+	char pin_dir[PATH_MAX];
+	int map_fd, arg = 2;
+	char *end;
+	long val;
+	__u32 tbid;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+	key.ifindex = if_nametoindex(argv[1]);
+	if (!key.ifindex) {
+		fprintf(stderr, "ERR: unknown interface %s\n", argv[1]);
+		return EXIT_FAIL_OPTION;
+	}
+
+	snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, argv[1]);
+	map_fd = open_bpf_map_file(pin_dir, "vrf_tables", NULL);
+	if (map_fd < 0)
+		return EXIT_FAIL_BPF;
+
+	if (!strcmp(argv[arg], "show"))
+		return show(map_fd);
+
+	if (!strcmp(argv[arg], "vlan") && arg + 1 < argc) {
+		val = strtol(argv[arg + 1], &end, 10);
+		if (*end || val < 1 || val > 4094) {
+			fprintf(stderr, "ERR: invalid VLAN id %s\n", argv[arg + 1]);
+			return EXIT_FAIL_OPTION;
+		}
+		key.vlan_id = val;
+		arg += 2;
+	}
+
+	if (arg + 1 == argc && !strcmp(argv[arg], "del")) {
+		if (bpf_map_delete_elem(map_fd, &key) < 0 && errno != ENOENT) {
+			fprintf(stderr, "ERR: deleting vrf entry: %s\n", strerror(errno));
+			return EXIT_FAIL_BPF;
+		}
+		return EXIT_OK;
+	}
+
+	if (arg + 2 != argc || strcmp(argv[arg], "table")) {
+		usage(argv[0]);
+		return EXIT_FAIL_OPTION;
+	}
+	if (!strcmp(argv[arg + 1], "main")) {
+		tbid = RT_TABLE_MAIN;
+	} else {
+		val = strtol(argv[arg + 1], &end, 10);
+		if (*end || val <= 0 || val > 0xffffffffL) {
+			fprintf(stderr, "ERR: invalid table id %s\n", argv[arg + 1]);
+			return EXIT_FAIL_OPTION;
+		}
+		tbid = val;
+	}
+
+	if (bpf_map_update_elem(map_fd, &key, &tbid, 0) < 0) {
+		fprintf(stderr, "ERR: updating vrf entry: %s\n", strerror(errno));
+		return EXIT_FAIL_BPF;
+	}
+	return EXIT_OK;
+}
@@ -20,10 +20,17 @@ fi
 
 echo "Found Router MAC: $ROUTER_MAC"
 
-# 3. 로더 실행 (추출한 MAC 사용)
-sudo ./loader eth0 192.168.10.1 10.111.222.11 $ROUTER_MAC
-
 # rp_filter 해제
 sysctl -w net.ipv4.conf.all.rp_filter=0
 
+# 3. 설정 파일 작성 (추출한 MAC 사용)
+# 실행 중에 이 파일을 고치면 lbd 가 바로 다시 읽어서 반영합니다.
+cat > /tmp/lb.conf <<EOF
+gateway $ROUTER_MAC
+vip 192.168.10.1 10.111.222.11
+EOF
+
+# 4. 제어 데몬 실행
+sudo ./lbd eth0 /tmp/lb.conf &
+
 tail -f /dev/null
\ No newline at end of file
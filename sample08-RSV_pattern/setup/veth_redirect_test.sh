@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Real 별 다음 홉(devmap redirect) 확인용 veth 테스트 (root 권한 필요, docker 없이 호스트에서 실행)
+#
+#   client (c0) ---- (l0) lb (l1) ---- (r1) real1
+#                            (l2) ---- (r2) real2
+#
+# client 가 VIP 로 보낸 UDP 패킷을 lb 가 l0 에서 받아 캡슐화한 뒤
+# Router 를 거치지 않고 l1 / l2 로 바로 redirect 하는지, 두 Real 에 모두 도착하는지 확인합니다.
+#
+# 사용법: cd xdp && make && sudo ../setup/veth_redirect_test.sh [패킷 수]
+
+COUNT=${1:-200}
+VIP=192.168.10.1
+PORT=5000
+NS="lbt-client lbt-lb lbt-real1 lbt-real2"
+
+cleanup() {
+    kill $LBD_PID 2>/dev/null
+    wait $LBD_PID 2>/dev/null
+    for ns in $NS; do ip netns del $ns 2>/dev/null; done
+    rm -f /tmp/lbt.conf
+}
+trap cleanup EXIT
+
+if [ ! -x ./lbd ] || [ ! -f ./xdp_lb.o ]; then
+    echo "Error: run from the xdp directory after 'make'"
+    exit 1
+fi
+
+# 1. 네임스페이스 + veth 구성
+for ns in $NS; do ip netns add $ns; done
+ip link add c0 netns lbt-client type veth peer name l0 netns lbt-lb
+ip link add r1 netns lbt-real1 type veth peer name l1 netns lbt-lb
+ip link add r2 netns lbt-real2 type veth peer name l2 netns lbt-lb
+
+ip -n lbt-client addr add 10.0.0.2/24 dev c0
+ip -n lbt-lb addr add 10.0.0.1/24 dev l0
+ip -n lbt-lb addr add 10.1.1.1/24 dev l1
+ip -n lbt-real1 addr add 10.1.1.2/24 dev r1
+ip -n lbt-lb addr add 10.1.2.1/24 dev l2
+ip -n lbt-real2 addr add 10.1.2.2/24 dev r2
+for ns in $NS; do ip -n $ns link set lo up; done
+ip -n lbt-client link set c0 up
+ip -n lbt-lb link set l0 up
+ip -n lbt-lb link set l1 up
+ip -n lbt-lb link set l2 up
+ip -n lbt-real1 link set r1 up
+ip -n lbt-real2 link set r2 up
+ip -n lbt-client route add $VIP/32 via 10.0.0.1
+
+# redirect 로 veth 에 보낸 패킷은 받는 쪽(peer)에 NAPI 가 있어야 처리됨 (GRO 를 켜면 생김)
+ip netns exec lbt-real1 ethtool -K r1 gro on > /dev/null
+ip netns exec lbt-real2 ethtool -K r2 gro on > /dev/null
+
+R1_MAC=$(ip netns exec lbt-real1 cat /sys/class/net/r1/address)
+R2_MAC=$(ip netns exec lbt-real2 cat /sys/class/net/r2/address)
+C0_MAC=$(ip netns exec lbt-client cat /sys/class/net/c0/address)
+
+# 2. lbd 실행 (l0 에 붙이고, Real 마다 다음 홉 인터페이스 지정)
+cat > /tmp/lbt.conf <<EOF
+gateway $C0_MAC
+vip $VIP:$PORT/udp 10.1.1.2 10.1.2.2
+real 10.1.1.2 dev l1 gw $R1_MAC
+real 10.1.2.2 dev l2 gw $R2_MAC
+EOF
+
+# ip netns exec 는 /sys 를 새로 마운트하므로 lbd 가 맵을 고정할 bpffs 도 다시 마운트
+ip netns exec lbt-lb sh -c "mount -t bpf bpf /sys/fs/bpf && exec ./lbd l0 /tmp/lbt.conf" &
+LBD_PID=$!
+sleep 2
+
+rx() {
+    ip netns exec $1 cat /sys/class/net/$2/statistics/rx_packets
+}
+
+R1_BEFORE=$(rx lbt-real1 r1)
+R2_BEFORE=$(rx lbt-real2 r2)
+
+# 3. 소스 포트를 바꿔가며 VIP 로 UDP 전송 (흐름마다 Real 이 갈림)
+# 첫 패킷 전에 client 가 l0 의 ARP 를 풀어야 하므로 ping 한 번
+ip netns exec lbt-client ping -c 1 -W 1 10.0.0.1 > /dev/null
+ip netns exec lbt-client bash -c "for i in \$(seq $COUNT); do echo x > /dev/udp/$VIP/$PORT; done"
+sleep 1
+
+R1=$(( $(rx lbt-real1 r1) - R1_BEFORE ))
+R2=$(( $(rx lbt-real2 r2) - R2_BEFORE ))
+echo "sent $COUNT, real1 (via l1) received $R1, real2 (via l2) received $R2"
+
+if [ $R1 -gt 0 ] && [ $R2 -gt 0 ] && [ $((R1 + R2)) -ge $COUNT ]; then
+    echo "PASS"
+    exit 0
+fi
+echo "FAIL"
+exit 1
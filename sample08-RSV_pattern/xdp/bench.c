@@ -0,0 +1,155 @@
+// bench.c
+// BPF_PROG_TEST_RUN 으로 XDP LB 프로그램의 패킷당 처리 시간을 측정합니다.
+//
+// 사용법: ./bench [반복 횟수]
+//  - xdp_lb.o           : 템플릿 복사 + 증분 체크섬 (기본 빌드)
+//  - xdp_lb_full_csum.o : 필드별 작성 + 전체 체크섬 (-DLB_FULL_CSUM, 비교용)
+//
+// 주의: bpf_xdp_adjust_head 를 쓰는 프로그램은 repeat > 1 로 돌리면
+// 커널이 반복 사이에 xdp_buff 를 되돌리지 않아 headroom 이 계속 줄어듭니다.
+// 그래서 repeat = 1 로 여러 번 호출하고, 커널이 재준 duration 의 평균을 씁니다.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <linux/tcp.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include "common.h"
+#include "lb_user.h"
+
+#define PKT_LEN 64 // 측정용 TCP 패킷 크기 (Ethernet 포함)
+
+struct bench_case {
+    const char *name;
+    const char *filename;
+};
+
+static const struct bench_case cases[] = {
+    { "template", "xdp_lb.o" },
+    { "full_csum", "xdp_lb_full_csum.o" },
+};
+
+// Client(10.111.220.11:40000) -> VIP(192.168.10.1:50007) TCP SYN
+static void build_packet(unsigned char *pkt)
+{
+    struct ethhdr *eth = (struct ethhdr *)pkt;
+    struct iphdr *iph = (struct iphdr *)(eth + 1);
+    struct tcphdr *tcph = (struct tcphdr *)(iph + 1);
+
+    memset(pkt, 0, PKT_LEN);
+    eth->h_proto = htons(ETH_P_IP);
+    iph->version = 4;
+    iph->ihl = 5;
+    iph->tot_len = htons(PKT_LEN - sizeof(*eth));
+    iph->ttl = 64;
+    iph->protocol = IPPROTO_TCP;
+    iph->saddr = inet_addr("10.111.220.11");
+    iph->daddr = inet_addr("192.168.10.1");
+    tcph->source = htons(40000);
+    tcph->dest = htons(50007);
+    tcph->doff = 5;
+    tcph->syn = 1;
+}
+
+// 바깥 IP 헤더 체크섬 검증 (체크섬 포함 합을 접으면 0xffff 가 되어야 함)
+static int outer_csum_ok(const unsigned char *out)
+{
+    const __u16 *word = (const __u16 *)(out + sizeof(struct ethhdr));
+    __u32 sum = 0;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(struct iphdr) / 2); i++)
+        sum += word[i];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return sum == 0xffff;
+}
+
+static int run_case(const struct bench_case *bc, int iterations, double *ns_per_pkt)
+{
+    unsigned char pkt[PKT_LEN], out[PKT_LEN + 256];
+    struct lb_config config = {0};
+    struct bpf_object *obj;
+    struct bpf_program *prog;
+    __u64 total_ns = 0;
+    int prog_fd, i, err = -1;
+
+    obj = bpf_object__open_file(bc->filename, NULL);
+    if (libbpf_get_error(obj)) {
+        fprintf(stderr, "ERROR: opening %s failed\n", bc->filename);
+        return -1;
+    }
+    if (bpf_object__load(obj)) {
+        fprintf(stderr, "ERROR: loading %s failed\n", bc->filename);
+        goto out;
+    }
+
+    prog = bpf_object__find_program_by_name(obj, "xdp_load_balancer");
+    if (!prog) {
+        fprintf(stderr, "ERROR: %s: program not found\n", bc->filename);
+        goto out;
+    }
+    prog_fd = bpf_program__fd(prog);
+
+    config.src_ip = inet_addr("10.111.221.11");
+    config.real_server_ip = inet_addr("10.111.222.11");
+    memcpy(config.src_mac, "\x02\x42\x0a\x6f\xdd\x0b", 6);
+    memcpy(config.dst_mac, "\x02\x42\x0a\x6f\xdd\x0c", 6);
+    config.mtu = 1500;
+    if (setup_single_vip(obj, inet_addr("192.168.10.1"), &config)) {
+        fprintf(stderr, "ERROR: %s: updating BPF maps failed\n", bc->filename);
+        goto out;
+    }
+
+    build_packet(pkt);
+    for (i = 0; i < iterations; i++) {
+        LIBBPF_OPTS(bpf_test_run_opts, opts,
+            .data_in = pkt,
+            .data_size_in = sizeof(pkt),
+            .data_out = out,
+            .data_size_out = sizeof(out),
+            .repeat = 1,
+        );
+
+        if (bpf_prog_test_run_opts(prog_fd, &opts)) {
+            fprintf(stderr, "ERROR: test run failed: %s\n", strerror(errno));
+            goto out;
+        }
+        if (opts.retval != XDP_TX || !outer_csum_ok(out)) {
+            fprintf(stderr, "ERROR: %s: unexpected result (retval %u)\n",
+                    bc->name, opts.retval);
+            goto out;
+        }
+        total_ns += opts.duration;
+    }
+
+    *ns_per_pkt = (double)total_ns / iterations;
+    err = 0;
+out:
+    bpf_object__close(obj);
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    double ns[sizeof(cases) / sizeof(cases[0])];
+    size_t i;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (run_case(&cases[i], iterations, &ns[i]))
+            return 1;
+        printf("%-10s %8.2f ns/pkt (%s, %d runs)\n",
+               cases[i].name, ns[i], cases[i].filename, iterations);
+    }
+
+    printf("saved      %8.2f ns/pkt\n", ns[1] - ns[0]);
+    return 0;
+}
@@ -2,11 +2,85 @@
 #ifndef __COMMON_H
 #define __COMMON_H
 
+#include <linux/types.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+
+#define MAX_VIPS 16          // vip_map 크기 (VIP 서비스 개수)
+#define MAX_REALS 64         // reals 맵 크기 (Real 슬롯 개수)
+#define CH_RING_SIZE 65537   // VIP 하나당 consistent hash 링 크기 (소수, Maglev)
+#define CONN_TABLE_SIZE (1 << 18) // 연결 테이블 최대 엔트리 수 (CPU 별 LRU 로 나눠 씀)
+#define MAX_TX_PORTS 16       // tx_ports 맵 크기 (Real 로 내보낼 수 있는 인터페이스 개수)
+// lb_stats 맵: [0, MAX_VIPS) VIP 별, 그 뒤로 Real 슬롯 별, 마지막은 MTU 초과로 버린 패킷
+#define STATS_MTU_DROP (MAX_VIPS + MAX_REALS)
+#define STATS_SIZE (STATS_MTU_DROP + 1)
+
 struct lb_config {
     __u32 real_server_ip;     // 백엔드 IP
-    __u32 lb_vip;             // 가상 IP (VIP)
+    __u32 src_ip;             // 바깥 헤더 출발지 IP (LB IP)
     unsigned char src_mac[6]; // LB MAC
     unsigned char dst_mac[6]; // Gateway/Real MAC
+    __u32 mtu;                // Real 로 가는 언더레이 MTU (0 = 검사 안 함)
+    __u32 ifindex;            // Real 로 내보낼 인터페이스 (0 = 들어온 인터페이스로 XDP_TX)
+    __u32 gen;                // Real 슬롯의 세대 (real_tmpl.gen)
+};
+
+// VIP 서비스 키 (port 0 = 모든 포트)
+struct vip_key {
+    __u32 vip;      // VIP (network byte order)
+    __u16 port;     // 목적지 포트 (network byte order)
+    __u8 proto;     // IPPROTO_TCP / IPPROTO_UDP
+    __u8 pad;
+};
+
+struct vip_meta {
+    __u32 vip_num;  // ch_rings 안에서 이 VIP 링의 번호 (0 ~ MAX_VIPS-1)
+    __u32 pad;
+    __u64 reals;    // 이 VIP 풀에 있는 Real 슬롯 (bit n = 슬롯 n), conn_table 항목 확인용
+};
+
+_Static_assert(MAX_REALS <= 64, "vip_meta.reals is a 64-bit slot mask");
+
+// 연결 테이블 키: 안쪽(원본) 패킷의 5-tuple
+struct flow_key {
+    __u32 src;
+    __u32 dst;
+    __u16 sport;
+    __u16 dport;
+    __u8 proto;
+    __u8 pad[3];
+};
+
+// 연결 테이블 값: Real 슬롯 번호 + 기록할 때의 슬롯 세대
+// 빠진 Real 의 슬롯이 다른 Real 에 다시 배정되면 세대가 달라지므로,
+// 그 슬롯을 가리키던 흐름은 엉뚱한 Real 로 가지 않고 링에서 다시 고릅니다.
+struct conn_val {
+    __u32 real_num;
+    __u32 gen;
+};
+
+// Real 하나당 미리 만들어 두는 바깥(outer) 헤더 템플릿
+// - eth, iph 는 패킷에 그대로 복사할 값 (tos, tot_len, check 는 0)
+// - csum 은 위 iph 의 16비트 워드 합 (fold/보수 전), 유저 공간에서 계산
+// - mtu  은 이 Real 로 가는 언더레이 MTU (캡슐화 후 IP 패킷 최대 크기, 0 = 검사 안 함)
+// - ifindex 는 이 Real 의 다음 홉이 있는 인터페이스 (0 = XDP_TX, 그 외 = tx_ports 로 redirect)
+// - gen  은 슬롯 세대: lbd 가 슬롯을 새 Real 에 배정할 때마다 올림 (conn_val.gen 과 비교)
+// XDP 에서는 복사 후 tos, tot_len 만 더해서 체크섬을 마무리합니다.
+struct real_tmpl {
+    struct ethhdr eth;
+    struct iphdr iph;
+    __u32 csum;
+    __u32 mtu;
+    __u32 ifindex;
+    __u32 gen;
+};
+
+// VIP / Real 별 트래픽 카운터 (CPU 별 값, 유저 공간에서 합산)
+// - VIP  : VIP 로 들어온 패킷 (캡슐화 전 길이)
+// - Real : 그 Real 로 캡슐화해서 보낸 패킷 (캡슐화 전 길이)
+struct lb_stats {
+    __u64 packets;
+    __u64 bytes;
 };
 
-#endif
\ No newline at end of file
+#endif
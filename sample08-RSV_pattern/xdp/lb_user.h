@@ -0,0 +1,224 @@
+// lb_user.h
+// 유저 공간 프로그램(lbd, bench)이 같이 쓰는 헬퍼 함수
+#ifndef __LB_USER_H
+#define __LB_USER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "common.h"
+
+#define CH_RING_EMPTY 0xffffffff
+// lbd 가 lbstat 용으로 맵을 고정(pin)하는 위치: /sys/fs/bpf/<ifname>/<map 이름>
+#define LB_PIN_BASE "/sys/fs/bpf"
+
+// 인터페이스 MTU 조회 (SIOCGIFMTU). 실패하면 0 (MTU 검사 안 함)
+static __u32 get_ifmtu(const char *ifname)
+{
+    struct ifreq ifr = {0};
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return 0;
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFMTU, &ifr) < 0)
+        ifr.ifr_mtu = 0;
+    close(fd);
+    return ifr.ifr_mtu;
+}
+
+// 인터페이스 MAC 조회 (SIOCGIFHWADDR)
+static int get_ifhwaddr(const char *ifname, unsigned char *mac)
+{
+    struct ifreq ifr = {0};
+    int fd, err;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    err = ioctl(fd, SIOCGIFHWADDR, &ifr);
+    close(fd);
+    if (err < 0)
+        return -1;
+    memcpy(mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+    return 0;
+}
+
+// 인터페이스 IPv4 주소 조회 (SIOCGIFADDR), network byte order
+static int get_ifaddr(const char *ifname, __u32 *addr)
+{
+    struct ifreq ifr = {0};
+    int fd, err;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+    ifr.ifr_addr.sa_family = AF_INET;
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    err = ioctl(fd, SIOCGIFADDR, &ifr);
+    close(fd);
+    if (err < 0)
+        return -1;
+    *addr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr;
+    return 0;
+}
+
+// lb_config 로부터 Real 의 바깥 헤더 템플릿을 만듭니다.
+// XDP 가 패킷마다 채우는 tos, tot_len, check 는 0 으로 두고,
+// 나머지 필드의 16비트 워드 합을 csum 에 미리 계산해 둡니다.
+static void build_real_tmpl(const struct lb_config *cfg, struct real_tmpl *tmpl)
+{
+    const __u16 *word;
+    __u32 sum = 0;
+    int i;
+
+    memset(tmpl, 0, sizeof(*tmpl));
+
+    memcpy(tmpl->eth.h_dest, cfg->dst_mac, ETH_ALEN);   // 목적지: 백엔드 서버(Gateway) MAC
+    memcpy(tmpl->eth.h_source, cfg->src_mac, ETH_ALEN); // 출발지: LB MAC
+    tmpl->eth.h_proto = htons(ETH_P_IP);
+
+    tmpl->iph.version = 4;
+    tmpl->iph.ihl = 5;
+    tmpl->iph.ttl = 64;
+    tmpl->iph.protocol = IPPROTO_IPIP;       // 프로토콜 4번 (IPIP)
+    tmpl->iph.saddr = cfg->src_ip;           // 출발지: LB IP
+    tmpl->iph.daddr = cfg->real_server_ip;   // 목적지: 백엔드 서버 IP
+    tmpl->mtu = cfg->mtu;
+    tmpl->ifindex = cfg->ifindex;
+    tmpl->gen = cfg->gen;
+
+    // 네트워크 바이트 순서 그대로 워드 합을 구합니다 (XDP 쪽과 같은 방식).
+    // 최대 10 * 0xffff 이므로 __u32 에서 넘치지 않습니다.
+    word = (const __u16 *)&tmpl->iph;
+    for (i = 0; i < (int)(sizeof(tmpl->iph) / 2); i++)
+        sum += word[i];
+    tmpl->csum = sum;
+}
+
+// Real 을 구분하는 값(IP)을 섞는 해시. 시드를 달리해서 offset/skip 을 만듭니다.
+static __u32 ch_hash(__u32 x, __u32 seed)
+{
+    x ^= seed;
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+// Maglev 방식으로 VIP 하나의 consistent hash 링을 만듭니다.
+// - ids[i]   : Real 을 구분하는 값 (Real IP). 같은 Real 은 풀이 바뀌어도 같은 순열을 가짐
+// - slots[i] : reals 맵에서 그 Real 의 슬롯 번호 (링에 들어가는 값)
+// Real 하나가 빠지거나 추가돼도 링의 대부분은 그대로라서,
+// 연결 테이블에서 밀려난 흐름도 대부분 같은 Real 로 다시 갑니다.
+static int build_ch_ring(const __u32 *ids, const __u32 *slots, int n, __u32 *ring)
+{
+    __u32 *offset, *skip, *next;
+    int filled = 0;
+    int i;
+
+    if (n <= 0)
+        return -1;
+
+    offset = calloc(n, sizeof(*offset));
+    skip = calloc(n, sizeof(*skip));
+    next = calloc(n, sizeof(*next));
+    if (!offset || !skip || !next) {
+        free(offset);
+        free(skip);
+        free(next);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        offset[i] = ch_hash(ids[i], 0x5bd1e995) % CH_RING_SIZE;
+        skip[i] = ch_hash(ids[i], 0x27d4eb2f) % (CH_RING_SIZE - 1) + 1;
+    }
+    for (i = 0; i < CH_RING_SIZE; i++)
+        ring[i] = CH_RING_EMPTY;
+
+    // 각 Real 이 돌아가며 자기 순열에서 아직 빈 칸을 하나씩 차지합니다.
+    while (filled < CH_RING_SIZE) {
+        for (i = 0; i < n && filled < CH_RING_SIZE; i++) {
+            __u32 c;
+
+            do {
+                c = (offset[i] + (__u64)next[i] * skip[i]) % CH_RING_SIZE;
+                next[i]++;
+            } while (ring[c] != CH_RING_EMPTY);
+
+            ring[c] = slots[i];
+            filled++;
+        }
+    }
+
+    free(offset);
+    free(skip);
+    free(next);
+    return 0;
+}
+
+// 링을 ch_rings 맵의 vip_num 구간에 한 번의 batch update 로 씁니다.
+static int write_ch_ring(int map_fd, __u32 vip_num, const __u32 *ring)
+{
+    __u32 count = CH_RING_SIZE;
+    __u32 *keys;
+    int err;
+    int i;
+
+    keys = calloc(CH_RING_SIZE, sizeof(*keys));
+    if (!keys)
+        return -1;
+    for (i = 0; i < CH_RING_SIZE; i++)
+        keys[i] = vip_num * CH_RING_SIZE + i;
+
+    err = bpf_map_update_batch(map_fd, keys, ring, &count, NULL);
+    free(keys);
+    return err;
+}
+
+// VIP 1개 + Real 1개(lb_config)로 맵을 채웁니다. (bench 용)
+// VIP 는 vip_num 0 번, 모든 포트(port 0)의 TCP/UDP 로 등록하고
+// Real 은 0 번 슬롯에 넣은 뒤 링 전체를 그 슬롯으로 채웁니다.
+static int setup_single_vip(struct bpf_object *obj, __u32 vip, const struct lb_config *cfg)
+{
+    static __u32 ring[CH_RING_SIZE];
+    struct vip_meta meta = { .vip_num = 0, .reals = 1 }; // 슬롯 0
+    struct vip_key vk = { .vip = vip };
+    struct real_tmpl tmpl;
+    __u32 slot = 0;
+    int vip_fd, reals_fd, ring_fd;
+
+    vip_fd = bpf_object__find_map_fd_by_name(obj, "vip_map");
+    reals_fd = bpf_object__find_map_fd_by_name(obj, "reals");
+    ring_fd = bpf_object__find_map_fd_by_name(obj, "ch_rings");
+    if (vip_fd < 0 || reals_fd < 0 || ring_fd < 0)
+        return -1;
+
+    build_real_tmpl(cfg, &tmpl);
+    if (bpf_map_update_elem(reals_fd, &slot, &tmpl, BPF_ANY))
+        return -1;
+
+    if (build_ch_ring(&cfg->real_server_ip, &slot, 1, ring) ||
+        write_ch_ring(ring_fd, meta.vip_num, ring))
+        return -1;
+
+    vk.proto = IPPROTO_TCP;
+    if (bpf_map_update_elem(vip_fd, &vk, &meta, BPF_ANY))
+        return -1;
+    vk.proto = IPPROTO_UDP;
+    return bpf_map_update_elem(vip_fd, &vk, &meta, BPF_ANY);
+}
+
+#endif
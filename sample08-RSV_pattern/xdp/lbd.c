@@ -0,0 +1,769 @@
+// lbd.c
+// sample08 LB 제어 데몬
+// - xdp_lb.o 를 로드해서 인터페이스에 붙입니다. (native 모드 우선, 지원하지 않으면 SKB 모드)
+// - LB 인터페이스의 MAC/IP/MTU 를 직접 읽어서 Real 헤더 템플릿을 만듭니다.
+// - 설정 파일이 바뀌거나(inotify) SIGHUP 을 받으면 다시 읽어서,
+//   이전 상태와 달라진 부분만 batch update 로 맵에 반영합니다.
+//   프로그램은 다시 로드하거나 떼어내지 않으므로 재설정 중에도 패킷이 끊기지 않습니다.
+// - vip_map, reals, lb_stats 맵을 /sys/fs/bpf/<ifname>/ 에 고정(pin)해서 lbstat 이 읽을 수 있게 합니다.
+//
+// 사용법: ./lbd <ifname> <config file>
+//
+// 설정 파일 형식 ('#' 뒤는 주석):
+//   gateway 02:42:0a:6f:dd:0c              # 캡슐화한 패킷을 보낼 다음 홉(Router) MAC
+//   mtu 1500                               # (선택) 언더레이 MTU, 기본값 = 인터페이스 MTU
+//   vip 192.168.10.1 10.111.222.11 ...     # VIP (모든 포트, TCP) 와 Real 목록
+//   vip 192.168.10.2:53/udp 10.111.222.12  # VIP:port/proto 와 Real 목록
+//   real 10.1.1.2 dev eth1 gw 02:00:0a:01:01:02  # (선택) Real 의 다음 홉: 다른 인터페이스로 redirect
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <poll.h>
+#include <limits.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <linux/if_link.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include "common.h"
+#include "lb_user.h"
+
+struct vip_conf {
+    struct vip_key key;
+    int nreals;
+    __u32 reals[MAX_REALS]; // Real IP 목록
+};
+
+// Real 별 다음 홉 (없으면 LB 인터페이스 + gateway 로 XDP_TX)
+struct real_route {
+    __u32 ip;
+    char dev[IF_NAMESIZE];
+    unsigned char gw_mac[ETH_ALEN];
+};
+
+struct lb_conf {
+    unsigned char gw_mac[ETH_ALEN];
+    bool has_gw;
+    __u32 mtu;
+    int nvips;
+    struct vip_conf vips[MAX_VIPS];
+    int nroutes;
+    struct real_route routes[MAX_REALS];
+};
+
+// 지금 맵에 반영되어 있는 상태
+struct lb_state {
+    struct lb_conf conf;              // 마지막으로 적용한 설정
+    __u32 real_ip[MAX_REALS];         // 슬롯 -> Real IP (0 = 빈 슬롯)
+    __u32 slot_gen[MAX_REALS];        // 슬롯 -> 세대 (새 Real 에 배정할 때마다 증가)
+    __u32 next_slot;                  // 빈 슬롯을 찾기 시작할 위치 (방금 비운 슬롯을 바로 재사용하지 않음)
+    bool vip_used[MAX_VIPS];          // vip_num 사용 여부
+    struct vip_key vip_keys[MAX_VIPS];
+    __u64 vip_reals[MAX_VIPS];        // vip_num -> vip_map 에 써 둔 Real 슬롯 마스크
+    __u32 *rings[MAX_VIPS];           // vip_num -> 맵에 써 둔 링
+    int ntx;
+    __u32 tx_ports[MAX_TX_PORTS];     // tx_ports 맵에 넣어 둔 ifindex
+};
+
+static struct lb_state state;
+static int vip_fd, reals_fd, ring_fd, tx_fd;
+static struct lb_config iface;         // LB 인터페이스 정보 (src_ip, src_mac, mtu)
+static int lb_ifindex;
+
+// 한 번의 batch update 에 쓰는 임시 버퍼 (링 하나 크기면 충분)
+static __u32 batch_keys[CH_RING_SIZE];
+static __u32 batch_vals[CH_RING_SIZE];
+
+// MAC 주소 파싱 헬퍼 함수
+static int parse_mac(const char *str, unsigned char *mac) {
+    return sscanf(str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+                  &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == 6 ? 0 : -1;
+}
+
+// "ip[:port][/tcp|udp]" 파싱 (port 생략 = 0 = 모든 포트, proto 생략 = tcp)
+static int parse_vip(char *str, struct vip_key *key) {
+    char *proto = strchr(str, '/');
+    char *port = strchr(str, ':');
+
+    memset(key, 0, sizeof(*key));
+    key->proto = IPPROTO_TCP;
+    if (proto) {
+        *proto++ = '\0';
+        if (!strcmp(proto, "udp"))
+            key->proto = IPPROTO_UDP;
+        else if (strcmp(proto, "tcp"))
+            return -1;
+    }
+    if (port) {
+        unsigned long n;
+        char *end;
+
+        *port++ = '\0';
+        if (*port < '0' || *port > '9')
+            return -1;
+        errno = 0;
+        n = strtoul(port, &end, 10);
+        if (errno || *end || n > 65535)
+            return -1;
+        key->port = htons(n);
+    }
+    return inet_pton(AF_INET, str, &key->vip) == 1 ? 0 : -1;
+}
+
+static int parse_conf(const char *path, struct lb_conf *conf) {
+    char line[1024];
+    int lineno = 0, i;
+    FILE *f;
+
+    memset(conf, 0, sizeof(*conf));
+    f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "ERROR: open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *tok, *save, *hash = strchr(line, '#');
+
+        lineno++;
+        if (hash)
+            *hash = '\0';
+        tok = strtok_r(line, " \t\n", &save);
+        if (!tok)
+            continue;
+
+        if (!strcmp(tok, "gateway")) {
+            tok = strtok_r(NULL, " \t\n", &save);
+            if (!tok || parse_mac(tok, conf->gw_mac))
+                goto err;
+            conf->has_gw = true;
+        } else if (!strcmp(tok, "mtu")) {
+            tok = strtok_r(NULL, " \t\n", &save);
+            if (!tok)
+                goto err;
+            conf->mtu = atoi(tok);
+        } else if (!strcmp(tok, "vip")) {
+            struct vip_conf *vc;
+
+            if (conf->nvips == MAX_VIPS) {
+                fprintf(stderr, "ERROR: %s:%d: too many VIPs (max %d)\n", path, lineno, MAX_VIPS);
+                goto out;
+            }
+            vc = &conf->vips[conf->nvips++];
+            tok = strtok_r(NULL, " \t\n", &save);
+            if (!tok || parse_vip(tok, &vc->key))
+                goto err;
+            for (i = 0; i < conf->nvips - 1; i++)
+                if (!memcmp(&conf->vips[i].key, &vc->key, sizeof(vc->key)))
+                    goto err; // 같은 VIP 가 두 번 나옴
+            while ((tok = strtok_r(NULL, " \t\n", &save))) {
+                if (vc->nreals == MAX_REALS ||
+                    inet_pton(AF_INET, tok, &vc->reals[vc->nreals]) != 1)
+                    goto err;
+                vc->nreals++;
+            }
+        } else if (!strcmp(tok, "real")) {
+            struct real_route *rt;
+            char *dev, *gw;
+
+            if (conf->nroutes == MAX_REALS)
+                goto err;
+            rt = &conf->routes[conf->nroutes++];
+            tok = strtok_r(NULL, " \t\n", &save);
+            if (!tok || inet_pton(AF_INET, tok, &rt->ip) != 1)
+                goto err;
+            // real <ip> dev <ifname> gw <mac>
+            tok = strtok_r(NULL, " \t\n", &save);
+            dev = strtok_r(NULL, " \t\n", &save);
+            if (!tok || strcmp(tok, "dev") || !dev || strlen(dev) >= IF_NAMESIZE ||
+                !if_nametoindex(dev))
+                goto err;
+            tok = strtok_r(NULL, " \t\n", &save);
+            gw = strtok_r(NULL, " \t\n", &save);
+            if (!tok || strcmp(tok, "gw") || !gw || parse_mac(gw, rt->gw_mac))
+                goto err;
+            strcpy(rt->dev, dev);
+        } else {
+            goto err;
+        }
+    }
+    fclose(f);
+
+    if (!conf->has_gw) {
+        fprintf(stderr, "ERROR: %s: missing 'gateway <mac>'\n", path);
+        return -1;
+    }
+    return 0;
+
+err:
+    fprintf(stderr, "ERROR: %s:%d: invalid line\n", path, lineno);
+out:
+    fclose(f);
+    return -1;
+}
+
+static int find_slot(__u32 ip) {
+    int i;
+
+    for (i = 0; i < MAX_REALS; i++)
+        if (state.real_ip[i] == ip)
+            return i;
+    return -1;
+}
+
+static int alloc_slot(__u32 ip) {
+    int i;
+
+    for (i = 0; i < MAX_REALS; i++) {
+        __u32 slot = (state.next_slot + i) % MAX_REALS;
+
+        if (!state.real_ip[slot]) {
+            state.real_ip[slot] = ip;
+            state.slot_gen[slot]++; // 예전 Real 을 가리키던 conn_table 항목을 무효로
+            state.next_slot = (slot + 1) % MAX_REALS;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static int find_vip(const struct vip_key *key) {
+    int i;
+
+    for (i = 0; i < MAX_VIPS; i++)
+        if (state.vip_used[i] && !memcmp(&state.vip_keys[i], key, sizeof(*key)))
+            return i;
+    return -1;
+}
+
+static bool conf_has_real(const struct lb_conf *conf, __u32 ip) {
+    int i, j;
+
+    for (i = 0; i < conf->nvips; i++)
+        for (j = 0; j < conf->vips[i].nreals; j++)
+            if (conf->vips[i].reals[j] == ip)
+                return true;
+    return false;
+}
+
+static bool conf_has_vip(const struct lb_conf *conf, const struct vip_key *key) {
+    int i;
+
+    for (i = 0; i < conf->nvips; i++)
+        if (!memcmp(&conf->vips[i].key, key, sizeof(*key)))
+            return true;
+    return false;
+}
+
+static const struct real_route *find_route(const struct lb_conf *conf, __u32 ip) {
+    int i;
+
+    for (i = 0; i < conf->nroutes; i++)
+        if (conf->routes[i].ip == ip)
+            return &conf->routes[i];
+    return NULL;
+}
+
+static bool route_changed(const struct lb_conf *conf, __u32 ip) {
+    const struct real_route *old = find_route(&state.conf, ip);
+    const struct real_route *new = find_route(conf, ip);
+
+    if (!old || !new)
+        return old != new;
+    return memcmp(old, new, sizeof(*old)) != 0;
+}
+
+// Real 하나의 바깥 헤더 설정을 만듭니다.
+// 다음 홉이 지정된 Real 은 그 인터페이스의 MAC/IP/MTU 를 쓰고 ifindex 로 redirect 합니다.
+static int real_config(const struct lb_conf *conf, __u32 ip, struct lb_config *rc) {
+    const struct real_route *rt = find_route(conf, ip);
+    int ifindex;
+
+    *rc = iface;
+    rc->real_server_ip = ip;
+    memcpy(rc->dst_mac, conf->gw_mac, ETH_ALEN);
+    if (!rt)
+        goto out;
+
+    memcpy(rc->dst_mac, rt->gw_mac, ETH_ALEN);
+    ifindex = if_nametoindex(rt->dev);
+    if (!ifindex) {
+        fprintf(stderr, "ERROR: %s: %s\n", rt->dev, strerror(errno));
+        return -1;
+    }
+    if (ifindex == lb_ifindex)
+        goto out; // 들어온 인터페이스와 같으면 XDP_TX
+
+    if (get_ifhwaddr(rt->dev, rc->src_mac) || get_ifaddr(rt->dev, &rc->src_ip)) {
+        fprintf(stderr, "ERROR: reading MAC/IP of %s failed\n", rt->dev);
+        return -1;
+    }
+    rc->mtu = get_ifmtu(rt->dev);
+    rc->ifindex = ifindex;
+out:
+    if (conf->mtu)
+        rc->mtu = conf->mtu;
+    return 0;
+}
+
+// 설정에 있는 Real 들이 쓰는 redirect 인터페이스 목록
+static int collect_tx_ports(const struct lb_conf *conf, __u32 *ports) {
+    int i, k, n = 0;
+
+    for (i = 0; i < conf->nroutes; i++) {
+        int ifindex;
+
+        if (!conf_has_real(conf, conf->routes[i].ip))
+            continue;
+        ifindex = if_nametoindex(conf->routes[i].dev);
+        if (!ifindex || ifindex == lb_ifindex)
+            continue;
+        for (k = 0; k < n; k++)
+            if (ports[k] == (__u32)ifindex)
+                break;
+        if (k < n)
+            continue;
+        if (n == MAX_TX_PORTS) {
+            fprintf(stderr, "ERROR: too many egress interfaces (max %d)\n", MAX_TX_PORTS);
+            return -1;
+        }
+        ports[n++] = ifindex;
+    }
+    return n;
+}
+
+static int update_batch(int fd, const void *keys, const void *vals, __u32 count) {
+    if (!count)
+        return 0;
+    if (bpf_map_update_batch(fd, keys, vals, &count, NULL)) {
+        fprintf(stderr, "ERROR: bpf_map_update_batch: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// 새 설정을 맵에 반영합니다. 순서가 중요합니다:
+//  0. 새로 쓰는 redirect 인터페이스를 tx_ports 에 넣고 (템플릿이 가리키기 전에 준비됨)
+//  1. 새 Real 템플릿을 먼저 쓰고        (링이 가리킬 슬롯이 먼저 준비됨)
+//  2. 링을 바뀐 칸만 고쳐 쓰고
+//  3. 새 VIP 와 풀이 바뀐 VIP 를 vip_map 에 쓰고 (링이 다 채워진 뒤에 보이게,
+//     빠진 Real 은 템플릿을 비우기 전에 풀에서 빠져서 그 VIP 의 흐름이 따라가지 않음)
+//  4. 빠진 VIP 를 vip_map 에서 지우고
+//  5. 더 이상 쓰지 않는 Real 템플릿을 비우고 (연결 테이블이 가리키던 흐름은 링에서 다시 고름)
+//  6. 더 이상 쓰지 않는 인터페이스를 tx_ports 에서 뺍니다.
+// DEVMAP_HASH 는 batch 연산을 지원하지 않아서 tx_ports 만 한 개씩 고칩니다. (최대 MAX_TX_PORTS 개)
+// 어느 시점에 패킷이 와도 항상 유효한 Real 로 가게 됩니다.
+// state 는 쓰면서 같이 고치므로, 실패했을 때 되돌리는 일은 apply_conf 가 합니다.
+static int write_conf(const struct lb_conf *conf) {
+    struct real_tmpl tmpls[MAX_REALS];
+    struct vip_key vkeys[MAX_VIPS];
+    struct vip_meta vmetas[MAX_VIPS];
+    bool tmpl_changed = state.conf.mtu != conf->mtu ||
+                        memcmp(state.conf.gw_mac, conf->gw_mac, ETH_ALEN);
+    int n_reals_add = 0, n_reals_del = 0, n_vips_add = 0, n_vips_del = 0, n_ring = 0;
+    __u32 tx_ports[MAX_TX_PORTS];
+    struct lb_config rc;
+    __u32 count = 0;
+    int i, j, k, ntx;
+
+    // 0. redirect 인터페이스 추가
+    ntx = collect_tx_ports(conf, tx_ports);
+    if (ntx < 0)
+        return -1;
+    for (i = 0; i < ntx; i++) {
+        if (bpf_map_update_elem(tx_fd, &tx_ports[i], &tx_ports[i], BPF_ANY)) {
+            fprintf(stderr, "ERROR: adding ifindex %u to tx_ports: %s\n",
+                    tx_ports[i], strerror(errno));
+            return -1;
+        }
+    }
+
+    // 1. Real 템플릿 (새 Real, 다음 홉이 바뀐 Real, 또는 gateway/mtu 가 바뀌었으면 전체)
+    for (i = 0; i < conf->nvips; i++) {
+        for (j = 0; j < conf->vips[i].nreals; j++) {
+            __u32 ip = conf->vips[i].reals[j];
+            int slot = find_slot(ip);
+            bool is_new = slot < 0;
+
+            if (is_new) {
+                slot = alloc_slot(ip);
+                if (slot < 0) {
+                    fprintf(stderr, "ERROR: too many reals (max %d)\n", MAX_REALS);
+                    return -1;
+                }
+                n_reals_add++;
+            }
+            if (is_new || tmpl_changed || route_changed(conf, ip)) {
+                // 같은 Real 이 여러 VIP 에 있어도 한 번만 씀
+                for (k = 0; k < (int)count; k++)
+                    if (batch_keys[k] == (__u32)slot)
+                        break;
+                if (k < (int)count)
+                    continue;
+                if (real_config(conf, ip, &rc))
+                    return -1;
+                rc.gen = state.slot_gen[slot];
+                build_real_tmpl(&rc, &tmpls[count]);
+                batch_keys[count++] = slot;
+            }
+        }
+    }
+    if (update_batch(reals_fd, batch_keys, tmpls, count))
+        return -1;
+
+    // 2. VIP 별 링: 새로 만든 링과 맵에 있는 링을 비교해서 바뀐 칸만 씀
+    count = 0;
+    for (i = 0; i < conf->nvips; i++) {
+        const struct vip_conf *vc = &conf->vips[i];
+        __u32 ids[MAX_REALS], slots[MAX_REALS];
+        __u32 ring_cnt = 0;
+        int vip_num = find_vip(&vc->key);
+        bool is_new = vip_num < 0;
+        __u64 reals = 0;
+        __u32 *ring;
+
+        if (is_new) {
+            for (vip_num = 0; vip_num < MAX_VIPS && state.vip_used[vip_num]; vip_num++)
+                ;
+            if (vip_num == MAX_VIPS) {
+                fprintf(stderr, "ERROR: too many VIPs (max %d)\n", MAX_VIPS);
+                return -1;
+            }
+            state.vip_used[vip_num] = true;
+            state.vip_keys[vip_num] = vc->key;
+            n_vips_add++;
+        }
+
+        if (!state.rings[vip_num]) {
+            state.rings[vip_num] = malloc(CH_RING_SIZE * sizeof(__u32));
+            if (!state.rings[vip_num])
+                return -1;
+            // 처음 쓰는 링은 모든 칸이 바뀐 것으로 취급
+            memset(state.rings[vip_num], 0xfe, CH_RING_SIZE * sizeof(__u32));
+        }
+
+        for (j = 0; j < vc->nreals; j++) {
+            ids[j] = vc->reals[j];
+            slots[j] = find_slot(vc->reals[j]);
+            reals |= 1ULL << slots[j];
+        }
+        if (is_new || reals != state.vip_reals[vip_num]) {
+            vkeys[count] = vc->key;
+            vmetas[count].vip_num = vip_num;
+            vmetas[count].pad = 0;
+            vmetas[count].reals = reals;
+            count++;
+            state.vip_reals[vip_num] = reals;
+        }
+        ring = batch_vals;
+        if (vc->nreals) {
+            build_ch_ring(ids, slots, vc->nreals, ring);
+        } else {
+            for (j = 0; j < CH_RING_SIZE; j++)
+                ring[j] = CH_RING_EMPTY;
+        }
+
+        for (j = 0; j < CH_RING_SIZE; j++) {
+            if (ring[j] == state.rings[vip_num][j])
+                continue;
+            batch_keys[ring_cnt] = vip_num * CH_RING_SIZE + j;
+            ring[ring_cnt++] = ring[j]; // ring 과 batch_vals 가 같은 버퍼: 앞쪽으로 당겨 담기
+            state.rings[vip_num][j] = ring[j];
+        }
+        if (update_batch(ring_fd, batch_keys, ring, ring_cnt))
+            return -1;
+        n_ring += ring_cnt;
+    }
+
+    // 3. 새 VIP 등록, 풀이 바뀐 VIP 갱신
+    if (update_batch(vip_fd, vkeys, vmetas, count))
+        return -1;
+
+    // 4. 빠진 VIP 삭제
+    count = 0;
+    for (i = 0; i < MAX_VIPS; i++) {
+        if (!state.vip_used[i] || conf_has_vip(conf, &state.vip_keys[i]))
+            continue;
+        vkeys[count++] = state.vip_keys[i];
+        state.vip_used[i] = false;
+        state.rings[i] = NULL; // 해제는 성공한 뒤에 (apply_conf)
+    }
+    if (count && bpf_map_delete_batch(vip_fd, vkeys, &count, NULL)) {
+        fprintf(stderr, "ERROR: bpf_map_delete_batch: %s\n", strerror(errno));
+        return -1;
+    }
+    n_vips_del = count;
+
+    // 5. 빠진 Real 템플릿 비우기
+    count = 0;
+    for (i = 0; i < MAX_REALS; i++) {
+        if (!state.real_ip[i] || conf_has_real(conf, state.real_ip[i]))
+            continue;
+        memset(&tmpls[count], 0, sizeof(tmpls[count]));
+        batch_keys[count++] = i;
+        state.real_ip[i] = 0;
+    }
+    if (update_batch(reals_fd, batch_keys, tmpls, count))
+        return -1;
+    n_reals_del = count;
+
+    // 6. 빠진 redirect 인터페이스 삭제
+    for (i = 0; i < state.ntx; i++) {
+        for (k = 0; k < ntx; k++)
+            if (tx_ports[k] == state.tx_ports[i])
+                break;
+        if (k == ntx)
+            bpf_map_delete_elem(tx_fd, &state.tx_ports[i]);
+    }
+    memcpy(state.tx_ports, tx_ports, sizeof(tx_ports));
+    state.ntx = ntx;
+
+    state.conf = *conf;
+    printf("Config applied: reals +%d/-%d, VIPs +%d/-%d, ring entries changed %d\n",
+           n_reals_add, n_reals_del, n_vips_add, n_vips_del, n_ring);
+    return 0;
+}
+
+// write_conf 가 중간에 실패하면 state 를 이전 설정으로 되돌립니다.
+// 되돌리지 않으면 맵에 쓰지 못한 슬롯/VIP 가 이미 있는 것으로 남아서,
+// 다음 재설정 때 그 템플릿을 쓰지 않고 링이 빈 슬롯을 가리키게 됩니다.
+// - 링 캐시는 일부만 써졌을 수 있으므로 전부 바뀐 것으로 표시 (다음에 링 전체를 다시 씀)
+// - 슬롯 세대는 되돌리지 않음: 실패 중에 기록된 conn_table 항목이 나중에 같은 세대로 맞지 않게
+static int apply_conf(const struct lb_conf *conf) {
+    static struct lb_state saved;
+    __u32 tx_ports[MAX_TX_PORTS];
+    int i, k, ntx;
+
+    saved = state;
+    if (!write_conf(conf)) {
+        for (i = 0; i < MAX_VIPS; i++)
+            if (saved.rings[i] && saved.rings[i] != state.rings[i])
+                free(saved.rings[i]); // 빠진 VIP 의 링
+        return 0;
+    }
+
+    // 실패하기 전에 맵에 쓴 것 되돌리기: 새 VIP 와 새 인터페이스는 지우고, 원래 있던 VIP 는
+    // 원래 값으로 다시 씀 (지워졌거나 풀 마스크가 바뀌었을 수 있음)
+    for (i = 0; i < MAX_VIPS; i++) {
+        if (state.vip_used[i] && !saved.vip_used[i]) {
+            bpf_map_delete_elem(vip_fd, &state.vip_keys[i]);
+        } else if (saved.vip_used[i]) {
+            struct vip_meta meta = { .vip_num = i, .reals = saved.vip_reals[i] };
+
+            if (bpf_map_update_elem(vip_fd, &saved.vip_keys[i], &meta, BPF_ANY))
+                fprintf(stderr, "ERROR: restoring VIP %d: %s\n", i, strerror(errno));
+        }
+    }
+    ntx = collect_tx_ports(conf, tx_ports);
+    for (k = 0; k < ntx; k++) {
+        for (i = 0; i < saved.ntx; i++)
+            if (saved.tx_ports[i] == tx_ports[k])
+                break;
+        if (i == saved.ntx)
+            bpf_map_delete_elem(tx_fd, &tx_ports[k]);
+    }
+
+    for (i = 0; i < MAX_VIPS; i++) {
+        if (state.rings[i] && state.rings[i] != saved.rings[i])
+            free(state.rings[i]); // 이번에 새로 만든 링
+        if (saved.rings[i])
+            memset(saved.rings[i], 0xfe, CH_RING_SIZE * sizeof(__u32));
+    }
+    memcpy(saved.slot_gen, state.slot_gen, sizeof(saved.slot_gen));
+    state = saved;
+    return -1;
+}
+
+static void reload(const char *path) {
+    static struct lb_conf conf;
+
+    if (parse_conf(path, &conf) || apply_conf(&conf))
+        fprintf(stderr, "ERROR: reload failed, keeping previous config\n");
+}
+
+// lbstat 이 읽을 수 있도록 고정(pin)하는 맵 (Real/VIP 이름 + 카운터)
+static const char *pinned_maps[] = { "vip_map", "reals", "lb_stats" };
+
+static void unpin_maps(struct bpf_object *obj, const char *ifname) {
+    char path[PATH_MAX];
+    size_t i;
+
+    for (i = 0; i < sizeof(pinned_maps) / sizeof(pinned_maps[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s/%s", LB_PIN_BASE, ifname, pinned_maps[i]);
+        bpf_map__unpin(bpf_object__find_map_by_name(obj, pinned_maps[i]), path);
+    }
+}
+
+static int pin_maps(struct bpf_object *obj, const char *ifname) {
+    char path[PATH_MAX];
+    size_t i;
+
+    snprintf(path, sizeof(path), "%s/%s", LB_PIN_BASE, ifname);
+    if (mkdir(path, 0700) && errno != EEXIST)
+        return -1;
+
+    for (i = 0; i < sizeof(pinned_maps) / sizeof(pinned_maps[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s/%s", LB_PIN_BASE, ifname, pinned_maps[i]);
+        unlink(path); // 이전 실행이 비정상 종료해서 남은 핀 제거
+        if (bpf_map__pin(bpf_object__find_map_by_name(obj, pinned_maps[i]), path)) {
+            fprintf(stderr, "ERROR: pinning %s failed\n", path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// native(드라이버) 모드로 붙여보고, 지원하지 않는 장치면 SKB 모드로 붙입니다.
+static int attach_xdp(int ifindex, int prog_fd, __u32 *flags) {
+    *flags = XDP_FLAGS_DRV_MODE;
+    if (!bpf_xdp_attach(ifindex, prog_fd, *flags, NULL))
+        return 0;
+
+    fprintf(stderr, "WARN: native XDP not supported, falling back to SKB mode\n");
+    *flags = XDP_FLAGS_SKB_MODE;
+    return bpf_xdp_attach(ifindex, prog_fd, *flags, NULL);
+}
+
+int main(int argc, char **argv) {
+    char conf_path[PATH_MAX], conf_dir[PATH_MAX], conf_name[NAME_MAX + 1];
+    struct lb_conf conf;
+    struct bpf_object *obj;
+    struct bpf_program *prog;
+    struct pollfd fds[2];
+    __u32 xdp_flags;
+    sigset_t mask;
+    int ifindex, ret = 0;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <ifname> <config file>\n", argv[0]);
+        return 1;
+    }
+
+    // 1. 인터페이스 정보 (LB MAC, LB IP, MTU)
+    const char *ifname = argv[1];
+    ifindex = if_nametoindex(ifname);
+    lb_ifindex = ifindex;
+    if (!ifindex) {
+        perror("if_nametoindex");
+        return 1;
+    }
+    if (get_ifhwaddr(ifname, iface.src_mac) || get_ifaddr(ifname, &iface.src_ip)) {
+        fprintf(stderr, "ERROR: reading MAC/IP of %s failed\n", ifname);
+        return 1;
+    }
+    iface.mtu = get_ifmtu(ifname);
+
+    if (!realpath(argv[2], conf_path)) {
+        fprintf(stderr, "ERROR: %s: %s\n", argv[2], strerror(errno));
+        return 1;
+    }
+    strncpy(conf_dir, conf_path, sizeof(conf_dir));
+    strncpy(conf_name, basename(conf_path), sizeof(conf_name) - 1);
+    conf_name[sizeof(conf_name) - 1] = '\0';
+    dirname(conf_dir);
+    if (parse_conf(conf_path, &conf))
+        return 1;
+
+    // 2. BPF 객체 열기 및 로드
+    obj = bpf_object__open_file("xdp_lb.o", NULL);
+    if (libbpf_get_error(obj)) {
+        fprintf(stderr, "ERROR: opening BPF object file failed\n");
+        return 1;
+    }
+    if (bpf_object__load(obj)) {
+        fprintf(stderr, "ERROR: loading BPF object file failed\n");
+        return 1;
+    }
+    prog = bpf_object__find_program_by_name(obj, "xdp_load_balancer");
+    vip_fd = bpf_object__find_map_fd_by_name(obj, "vip_map");
+    reals_fd = bpf_object__find_map_fd_by_name(obj, "reals");
+    ring_fd = bpf_object__find_map_fd_by_name(obj, "ch_rings");
+    tx_fd = bpf_object__find_map_fd_by_name(obj, "tx_ports");
+    if (!prog || vip_fd < 0 || reals_fd < 0 || ring_fd < 0 || tx_fd < 0) {
+        fprintf(stderr, "ERROR: finding XDP program or maps failed\n");
+        return 1;
+    }
+
+    // 3. 붙이기 전에 맵부터 채움 (붙는 순간부터 바로 동작)
+    if (apply_conf(&conf) || pin_maps(obj, ifname))
+        return 1;
+
+    if (attach_xdp(ifindex, bpf_program__fd(prog), &xdp_flags)) {
+        fprintf(stderr, "ERROR: attaching XDP program failed\n");
+        return 1;
+    }
+    printf("XDP attached to %s (index %d, %s mode)\n", ifname, ifindex,
+           xdp_flags == XDP_FLAGS_DRV_MODE ? "native" : "skb");
+
+    // 4. 이벤트 대기: 시그널(signalfd) + 설정 파일 변경(inotify)
+    // 편집기는 보통 새 파일로 바꿔치기하므로 파일이 아니라 디렉토리를 감시합니다.
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    fds[0].fd = signalfd(-1, &mask, 0);
+    fds[0].events = POLLIN;
+    fds[1].fd = inotify_init1(0);
+    fds[1].events = POLLIN;
+    if (fds[0].fd < 0 || fds[1].fd < 0 ||
+        inotify_add_watch(fds[1].fd, conf_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        perror("signalfd/inotify");
+        ret = 1;
+        goto detach;
+    }
+    printf("Watching %s for changes (or send SIGHUP). Press Ctrl+C to stop.\n", conf_path);
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            ret = 1;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            struct signalfd_siginfo si;
+
+            if (read(fds[0].fd, &si, sizeof(si)) != sizeof(si))
+                break;
+            if (si.ssi_signo != SIGHUP)
+                break;
+            reload(conf_path);
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            bool changed = false;
+            ssize_t len = read(fds[1].fd, buf, sizeof(buf));
+            char *p;
+
+            for (p = buf; len > 0 && p < buf + len;) {
+                struct inotify_event *ev = (struct inotify_event *)p;
+
+                if (ev->len && !strcmp(ev->name, conf_name))
+                    changed = true;
+                p += sizeof(*ev) + ev->len;
+            }
+            if (changed)
+                reload(conf_path);
+        }
+    }
+
+detach:
+    // 5. 정리 및 종료
+    printf("Detaching XDP program...\n");
+    bpf_xdp_detach(ifindex, xdp_flags, NULL);
+    unpin_maps(obj, ifname);
+    bpf_object__close(obj);
+    return ret;
+}
@@ -0,0 +1,182 @@
+// lbstat.c
+// lbd 가 고정(pin)해 둔 lb_stats 맵을 주기적으로 읽어서 VIP / Real 별 pps, bps 를 출력합니다.
+//
+// 사용법: ./lbstat <ifname> [interval 초]
+//
+// 카운터는 주기마다 bpf_map_lookup_batch 한 번으로 (모든 인덱스 x 모든 CPU) 통째로 읽고,
+// 이전 값과의 차이를 실제 경과 시간으로 나눠 속도를 구합니다.
+// 이름(VIP:port/proto, Real IP)은 vip_map / reals 에서 읽으므로 lbd 재설정도 바로 반영됩니다.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+#include "common.h"
+#include "lb_user.h"
+
+// 유저 공간에서 PERCPU 맵 값은 CPU 마다 8 바이트 단위로 정렬됩니다.
+#define STATS_VALUE_SIZE ((sizeof(struct lb_stats) + 7) & ~7UL)
+
+struct stats_snapshot {
+    struct lb_stats sum[STATS_SIZE]; // 모든 CPU 의 합
+    struct timespec ts;
+};
+
+static int open_pinned(const char *ifname, const char *name) {
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s/%s", LB_PIN_BASE, ifname, name);
+    fd = bpf_obj_get(path);
+    if (fd < 0)
+        fprintf(stderr, "ERROR: opening %s failed (is lbd running?): %s\n",
+                path, strerror(errno));
+    return fd;
+}
+
+// lb_stats 전체를 한 번의 batch lookup 으로 읽어서 CPU 별 값을 합산합니다.
+static int read_stats(int fd, int nr_cpus, void *values, struct stats_snapshot *snap) {
+    static __u32 keys[STATS_SIZE];
+    __u32 out_batch, count = STATS_SIZE;
+    __u32 i;
+    int cpu;
+
+    if (bpf_map_lookup_batch(fd, NULL, &out_batch, keys, values, &count, NULL) &&
+        errno != ENOENT) {
+        fprintf(stderr, "ERROR: bpf_map_lookup_batch: %s\n", strerror(errno));
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &snap->ts);
+
+    memset(snap->sum, 0, sizeof(snap->sum));
+    for (i = 0; i < count; i++) {
+        if (keys[i] >= STATS_SIZE)
+            continue;
+        for (cpu = 0; cpu < nr_cpus; cpu++) {
+            const struct lb_stats *v = (const void *)((const char *)values +
+                                       ((size_t)i * nr_cpus + cpu) * STATS_VALUE_SIZE);
+
+            snap->sum[keys[i]].packets += v->packets;
+            snap->sum[keys[i]].bytes += v->bytes;
+        }
+    }
+    return 0;
+}
+
+// vip_num -> "VIP:port/proto" 이름 (등록되지 않은 번호는 빈 문자열)
+static void read_vip_names(int fd, char names[MAX_VIPS][32]) {
+    struct vip_key keys[MAX_VIPS];
+    struct vip_meta metas[MAX_VIPS];
+    __u32 out_batch, count = MAX_VIPS;
+    char ip[INET_ADDRSTRLEN];
+    __u32 i;
+
+    memset(names, 0, MAX_VIPS * sizeof(names[0]));
+    if (bpf_map_lookup_batch(fd, NULL, &out_batch, keys, metas, &count, NULL) &&
+        errno != ENOENT)
+        return;
+
+    for (i = 0; i < count; i++) {
+        if (metas[i].vip_num >= MAX_VIPS)
+            continue;
+        inet_ntop(AF_INET, &keys[i].vip, ip, sizeof(ip));
+        snprintf(names[metas[i].vip_num], sizeof(names[0]), "%s:%u/%s", ip,
+                 ntohs(keys[i].port), keys[i].proto == IPPROTO_UDP ? "udp" : "tcp");
+    }
+}
+
+// Real 슬롯 -> 템플릿 (iph.daddr 가 Real IP, 0 = 빈 슬롯)
+static void read_reals(int fd, struct real_tmpl tmpls[MAX_REALS]) {
+    __u32 keys[MAX_REALS];
+    __u32 out_batch, count = MAX_REALS;
+
+    if (bpf_map_lookup_batch(fd, NULL, &out_batch, keys, tmpls, &count, NULL) &&
+        errno != ENOENT)
+        memset(tmpls, 0, MAX_REALS * sizeof(tmpls[0]));
+}
+
+static double elapsed_sec(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static void print_row(const char *kind, const char *name, const struct lb_stats *prev,
+                      const struct lb_stats *cur, double sec) {
+    double pps = (cur->packets - prev->packets) / sec;
+    double bps = (cur->bytes - prev->bytes) * 8 / sec;
+
+    printf("%-5s %-26s %12.0f pps %10.3f Mbit/s %14llu pkts\n", kind, name, pps, bps / 1e6,
+           (unsigned long long)cur->packets);
+}
+
+int main(int argc, char **argv) {
+    static struct stats_snapshot snaps[2];
+    struct real_tmpl tmpls[MAX_REALS];
+    char vip_names[MAX_VIPS][32];
+    int stats_fd, vip_fd, reals_fd, nr_cpus;
+    int interval = argc > 2 ? atoi(argv[2]) : 1;
+    int cur = 0;
+    void *values;
+    __u32 i;
+
+    if (argc < 2 || interval <= 0) {
+        fprintf(stderr, "Usage: %s <ifname> [interval]\n", argv[0]);
+        return 1;
+    }
+
+    stats_fd = open_pinned(argv[1], "lb_stats");
+    vip_fd = open_pinned(argv[1], "vip_map");
+    reals_fd = open_pinned(argv[1], "reals");
+    if (stats_fd < 0 || vip_fd < 0 || reals_fd < 0)
+        return 1;
+
+    nr_cpus = libbpf_num_possible_cpus();
+    if (nr_cpus <= 0) {
+        fprintf(stderr, "ERROR: libbpf_num_possible_cpus failed\n");
+        return 1;
+    }
+    values = calloc((size_t)STATS_SIZE * nr_cpus, STATS_VALUE_SIZE);
+    if (!values)
+        return 1;
+
+    if (read_stats(stats_fd, nr_cpus, values, &snaps[cur]))
+        return 1;
+
+    for (;;) {
+        struct stats_snapshot *prev = &snaps[cur], *now = &snaps[cur ^ 1];
+        char ip[INET_ADDRSTRLEN];
+        double sec;
+
+        sleep(interval);
+        if (read_stats(stats_fd, nr_cpus, values, now))
+            return 1;
+        cur ^= 1;
+        sec = elapsed_sec(&prev->ts, &now->ts);
+
+        // 이름은 출력용이라 주기마다 다시 읽음 (lbd 재설정 반영)
+        read_vip_names(vip_fd, vip_names);
+        read_reals(reals_fd, tmpls);
+
+        printf("\n");
+        for (i = 0; i < MAX_VIPS; i++) {
+            if (vip_names[i][0])
+                print_row("VIP", vip_names[i], &prev->sum[i], &now->sum[i], sec);
+        }
+        for (i = 0; i < MAX_REALS; i++) {
+            if (!tmpls[i].iph.daddr)
+                continue;
+            inet_ntop(AF_INET, &tmpls[i].iph.daddr, ip, sizeof(ip));
+            print_row("REAL", ip, &prev->sum[MAX_VIPS + i], &now->sum[MAX_VIPS + i], sec);
+        }
+        // 캡슐화하면 언더레이 MTU 를 넘어서 버린 DF 없는 패킷 (한 번이라도 있었을 때만)
+        if (now->sum[STATS_MTU_DROP].packets)
+            print_row("DROP", "mtu exceeded", &prev->sum[STATS_MTU_DROP],
+                      &now->sum[STATS_MTU_DROP], sec);
+    }
+
+    return 0;
+}
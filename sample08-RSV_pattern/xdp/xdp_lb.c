@@ -1,21 +1,75 @@
+#include <stddef.h>
 #include <linux/bpf.h>
 #include <linux/in.h>
 #include <linux/if_ether.h>
 #include <linux/ip.h>
 #include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/icmp.h>
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_endian.h>
 
 #include "common.h" // ★ 여기에 공통 헤더 포함
 
+#define IP_DF 0x4000 // Don't Fragment 플래그 (frag_off)
+// ICMP "fragmentation needed" 에 담는 원본 패킷 길이: 최대 IP 헤더(60) + 8 바이트
+#define ICMP_TOOBIG_DATA_LEN 68
 
-// 설정을 저장할 BPF 맵 (Array 타입, 인덱스 0번 하나만 사용)
+
+// VIP 서비스 목록 (VIP:port/proto -> vip_num)
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_VIPS);
+    __type(key, struct vip_key);
+    __type(value, struct vip_meta);
+} vip_map SEC(".maps");
+
+// Real 별 바깥 헤더 템플릿 (Array 타입, 유저 공간에서 채움)
 struct {
     __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(max_entries, 1);
+    __uint(max_entries, MAX_REALS);
+    __type(key, __u32);
+    __type(value, struct real_tmpl);
+} reals SEC(".maps");
+
+// VIP 별 consistent hash 링 (Maglev, 유저 공간에서 채움)
+// 인덱스 = vip_num * CH_RING_SIZE + (flow hash % CH_RING_SIZE), 값 = Real 슬롯 번호
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, MAX_VIPS * CH_RING_SIZE);
+    __type(key, __u32);
+    __type(value, __u32);
+} ch_rings SEC(".maps");
+
+// 연결 테이블 (5-tuple -> Real 슬롯 번호 + 슬롯 세대)
+// BPF_F_NO_COMMON_LRU: CPU 마다 LRU 리스트를 따로 둬서 락 경합 없이 갱신하고,
+// max_entries 로 전체 메모리 사용량이 고정됩니다.
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, CONN_TABLE_SIZE);
+    __uint(map_flags, BPF_F_NO_COMMON_LRU);
+    __type(key, struct flow_key);
+    __type(value, struct conn_val);
+} conn_table SEC(".maps");
+
+// Real 로 내보낼 인터페이스 (ifindex -> ifindex, 유저 공간에서 채움)
+// bpf_redirect_map 으로 보내면 커널이 NAPI 한 번 동안 모인 패킷을 장치별로 모아서 한꺼번에 보냅니다.
+struct {
+    __uint(type, BPF_MAP_TYPE_DEVMAP_HASH);
+    __uint(max_entries, MAX_TX_PORTS);
     __type(key, __u32);
-    __type(value, struct lb_config);
-} lb_map SEC(".maps");
+    __type(value, __u32);
+} tx_ports SEC(".maps");
+
+// VIP / Real 별 트래픽 카운터
+// 인덱스 = vip_num (VIP), MAX_VIPS + Real 슬롯 번호 (Real)
+// PERCPU 맵이라 CPU 끼리 캐시 라인을 공유하지 않고, atomic 연산 없이 더하기만 합니다.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, STATS_SIZE);
+    __type(key, __u32);
+    __type(value, struct lb_stats);
+} lb_stats SEC(".maps");
 
 // IP 체크섬 계산을 위한 간단한 헬퍼 함수
 static __always_inline __u16 csum_fold_helper(__u64 csum) {
@@ -34,6 +88,156 @@ static __always_inline __u16 iph_csum(struct iphdr *iph) {
     return csum_fold_helper(csum);
 }
 
+// 캡슐화하면 MTU 를 넘는 DF 패킷에 대해 ICMP type 3 code 4 (fragmentation needed)
+// 응답을 제자리에서 만들어 클라이언트로 돌려보냅니다. (XDP_TX)
+// 클라이언트 TCP 는 바로 MSS 를 줄이므로 재전송으로 멈춰 있지 않습니다.
+//
+// 패킷 모양: [Eth][IP][ICMP][원본 IP 헤더 + 페이로드 일부 (ICMP_TOOBIG_DATA_LEN)]
+// 앞쪽에 IP+ICMP 헤더(28 바이트)만큼 공간을 늘리면 원본 IP 헤더가 ICMP 헤더 바로 뒤에 옵니다.
+static __always_inline int send_icmp_toobig(struct xdp_md *ctx, __u16 mtu) {
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    struct ethhdr *eth = data;
+    struct iphdr *iph = (void *)(eth + 1);
+    unsigned char smac[ETH_ALEN], dmac[ETH_ALEN];
+    __u32 saddr, daddr;
+    int headroom = sizeof(struct iphdr) + sizeof(struct icmphdr);
+    int tail;
+
+    if ((void *)(iph + 1) > data_end)
+        return XDP_DROP;
+
+    // 원본 주소 저장 (응답은 반대 방향)
+    __builtin_memcpy(smac, eth->h_source, ETH_ALEN);
+    __builtin_memcpy(dmac, eth->h_dest, ETH_ALEN);
+    saddr = iph->saddr;
+    daddr = iph->daddr;
+
+    // 1. 원본은 Ethernet + ICMP_TOOBIG_DATA_LEN 바이트만 남기고 자르기
+    tail = (int)(data_end - data) - (int)(sizeof(struct ethhdr) + ICMP_TOOBIG_DATA_LEN);
+    if (tail > 0 && bpf_xdp_adjust_tail(ctx, 0 - tail))
+        return XDP_DROP;
+
+    // 2. 앞쪽에 새 IP + ICMP 헤더 공간 확보
+    if (bpf_xdp_adjust_head(ctx, 0 - headroom))
+        return XDP_DROP;
+
+    data = (void *)(long)ctx->data;
+    data_end = (void *)(long)ctx->data_end;
+    eth = data;
+    iph = (void *)(eth + 1);
+    struct icmphdr *icmph = (void *)(iph + 1);
+    if ((void *)(icmph + 1) + ICMP_TOOBIG_DATA_LEN > data_end)
+        return XDP_DROP;
+
+    // 3. Ethernet: 들어온 방향 그대로 되돌려 보내기
+    __builtin_memcpy(eth->h_dest, smac, ETH_ALEN);
+    __builtin_memcpy(eth->h_source, dmac, ETH_ALEN);
+    eth->h_proto = bpf_htons(ETH_P_IP);
+
+    // 4. ICMP 헤더 (원본 데이터까지 포함해서 체크섬 계산)
+    icmph->type = ICMP_DEST_UNREACH;
+    icmph->code = ICMP_FRAG_NEEDED;
+    icmph->un.frag.__unused = 0;
+    icmph->un.frag.mtu = bpf_htons(mtu);
+    icmph->checksum = 0;
+    icmph->checksum = csum_fold_helper(bpf_csum_diff(0, 0, (unsigned int *)icmph,
+                                                     sizeof(*icmph) + ICMP_TOOBIG_DATA_LEN, 0));
+
+    // 5. IP 헤더: VIP -> Client
+    iph->version = 4;
+    iph->ihl = 5;
+    iph->tos = 0;
+    iph->tot_len = bpf_htons(sizeof(*iph) + sizeof(*icmph) + ICMP_TOOBIG_DATA_LEN);
+    iph->id = 0;
+    iph->frag_off = 0;
+    iph->ttl = 64;
+    iph->protocol = IPPROTO_ICMP;
+    iph->saddr = daddr;
+    iph->daddr = saddr;
+    iph->check = iph_csum(iph);
+
+    return XDP_TX;
+}
+
+static __always_inline void count_packet(__u32 idx, __u64 bytes) {
+    struct lb_stats *st = bpf_map_lookup_elem(&lb_stats, &idx);
+
+    if (st) {
+        st->packets++;
+        st->bytes += bytes;
+    }
+}
+
+// 5-tuple 해시 (murmur3 finalizer 로 섞기)
+static __always_inline __u32 mix32(__u32 h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static __always_inline __u32 flow_hash(const struct flow_key *flow) {
+    __u32 h = mix32(flow->src);
+    h = mix32(h ^ flow->dst);
+    h = mix32(h ^ (((__u32)flow->sport << 16) | flow->dport));
+    return mix32(h ^ flow->proto);
+}
+
+// VIP 찾기: VIP:port 로 먼저 찾고, 없으면 port 0 (모든 포트) 으로 다시 찾기
+static __always_inline struct vip_meta *lookup_vip(__u32 daddr, __u16 dport, __u8 proto) {
+    struct vip_key vk = {
+        .vip = daddr,
+        .port = dport,
+        .proto = proto,
+    };
+    struct vip_meta *vip = bpf_map_lookup_elem(&vip_map, &vk);
+
+    if (vip)
+        return vip;
+    vk.port = 0;
+    return bpf_map_lookup_elem(&vip_map, &vk);
+}
+
+// Real 선택: 연결 테이블에 있으면 그 Real 을 그대로 사용 (풀이 바뀌어도 유지),
+// 없거나 가리키던 Real 이 빠졌으면 (슬롯이 비었거나 세대가 다르거나, 이 VIP 풀에서 빠졌으면)
+// VIP 링에서 고르고 연결 테이블에 기록합니다.
+// 고른 Real 의 슬롯 번호는 real_out 에 담습니다.
+static __always_inline struct real_tmpl *select_real(const struct vip_meta *vip,
+                                                     struct flow_key *flow,
+                                                     __u32 *real_out) {
+    struct real_tmpl *tmpl;
+    struct conn_val *conn, cv;
+    __u32 *real_num;
+    __u32 ring_key;
+
+    conn = bpf_map_lookup_elem(&conn_table, flow);
+    if (conn) {
+        tmpl = bpf_map_lookup_elem(&reals, &conn->real_num);
+        if (tmpl && tmpl->iph.daddr && tmpl->gen == conn->gen &&
+            (vip->reals & (1ULL << (conn->real_num & (MAX_REALS - 1))))) {
+            *real_out = conn->real_num;
+            return tmpl;
+        }
+    }
+
+    ring_key = vip->vip_num * CH_RING_SIZE + flow_hash(flow) % CH_RING_SIZE;
+    real_num = bpf_map_lookup_elem(&ch_rings, &ring_key);
+    if (!real_num)
+        return NULL;
+    tmpl = bpf_map_lookup_elem(&reals, real_num);
+    if (!tmpl || !tmpl->iph.daddr)
+        return NULL; // 링이 아직 비어 있음
+
+    *real_out = *real_num;
+    cv.real_num = *real_num;
+    cv.gen = tmpl->gen;
+    bpf_map_update_elem(&conn_table, flow, &cv, BPF_ANY);
+    return tmpl;
+}
+
 // 2. 메인 XDP 프로그램
 SEC("xdp")
 int xdp_load_balancer(struct xdp_md *ctx) {
@@ -53,22 +257,58 @@ int xdp_load_balancer(struct xdp_md *ctx) {
     if ((void *)(iph + 1) > data_end)
         return XDP_PASS;
 
-    // TCP가 아니면 통과
-    if (iph->protocol != IPPROTO_TCP)
+    // TCP/UDP가 아니면 통과
+    if (iph->protocol != IPPROTO_TCP && iph->protocol != IPPROTO_UDP)
         return XDP_PASS;
 
-    // 2. 설정(백엔드 서버 정보) 가져오기
-    __u32 key = 0;
-    struct lb_config *config = bpf_map_lookup_elem(&lb_map, &key);
-    if (!config) {
+    // 포트 파싱 (TCP/UDP 모두 처음 4바이트가 source/dest 포트)
+    __u32 ihl = iph->ihl * 4;
+    if (ihl < sizeof(*iph))
+        return XDP_PASS;
+    struct udphdr *l4 = (void *)iph + ihl;
+    if ((void *)(l4 + 1) > data_end)
+        return XDP_PASS;
+
+    // 2. VIP 확인: 등록된 VIP 서비스가 아니면 통과
+    struct vip_meta *vip = lookup_vip(iph->daddr, l4->dest, iph->protocol);
+    if (!vip)
+        return XDP_PASS;
+
+    __u64 pkt_len = data_end - data;
+    count_packet(vip->vip_num, pkt_len);
+
+    // 3. 백엔드 서버(Real) 선택 후 헤더 템플릿 가져오기
+    struct flow_key flow = {
+        .src = iph->saddr,
+        .dst = iph->daddr,
+        .sport = l4->source,
+        .dport = l4->dest,
+        .proto = iph->protocol,
+    };
+    __u32 real_num;
+    struct real_tmpl *tmpl = select_real(vip, &flow, &real_num);
+    if (!tmpl) {
         return XDP_PASS; // 설정이 없으면 그냥 통과
     }
 
-    // 3. 헤더 공간 확보 (IPIP 캡슐화를 위해 IP 헤더 크기만큼 공간 늘리기)
+    // 4. Path MTU 확인: 캡슐화하면 언더레이 MTU 를 넘는 경우
+    // DF 가 있으면 ICMP fragmentation needed 로 응답합니다.
+    // DF 가 없어도 그대로 캡슐화하면 안 됩니다: XDP_TX / redirect 는 단편화하지 않으므로
+    // 나가는 드라이버가 카운터 없이 버립니다. 여기서 버리고 STATS_MTU_DROP 에 셉니다.
+    if (tmpl->mtu && bpf_ntohs(iph->tot_len) + sizeof(struct iphdr) > tmpl->mtu) {
+        if (iph->frag_off & bpf_htons(IP_DF))
+            return send_icmp_toobig(ctx, tmpl->mtu - sizeof(struct iphdr));
+        count_packet(STATS_MTU_DROP, pkt_len);
+        return XDP_DROP;
+    }
+
+    // 5. 헤더 공간 확보 (IPIP 캡슐화를 위해 IP 헤더 크기만큼 공간 늘리기)
     // bpf_xdp_adjust_head는 음수 값을 주면 헤더 공간이 늘어납니다 (앞으로 확장).
     if (bpf_xdp_adjust_head(ctx, 0 - (int)sizeof(struct iphdr)))
         return XDP_DROP; // 공간 확보 실패 시 드랍
 
+    count_packet(MAX_VIPS + real_num, pkt_len);
+
     // adjust_head 이후 포인터가 변경되므로 다시 초기화해야 함 (필수!)
     data = (void *)(long)ctx->data;
     data_end = (void *)(long)ctx->data_end;
@@ -82,32 +322,47 @@ int xdp_load_balancer(struct xdp_md *ctx) {
     if ((void *)(inner_iph + 1) > data_end)
         return XDP_DROP;
 
-    // 4. 이더넷 헤더 이동 및 수정
-    // 원본 이더넷 헤더는 adjust_head로 인해 깨졌거나 위치가 안 맞으므로
-    // 새로운 이더넷 헤더를 앞에 작성합니다.
-    // (메모리 복사 대신 직접 값을 설정합니다)
-    __builtin_memcpy(new_eth->h_dest, config->dst_mac, 6);   // 목적지: 백엔드 서버 MAC
-    __builtin_memcpy(new_eth->h_source, config->src_mac, 6); // 출발지: LB MAC
+#ifdef LB_FULL_CSUM
+    // [벤치마크 비교용] 예전 방식: 헤더를 필드 단위로 작성하고
+    // 20 바이트 전체에 대해 bpf_csum_diff 로 체크섬을 다시 계산합니다.
+    __builtin_memcpy(new_eth->h_dest, tmpl->eth.h_dest, 6);
+    __builtin_memcpy(new_eth->h_source, tmpl->eth.h_source, 6);
     new_eth->h_proto = bpf_htons(ETH_P_IP);
 
-    // 5. IPIP (Outer) IP 헤더 작성
     outer_iph->version = 4;
     outer_iph->ihl = 5;
-    outer_iph->tos = inner_iph->tos; // 원본 TOS 유지
-    // 전체 길이 = 원본 패킷 길이 + 새 IP 헤더 크기
+    outer_iph->tos = inner_iph->tos;
     outer_iph->tot_len = bpf_htons(bpf_ntohs(inner_iph->tot_len) + sizeof(struct iphdr));
-    outer_iph->id = 0; // Fragmentation 없을 경우 0 가능
+    outer_iph->id = 0;
     outer_iph->frag_off = 0;
     outer_iph->ttl = 64;
-    outer_iph->protocol = IPPROTO_IPIP; // ★ 핵심: 프로토콜 4번 (IPIP)
-    outer_iph->saddr = config->lb_vip;       // 출발지: LB VIP
-    outer_iph->daddr = config->real_server_ip; // 목적지: 백엔드 서버 IP
-    
-    // 체크섬 계산
+    outer_iph->protocol = IPPROTO_IPIP;
+    outer_iph->saddr = tmpl->iph.saddr;
+    outer_iph->daddr = tmpl->iph.daddr;
     outer_iph->check = iph_csum(outer_iph);
+#else
+    // 6. 이더넷 헤더 + IPIP (Outer) IP 헤더를 템플릿에서 통째로 복사
+    // (목적지 MAC, LB MAC, 프로토콜 4번(IPIP), VIP -> Real IP 모두 템플릿에 들어있음)
+    __builtin_memcpy(new_eth, &tmpl->eth, sizeof(*new_eth));
+    __builtin_memcpy(outer_iph, &tmpl->iph, sizeof(*outer_iph));
+
+    // 7. 패킷마다 달라지는 필드만 채우기
+    outer_iph->tos = inner_iph->tos; // 원본 TOS 유지
+    // 전체 길이 = 원본 패킷 길이 + 새 IP 헤더 크기
+    outer_iph->tot_len = bpf_htons(bpf_ntohs(inner_iph->tot_len) + sizeof(struct iphdr));
+
+    // 체크섬: 템플릿의 부분합에 tos, tot_len 워드만 더해서 접기 (증분 계산)
+    // tos 는 (version/ihl, tos) 16비트 워드의 두 번째 바이트라 htons 로 자리를 맞춥니다.
+    outer_iph->check = csum_fold_helper((__u64)tmpl->csum + outer_iph->tot_len +
+                                        bpf_htons(outer_iph->tos));
+#endif
 
-    // 6. 패킷 전송 (XDP_TX)
-    // 들어온 인터페이스로 다시 내보냅니다.
+    // 8. 패킷 전송
+    // Real 의 다음 홉이 다른 인터페이스에 있으면 그쪽으로 redirect 하고 (Router 를 거쳐 돌아가지 않음),
+    // 아니면 들어온 인터페이스로 다시 내보냅니다. (XDP_TX)
+    // tx_ports 에 없는 인터페이스면 잘못된 곳으로 나가지 않도록 버립니다.
+    if (tmpl->ifindex)
+        return bpf_redirect_map(&tx_ports, tmpl->ifindex, XDP_DROP);
     return XDP_TX;
 }
 